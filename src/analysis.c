@@ -0,0 +1,633 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "analysis.h"
+#include "analysis_kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+unsigned long
+analysis_reduce_blocks(const SampleInfo *sample_info, const unsigned char *buf, size_t num_bytes, Points *out)
+{
+    unsigned long i = 0;
+    size_t offset = 0;
+
+    unsigned int channels = MAX(1, sample_info->channels);
+    size_t bytes_per_sample = sample_info->blockAlign / channels;
+
+    analysis_kernel_func reduce = NULL;
+    if (bytes_per_sample >= 1 && bytes_per_sample <= 4) {
+        reduce = analysis_kernels_get()->reduce[bytes_per_sample - 1];
+    }
+
+    while (offset < num_bytes) {
+        size_t len = MIN(num_bytes - offset, sample_info->blockSize);
+
+        if (reduce != NULL) {
+            reduce(buf + offset, len, channels, &out[i++]);
+        } else {
+            // unsupported sample format, draw silence
+            out[i].min = out[i].max = 0;
+            i++;
+        }
+
+        offset += len;
+    }
+
+    return i;
+}
+
+static void
+analysis_free_pyramid(GraphData *graph_data)
+{
+    free(graph_data->pyramid);
+
+    graph_data->pyramid = NULL;
+    graph_data->numLevels = 0;
+    memset(graph_data->levels, 0, sizeof(graph_data->levels));
+    memset(graph_data->levelSamples, 0, sizeof(graph_data->levelSamples));
+}
+
+static gboolean
+analysis_alloc_pyramid(GraphData *graph_data)
+{
+    analysis_free_pyramid(graph_data);
+
+    unsigned long total = 0;
+    for (unsigned long n = graph_data->numSamples; n > 1; n = (n + 1) / 2) {
+        total += (n + 1) / 2;
+    }
+
+    if (total == 0) {
+        return TRUE;
+    }
+
+    // All levels live in one allocation, about the size of data itself
+    graph_data->pyramid = calloc(total, sizeof(Points));
+    if (graph_data->pyramid == NULL) {
+        printf("NULL returned from calloc of peak pyramid\n");
+        return FALSE;
+    }
+
+    Points *dst = graph_data->pyramid;
+    unsigned long n = graph_data->numSamples;
+    unsigned int level = 0;
+
+    while (n > 1 && level < GRAPH_DATA_MAX_LEVELS) {
+        n = (n + 1) / 2;
+
+        graph_data->levels[level] = dst;
+        graph_data->levelSamples[level] = n;
+        ++level;
+
+        dst += n;
+    }
+
+    graph_data->numLevels = level;
+
+    return TRUE;
+}
+
+void
+analysis_update_pyramid(GraphData *graph_data, unsigned long first, unsigned long count)
+{
+    if (count == 0 || first >= graph_data->numSamples) {
+        return;
+    }
+
+    const Points *src = graph_data->data;
+    unsigned long src_n = graph_data->numSamples;
+
+    // inclusive range of entries to recompute on the current level
+    unsigned long lo = first;
+    unsigned long hi = MIN(first + count, src_n) - 1;
+
+    for (unsigned int level = 0; level < graph_data->numLevels; level++) {
+        Points *dst = graph_data->levels[level];
+
+        lo /= 2;
+        hi /= 2;
+
+        for (unsigned long j = lo; j <= hi; j++) {
+            Points p = src[2*j];
+
+            if (2*j + 1 < src_n) {
+                p.min = MIN(p.min, src[2*j+1].min);
+                p.max = MAX(p.max, src[2*j+1].max);
+            }
+
+            dst[j] = p;
+        }
+
+        src = dst;
+        src_n = graph_data->levelSamples[level];
+    }
+}
+
+gboolean
+analysis_build_pyramid(GraphData *graph_data)
+{
+    if (!analysis_alloc_pyramid(graph_data)) {
+        return FALSE;
+    }
+
+    analysis_update_pyramid(graph_data, 0, graph_data->numSamples);
+
+    return TRUE;
+}
+
+unsigned long
+analysis_get_valid_blocks(const GraphData *graph_data)
+{
+    return g_atomic_int_get(&graph_data->validSamples);
+}
+
+unsigned long
+analysis_get_analyzed_blocks(const GraphData *graph_data)
+{
+    return g_atomic_int_get(&graph_data->analyzedSamples);
+}
+
+gboolean
+analysis_is_block_valid(const GraphData *graph_data, unsigned long block)
+{
+    if (block < analysis_get_valid_blocks(graph_data)) {
+        return TRUE;
+    }
+
+    if (graph_data->chunkValid == NULL || block >= graph_data->numSamples) {
+        return FALSE;
+    }
+
+    return g_atomic_int_get(&graph_data->chunkValid[block / graph_data->chunkBlocks]);
+}
+
+void
+analysis_control_init(AnalysisControl *control)
+{
+    memset(control, 0, sizeof(*control));
+    g_mutex_init(&control->mutex);
+}
+
+void
+analysis_control_clear(AnalysisControl *control)
+{
+    g_mutex_clear(&control->mutex);
+}
+
+void
+analysis_control_set_focus(AnalysisControl *control, unsigned long first, unsigned long count)
+{
+    g_mutex_lock(&control->mutex);
+    if (control->focus_first != first || control->focus_count != count) {
+        control->focus_first = first;
+        control->focus_count = count;
+        ++control->focus_serial;
+    }
+    g_mutex_unlock(&control->mutex);
+}
+
+void
+analysis_control_cancel(AnalysisControl *control)
+{
+    g_atomic_int_set(&control->cancelled, TRUE);
+}
+
+gboolean
+analysis_control_is_cancelled(AnalysisControl *control)
+{
+    return g_atomic_int_get(&control->cancelled);
+}
+
+void
+analysis_get_peaks(const GraphData *graph_data, unsigned long first, unsigned long count, Points *out)
+{
+    int min = 0, max = 0;
+
+    const Points *data = graph_data->data;
+    unsigned long lo = first;
+    unsigned long hi = MIN(first + count, graph_data->numSamples);
+    unsigned int level = 0;
+
+    while (lo < hi) {
+        if (hi - lo > 2 && level < graph_data->numLevels) {
+            // Consume unaligned entries at both ends, then go up one level
+            if (lo % 2 == 1) {
+                min = MIN(min, data[lo].min);
+                max = MAX(max, data[lo].max);
+                ++lo;
+            }
+
+            if (hi % 2 == 1) {
+                --hi;
+                min = MIN(min, data[hi].min);
+                max = MAX(max, data[hi].max);
+            }
+
+            data = graph_data->levels[level++];
+            lo /= 2;
+            hi /= 2;
+        } else {
+            for (; lo < hi; lo++) {
+                min = MIN(min, data[lo].min);
+                max = MAX(max, data[lo].max);
+            }
+        }
+    }
+
+    out->min = min;
+    out->max = max;
+}
+
+typedef struct AnalysisJob_ AnalysisJob;
+struct AnalysisJob_ {
+    const SampleInfo *sample_info;
+    GraphData *graph_data;
+    Points *points;
+
+    unsigned long num_blocks;
+    unsigned long chunk_blocks;
+    gint num_chunks;
+
+    volatile gint blocks_done;
+
+    // protects the scheduling state, the peak pyramid and the watermark
+    GMutex mutex;
+    guint8 *chunk_state;
+    gint watermark_chunk;
+    gint backfill_chunk;
+
+    AnalysisControl *control;
+    guint focus_serial;
+
+    analysis_progress_func progress;
+    void *progress_user_data;
+};
+
+typedef struct AnalysisWorker_ AnalysisWorker;
+struct AnalysisWorker_ {
+    AnalysisJob *job;
+
+    OpenedAudioFile *file;
+    gboolean owns_file;
+    GThread *thread;
+
+    // partial results, merged after all workers finished
+    int min_sample;
+    int max_sample;
+    uint64_t bytes;
+    unsigned long blocks;
+    gboolean mapped;
+};
+
+static guint
+analysis_get_num_workers(OpenedAudioFile *file, gint num_chunks)
+{
+    if (!file->mod->random_access) {
+        // Decoders must be fed sequentially from a single handle
+        return 1;
+    }
+
+    return CLAMP(g_get_num_processors(), 1, num_chunks);
+}
+
+enum ChunkState {
+    CHUNK_PENDING = 0,
+    CHUNK_RUNNING,
+    CHUNK_DONE,
+};
+
+static gint
+analysis_find_pending_chunk(AnalysisJob *job, gint first, gint last)
+{
+    for (gint chunk = first; chunk <= last; chunk++) {
+        if (job->chunk_state[chunk] == CHUNK_PENDING) {
+            return chunk;
+        }
+    }
+
+    return -1;
+}
+
+static gint
+analysis_claim_chunk(AnalysisJob *job)
+{
+    gint chunk = -1;
+
+    if (job->control != NULL && analysis_control_is_cancelled(job->control)) {
+        return -1;
+    }
+
+    g_mutex_lock(&job->mutex);
+
+    if (job->control != NULL) {
+        g_mutex_lock(&job->control->mutex);
+        unsigned long focus_first = job->control->focus_first;
+        unsigned long focus_count = job->control->focus_count;
+        guint focus_serial = job->control->focus_serial;
+        g_mutex_unlock(&job->control->mutex);
+
+        if (focus_count > 0 && focus_first < job->num_blocks) {
+            gint first = focus_first / job->chunk_blocks;
+            gint last = MIN(focus_first + focus_count - 1, job->num_blocks - 1) / job->chunk_blocks;
+
+            if (focus_serial != job->focus_serial) {
+                // Re-prioritize: back-fill from the new focus onwards
+                job->focus_serial = focus_serial;
+                job->backfill_chunk = last + 1;
+            }
+
+            chunk = analysis_find_pending_chunk(job, first, last);
+        }
+    }
+
+    if (chunk == -1) {
+        chunk = analysis_find_pending_chunk(job, job->backfill_chunk, job->num_chunks - 1);
+    }
+
+    if (chunk == -1) {
+        chunk = analysis_find_pending_chunk(job, 0, job->num_chunks - 1);
+    }
+
+    if (chunk != -1) {
+        job->chunk_state[chunk] = CHUNK_RUNNING;
+        job->backfill_chunk = chunk + 1;
+    }
+
+    g_mutex_unlock(&job->mutex);
+
+    return chunk;
+}
+
+static void
+analysis_publish_chunk(AnalysisJob *job, gint chunk, unsigned long first, unsigned long count)
+{
+    GraphData *graph_data = job->graph_data;
+
+    g_mutex_lock(&job->mutex);
+
+    analysis_update_pyramid(graph_data, first, count);
+
+    job->chunk_state[chunk] = CHUNK_DONE;
+    g_atomic_int_set(&graph_data->chunkValid[chunk], TRUE);
+    g_atomic_int_add(&graph_data->analyzedSamples, count);
+
+    // Chunks finish out of order, the watermark only covers a gapless prefix
+    while (job->watermark_chunk < job->num_chunks && job->chunk_state[job->watermark_chunk] == CHUNK_DONE) {
+        ++job->watermark_chunk;
+    }
+
+    g_atomic_int_set(&graph_data->validSamples,
+            MIN(job->watermark_chunk * job->chunk_blocks, job->num_blocks));
+
+    g_mutex_unlock(&job->mutex);
+}
+
+static gpointer
+analysis_worker_thread(gpointer data)
+{
+    AnalysisWorker *worker = data;
+    AnalysisJob *job = worker->job;
+    const SampleInfo *sample_info = job->sample_info;
+
+    size_t buf_size = job->chunk_blocks * sample_info->blockSize;
+    unsigned char *buf = NULL;
+
+    gint chunk;
+    while ((chunk = analysis_claim_chunk(job)) != -1) {
+        unsigned long first = chunk * job->chunk_blocks;
+        unsigned long count = MIN(job->chunk_blocks, job->num_blocks - first);
+        uint64_t pos = (uint64_t)first * sample_info->blockSize;
+
+        size_t want = count * sample_info->blockSize;
+        size_t filled = want;
+
+        // Reduce straight from the page cache if the file is mapped
+        const unsigned char *data = format_map_samples(worker->file, pos, &filled, FORMAT_ACCESS_SEQUENTIAL);
+
+        if (data != NULL) {
+            worker->mapped = TRUE;
+        } else {
+            if (buf == NULL && (buf = malloc(buf_size)) == NULL) {
+                // Publish the chunk empty, so that the analysis still finishes
+                printf("NULL returned from malloc of analysis buffer\n");
+                want = 0;
+            }
+
+            // Compressed formats may return short reads, fill up the buffer
+            filled = 0;
+            while (filled < want) {
+                long ret = format_read_samples(worker->file, buf + filled, want - filled, pos + filled);
+                if (ret <= 0) {
+                    break;
+                }
+
+                filled += ret;
+            }
+
+            data = buf;
+        }
+
+        unsigned long n = analysis_reduce_blocks(sample_info, data, filled, job->points + first);
+
+        for (unsigned long k = first; k < first + n; k++) {
+            int amp = job->points[k].max - job->points[k].min;
+
+            if (worker->min_sample > amp) {
+                worker->min_sample = amp;
+            }
+            if (worker->max_sample < amp) {
+                worker->max_sample = amp;
+            }
+        }
+
+        worker->bytes += filled;
+        worker->blocks += n;
+
+        analysis_publish_chunk(job, chunk, first, count);
+
+        // Count the whole chunk, so that progress reaches 100% at EOF
+        gint done = g_atomic_int_add(&job->blocks_done, count) + count;
+
+        if (job->progress != NULL) {
+            job->progress(done, job->num_blocks, job->progress_user_data);
+        }
+    }
+
+    free(buf);
+
+    return NULL;
+}
+
+gboolean
+analysis_prepare(OpenedAudioFile *file, GraphData *graph_data)
+{
+    SampleInfo *sample_info = &file->sample_info;
+
+    unsigned long num_blocks = sample_info->numBytes / sample_info->blockSize + 1;
+
+    Points *points = calloc(num_blocks, sizeof(Points));
+    if (points == NULL) {
+        printf("NULL returned from calloc of graph_data\n");
+        return FALSE;
+    }
+
+    if (graph_data->data != NULL) {
+        free(graph_data->data);
+    }
+
+    graph_data->data = points;
+    graph_data->numSamples = num_blocks;
+    graph_data->minSampleAmp = 0;
+    graph_data->maxSampleAmp = 0;
+    g_atomic_int_set(&graph_data->validSamples, 0);
+    g_atomic_int_set(&graph_data->analyzedSamples, 0);
+
+    g_free((gpointer)graph_data->chunkValid);
+    graph_data->chunkBlocks = MAX(1, ANALYSIS_BUFFER_SIZE / sample_info->blockSize);
+    graph_data->numChunks = (num_blocks + graph_data->chunkBlocks - 1) / graph_data->chunkBlocks;
+    graph_data->chunkValid = g_new0(gint, graph_data->numChunks);
+
+    if (sample_info->bitsPerSample == 8) {
+        graph_data->maxSampleValue = UCHAR_MAX;
+    } else if (sample_info->bitsPerSample == 16) {
+        graph_data->maxSampleValue = SHRT_MAX;
+    } else if (sample_info->bitsPerSample == 24 || sample_info->bitsPerSample == 32) {
+        // 32-bit samples are scaled down to 24 bits by the kernels
+        graph_data->maxSampleValue = 0x7fffff;
+    }
+
+    return analysis_alloc_pyramid(graph_data);
+}
+
+void
+analysis_free(GraphData *graph_data)
+{
+    analysis_free_pyramid(graph_data);
+
+    g_free((gpointer)graph_data->chunkValid);
+    graph_data->chunkValid = NULL;
+
+    free(graph_data->data);
+    graph_data->data = NULL;
+}
+
+gboolean
+analysis_run(OpenedAudioFile *file, GraphData *graph_data, AnalysisControl *control, analysis_progress_func progress, void *progress_user_data, AnalysisStats *stats)
+{
+    SampleInfo *sample_info = &file->sample_info;
+
+    gint64 started = g_get_monotonic_time();
+
+    AnalysisJob job;
+    memset(&job, 0, sizeof(job));
+
+    job.sample_info = sample_info;
+    job.graph_data = graph_data;
+    job.points = graph_data->data;
+    job.num_blocks = graph_data->numSamples;
+    job.chunk_blocks = graph_data->chunkBlocks;
+    job.num_chunks = graph_data->numChunks;
+    job.control = control;
+    job.progress = progress;
+    job.progress_user_data = progress_user_data;
+
+    g_mutex_init(&job.mutex);
+    job.chunk_state = g_new0(guint8, job.num_chunks);
+
+    guint num_workers = analysis_get_num_workers(file, job.num_chunks);
+    AnalysisWorker *workers = g_new0(AnalysisWorker, num_workers);
+
+    for (guint w = 0; w < num_workers; w++) {
+        AnalysisWorker *worker = &workers[w];
+
+        worker->job = &job;
+        worker->min_sample = SHRT_MAX; /* highest value for 16-bit samples */
+        worker->max_sample = 0;
+
+        if (w == 0) {
+            // The first worker runs on the calling thread with the caller's handle
+            worker->file = file;
+            continue;
+        }
+
+        char *error_message = NULL;
+        worker->file = format_reopen_file(file, &error_message);
+        if (worker->file == NULL) {
+            g_warning("Could not open additional analysis handle: %s", error_message);
+            g_free(error_message);
+            continue;
+        }
+
+        worker->owns_file = TRUE;
+        worker->thread = g_thread_new("analysis", analysis_worker_thread, worker);
+    }
+
+    analysis_worker_thread(&workers[0]);
+
+    int min_sample = SHRT_MAX;
+    int max_sample = 0;
+    uint64_t bytes = 0;
+    unsigned long blocks = 0;
+    gboolean mapped = FALSE;
+
+    for (guint w = 0; w < num_workers; w++) {
+        AnalysisWorker *worker = &workers[w];
+
+        if (worker->thread != NULL) {
+            g_thread_join(g_steal_pointer(&worker->thread));
+        }
+
+        if (worker->owns_file) {
+            format_close_file(g_steal_pointer(&worker->file));
+        }
+
+        min_sample = MIN(min_sample, worker->min_sample);
+        max_sample = MAX(max_sample, worker->max_sample);
+        bytes += worker->bytes;
+        blocks += worker->blocks;
+        mapped = mapped || worker->mapped;
+    }
+
+    g_free(workers);
+    g_free(job.chunk_state);
+    g_mutex_clear(&job.mutex);
+
+    if (control != NULL && analysis_control_is_cancelled(control)) {
+        // Published chunks stay valid, the rest of graph_data is incomplete
+        return FALSE;
+    }
+
+    graph_data->minSampleAmp = min_sample;
+    graph_data->maxSampleAmp = max_sample;
+    g_atomic_int_set(&graph_data->validSamples, graph_data->numSamples);
+
+    if (stats != NULL) {
+        stats->bytes = bytes;
+        stats->blocks = blocks;
+        stats->duration = g_get_monotonic_time() - started;
+        stats->workers = num_workers;
+        stats->mapped = mapped;
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,133 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "sample.h"
+#include "format.h"
+
+/**
+ * Target size of one read from the format module during analysis. The
+ * buffer is rounded down to a multiple of the sample block size, so that
+ * every read can be reduced to Points without carrying over leftovers.
+ **/
+#define ANALYSIS_BUFFER_SIZE (4 * 1024 * 1024)
+
+typedef void (*analysis_progress_func)(unsigned long blocks_done, unsigned long blocks_total, void *user_data);
+
+/**
+ * Lets other threads steer a running analysis_run(): chunks overlapping
+ * the focus range are analyzed first, then the rest of the file is
+ * back-filled starting right after the focus range. After
+ * analysis_control_cancel(), workers stop before their next chunk.
+ **/
+typedef struct AnalysisControl_ AnalysisControl;
+struct AnalysisControl_ {
+    GMutex mutex;
+    unsigned long focus_first;
+    unsigned long focus_count;
+    guint focus_serial;
+    volatile gint cancelled;
+};
+
+void
+analysis_control_init(AnalysisControl *control);
+
+void
+analysis_control_clear(AnalysisControl *control);
+
+void
+analysis_control_set_focus(AnalysisControl *control, unsigned long first, unsigned long count);
+
+void
+analysis_control_cancel(AnalysisControl *control);
+
+gboolean
+analysis_control_is_cancelled(AnalysisControl *control);
+
+/**
+ * Reduce a buffer of interleaved PCM data to one Points entry per sample
+ * block (the last block may be partial). Returns the number of entries
+ * written to out.
+ **/
+unsigned long
+analysis_reduce_blocks(const SampleInfo *sample_info, const unsigned char *buf, size_t num_bytes, Points *out);
+
+/**
+ * Allocate graph_data for the blocks of file, including the peak pyramid.
+ * All entries start out as zero and no blocks are valid yet; the data can
+ * be shared with readers before analysis_run() fills it in.
+ **/
+gboolean
+analysis_prepare(OpenedAudioFile *file, GraphData *graph_data);
+
+/* Free everything allocated by analysis_prepare() */
+void
+analysis_free(GraphData *graph_data);
+
+/**
+ * Number of blocks at the start of graph_data that have been analyzed
+ * (the valid-prefix watermark). Safe to call while analysis is running.
+ **/
+unsigned long
+analysis_get_valid_blocks(const GraphData *graph_data);
+
+/* Total number of analyzed blocks, including those beyond the watermark */
+unsigned long
+analysis_get_analyzed_blocks(const GraphData *graph_data);
+
+gboolean
+analysis_is_block_valid(const GraphData *graph_data, unsigned long block);
+
+/**
+ * (Re-)build the peak pyramid of graph_data from its data array.
+ **/
+gboolean
+analysis_build_pyramid(GraphData *graph_data);
+
+/**
+ * Recompute the pyramid entries covering count blocks starting at first.
+ * Blocks that have not been analyzed yet are zero, which is neutral for
+ * min/max, so partially analyzed data can be reduced at any time.
+ **/
+void
+analysis_update_pyramid(GraphData *graph_data, unsigned long first, unsigned long count);
+
+/**
+ * Get the min/max over count blocks starting at block first, using the
+ * peak pyramid if it is available. The range is clipped to numSamples.
+ **/
+void
+analysis_get_peaks(const GraphData *graph_data, unsigned long first, unsigned long count, Points *out);
+
+/**
+ * Run a full analysis pass over file and store the result in graph_data,
+ * which must have been set up with analysis_prepare().
+ *
+ * The file is split into chunks of ANALYSIS_BUFFER_SIZE bytes. For random
+ * access formats, a pool of workers (one per CPU, each with its own file
+ * handle and scratch buffer) fills disjoint slices of graph_data; other
+ * formats are analyzed on the calling thread, using decoder seeks to
+ * follow the focus of control (which may be NULL). The progress callback
+ * may be called from any of the worker threads. Each finished chunk is
+ * published (peak pyramid, chunk flag and watermark) right away.
+ *
+ * Returns FALSE if the analysis was cancelled through control.
+ **/
+gboolean
+analysis_run(OpenedAudioFile *file, GraphData *graph_data, AnalysisControl *control, analysis_progress_func progress, void *progress_user_data, AnalysisStats *stats);
@@ -0,0 +1,529 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "analysis_kernels.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ANALYSIS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+/* Portable kernels */
+
+static void
+reduce_u8_scalar(const unsigned char *buf, size_t len, unsigned int channels, Points *out)
+{
+    int min = 0, max = 0;
+
+    for (size_t k = 0; k < len; k += channels) {
+        int v = buf[k] - 128;
+
+        if (v > max) {
+            max = v;
+        } else if (v < min) {
+            min = v;
+        }
+    }
+
+    out->min = min;
+    out->max = max;
+}
+
+static void
+reduce_s16_scalar(const unsigned char *buf, size_t len, unsigned int channels, Points *out)
+{
+    int min = 0, max = 0;
+
+    for (size_t k = 0; k + 2 <= len; k += 2 * channels) {
+        int v = (int16_t)(buf[k] | (buf[k+1] << 8));
+
+        if (v > max) {
+            max = v;
+        } else if (v < min) {
+            min = v;
+        }
+    }
+
+    out->min = min;
+    out->max = max;
+}
+
+static void
+reduce_s24_scalar(const unsigned char *buf, size_t len, unsigned int channels, Points *out)
+{
+    int min = 0, max = 0;
+
+    for (size_t k = 0; k + 3 <= len; k += 3 * channels) {
+        int v = buf[k] | (buf[k+1] << 8) | ((signed char)buf[k+2] << 16);
+
+        if (v > max) {
+            max = v;
+        } else if (v < min) {
+            min = v;
+        }
+    }
+
+    out->min = min;
+    out->max = max;
+}
+
+static void
+reduce_s32_scalar(const unsigned char *buf, size_t len, unsigned int channels, Points *out)
+{
+    int32_t min = 0, max = 0;
+
+    for (size_t k = 0; k + 4 <= len; k += 4 * channels) {
+        int32_t v = (int32_t)((uint32_t)buf[k] | ((uint32_t)buf[k+1] << 8) |
+                              ((uint32_t)buf[k+2] << 16) | ((uint32_t)buf[k+3] << 24));
+
+        if (v > max) {
+            max = v;
+        } else if (v < min) {
+            min = v;
+        }
+    }
+
+    out->min = min >> 8;
+    out->max = max >> 8;
+}
+
+static const AnalysisKernel
+SCALAR_KERNEL = {
+    .name = "scalar",
+    .reduce = {
+        reduce_u8_scalar,
+        reduce_s16_scalar,
+        reduce_s24_scalar,
+        reduce_s32_scalar,
+    },
+};
+
+
+#if defined(ANALYSIS_X86_KERNELS)
+
+/**
+ * The vector kernels process whole registers of interleaved samples. Lanes
+ * that belong to other channels than the first are masked to the neutral
+ * value (zero, or 0x80 for unsigned 8-bit), which only works if the number
+ * of channels divides the number of lanes; all other layouts, and the tail
+ * of each block, are handled by the portable kernels.
+ **/
+
+static inline gboolean
+channels_divide_lanes(unsigned int channels, unsigned int lanes)
+{
+    return channels != 0 && channels <= lanes && (lanes % channels) == 0;
+}
+
+/* SSE2 */
+
+__attribute__((target("sse2")))
+static inline __m128i
+lane_mask_sse2(unsigned int channels, unsigned int lane_bytes)
+{
+    unsigned char mask[16];
+
+    for (unsigned int i = 0; i < 16; i++) {
+        mask[i] = ((i / lane_bytes) % channels == 0) ? 0xff : 0x00;
+    }
+
+    return _mm_loadu_si128((const __m128i *)mask);
+}
+
+__attribute__((target("sse2")))
+static void
+reduce_u8_sse2(const unsigned char *buf, size_t len, unsigned int channels, Points *out)
+{
+    if (!channels_divide_lanes(channels, 16)) {
+        reduce_u8_scalar(buf, len, channels, out);
+        return;
+    }
+
+    const __m128i mask = lane_mask_sse2(channels, 1);
+    const __m128i neutral = _mm_andnot_si128(mask, _mm_set1_epi8((char)0x80));
+    __m128i vmin = _mm_set1_epi8((char)0x80);
+    __m128i vmax = vmin;
+
+    size_t k = 0;
+    for (; k + 16 <= len; k += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(buf + k));
+        v = _mm_or_si128(_mm_and_si128(v, mask), neutral);
+        vmin = _mm_min_epu8(vmin, v);
+        vmax = _mm_max_epu8(vmax, v);
+    }
+
+    unsigned char lmin[16], lmax[16];
+    _mm_storeu_si128((__m128i *)lmin, vmin);
+    _mm_storeu_si128((__m128i *)lmax, vmax);
+
+    Points tail;
+    reduce_u8_scalar(buf + k, len - k, channels, &tail);
+
+    int min = tail.min, max = tail.max;
+    for (int i = 0; i < 16; i++) {
+        min = MIN(min, lmin[i] - 128);
+        max = MAX(max, lmax[i] - 128);
+    }
+
+    out->min = min;
+    out->max = max;
+}
+
+__attribute__((target("sse2")))
+static void
+reduce_s16_sse2(const unsigned char *buf, size_t len, unsigned int channels, Points *out)
+{
+    if (!channels_divide_lanes(channels, 8)) {
+        reduce_s16_scalar(buf, len, channels, out);
+        return;
+    }
+
+    const __m128i mask = lane_mask_sse2(channels, 2);
+    __m128i vmin = _mm_setzero_si128();
+    __m128i vmax = _mm_setzero_si128();
+
+    size_t k = 0;
+    for (; k + 16 <= len; k += 16) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(buf + k)), mask);
+        vmin = _mm_min_epi16(vmin, v);
+        vmax = _mm_max_epi16(vmax, v);
+    }
+
+    int16_t lmin[8], lmax[8];
+    _mm_storeu_si128((__m128i *)lmin, vmin);
+    _mm_storeu_si128((__m128i *)lmax, vmax);
+
+    Points tail;
+    reduce_s16_scalar(buf + k, len - k, channels, &tail);
+
+    int min = tail.min, max = tail.max;
+    for (int i = 0; i < 8; i++) {
+        min = MIN(min, lmin[i]);
+        max = MAX(max, lmax[i]);
+    }
+
+    out->min = min;
+    out->max = max;
+}
+
+__attribute__((target("sse2")))
+static void
+reduce_s32_sse2(const unsigned char *buf, size_t len, unsigned int channels, Points *out)
+{
+    if (!channels_divide_lanes(channels, 4)) {
+        reduce_s32_scalar(buf, len, channels, out);
+        return;
+    }
+
+    const __m128i mask = lane_mask_sse2(channels, 4);
+    __m128i vmin = _mm_setzero_si128();
+    __m128i vmax = _mm_setzero_si128();
+
+    size_t k = 0;
+    for (; k + 16 <= len; k += 16) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(buf + k)), mask);
+
+        // SSE2 has no 32-bit min/max, select via compare masks
+        __m128i lt = _mm_cmplt_epi32(v, vmin);
+        vmin = _mm_or_si128(_mm_and_si128(lt, v), _mm_andnot_si128(lt, vmin));
+        __m128i gt = _mm_cmpgt_epi32(v, vmax);
+        vmax = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, vmax));
+    }
+
+    int32_t lmin[4], lmax[4];
+    _mm_storeu_si128((__m128i *)lmin, vmin);
+    _mm_storeu_si128((__m128i *)lmax, vmax);
+
+    Points tail;
+    reduce_s32_scalar(buf + k, len - k, channels, &tail);
+
+    int min = tail.min, max = tail.max;
+    for (int i = 0; i < 4; i++) {
+        min = MIN(min, lmin[i] >> 8);
+        max = MAX(max, lmax[i] >> 8);
+    }
+
+    out->min = min;
+    out->max = max;
+}
+
+static const AnalysisKernel
+SSE2_KERNEL = {
+    .name = "sse2",
+    .reduce = {
+        reduce_u8_sse2,
+        reduce_s16_sse2,
+        // unpacking 3-byte samples needs a byte shuffle (SSSE3 and up)
+        reduce_s24_scalar,
+        reduce_s32_sse2,
+    },
+};
+
+/* AVX2 */
+
+__attribute__((target("avx2")))
+static inline __m256i
+lane_mask_avx2(unsigned int channels, unsigned int lane_bytes)
+{
+    unsigned char mask[32];
+
+    for (unsigned int i = 0; i < 32; i++) {
+        mask[i] = ((i / lane_bytes) % channels == 0) ? 0xff : 0x00;
+    }
+
+    return _mm256_loadu_si256((const __m256i *)mask);
+}
+
+__attribute__((target("avx2")))
+static void
+reduce_u8_avx2(const unsigned char *buf, size_t len, unsigned int channels, Points *out)
+{
+    if (!channels_divide_lanes(channels, 32)) {
+        reduce_u8_scalar(buf, len, channels, out);
+        return;
+    }
+
+    const __m256i mask = lane_mask_avx2(channels, 1);
+    const __m256i neutral = _mm256_andnot_si256(mask, _mm256_set1_epi8((char)0x80));
+    __m256i vmin = _mm256_set1_epi8((char)0x80);
+    __m256i vmax = vmin;
+
+    size_t k = 0;
+    for (; k + 32 <= len; k += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(buf + k));
+        v = _mm256_or_si256(_mm256_and_si256(v, mask), neutral);
+        vmin = _mm256_min_epu8(vmin, v);
+        vmax = _mm256_max_epu8(vmax, v);
+    }
+
+    unsigned char lmin[32], lmax[32];
+    _mm256_storeu_si256((__m256i *)lmin, vmin);
+    _mm256_storeu_si256((__m256i *)lmax, vmax);
+
+    Points tail;
+    reduce_u8_scalar(buf + k, len - k, channels, &tail);
+
+    int min = tail.min, max = tail.max;
+    for (int i = 0; i < 32; i++) {
+        min = MIN(min, lmin[i] - 128);
+        max = MAX(max, lmax[i] - 128);
+    }
+
+    out->min = min;
+    out->max = max;
+}
+
+__attribute__((target("avx2")))
+static void
+reduce_s16_avx2(const unsigned char *buf, size_t len, unsigned int channels, Points *out)
+{
+    if (!channels_divide_lanes(channels, 16)) {
+        reduce_s16_scalar(buf, len, channels, out);
+        return;
+    }
+
+    const __m256i mask = lane_mask_avx2(channels, 2);
+    __m256i vmin = _mm256_setzero_si256();
+    __m256i vmax = _mm256_setzero_si256();
+
+    size_t k = 0;
+    for (; k + 32 <= len; k += 32) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(buf + k)), mask);
+        vmin = _mm256_min_epi16(vmin, v);
+        vmax = _mm256_max_epi16(vmax, v);
+    }
+
+    int16_t lmin[16], lmax[16];
+    _mm256_storeu_si256((__m256i *)lmin, vmin);
+    _mm256_storeu_si256((__m256i *)lmax, vmax);
+
+    Points tail;
+    reduce_s16_scalar(buf + k, len - k, channels, &tail);
+
+    int min = tail.min, max = tail.max;
+    for (int i = 0; i < 16; i++) {
+        min = MIN(min, lmin[i]);
+        max = MAX(max, lmax[i]);
+    }
+
+    out->min = min;
+    out->max = max;
+}
+
+__attribute__((target("avx2")))
+static void
+reduce_s24_avx2(const unsigned char *buf, size_t len, unsigned int channels, Points *out)
+{
+    if (!channels_divide_lanes(channels, 8)) {
+        reduce_s24_scalar(buf, len, channels, out);
+        return;
+    }
+
+    // Move each 3-byte sample into the upper 24 bits of a 32-bit lane
+    const __m256i shuffle = _mm256_setr_epi8(
+            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    const __m256i mask = lane_mask_avx2(channels, 4);
+    __m256i vmin = _mm256_setzero_si256();
+    __m256i vmax = _mm256_setzero_si256();
+
+    size_t k = 0;
+    // 8 samples (24 bytes) per iteration, the second load reads 4 bytes past them
+    for (; k + 28 <= len; k += 24) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(buf + k));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(buf + k + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+        v = _mm256_srai_epi32(_mm256_shuffle_epi8(v, shuffle), 8);
+        v = _mm256_and_si256(v, mask);
+
+        vmin = _mm256_min_epi32(vmin, v);
+        vmax = _mm256_max_epi32(vmax, v);
+    }
+
+    int32_t lmin[8], lmax[8];
+    _mm256_storeu_si256((__m256i *)lmin, vmin);
+    _mm256_storeu_si256((__m256i *)lmax, vmax);
+
+    Points tail;
+    reduce_s24_scalar(buf + k, len - k, channels, &tail);
+
+    int min = tail.min, max = tail.max;
+    for (int i = 0; i < 8; i++) {
+        min = MIN(min, lmin[i]);
+        max = MAX(max, lmax[i]);
+    }
+
+    out->min = min;
+    out->max = max;
+}
+
+__attribute__((target("avx2")))
+static void
+reduce_s32_avx2(const unsigned char *buf, size_t len, unsigned int channels, Points *out)
+{
+    if (!channels_divide_lanes(channels, 8)) {
+        reduce_s32_scalar(buf, len, channels, out);
+        return;
+    }
+
+    const __m256i mask = lane_mask_avx2(channels, 4);
+    __m256i vmin = _mm256_setzero_si256();
+    __m256i vmax = _mm256_setzero_si256();
+
+    size_t k = 0;
+    for (; k + 32 <= len; k += 32) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(buf + k)), mask);
+        vmin = _mm256_min_epi32(vmin, v);
+        vmax = _mm256_max_epi32(vmax, v);
+    }
+
+    int32_t lmin[8], lmax[8];
+    _mm256_storeu_si256((__m256i *)lmin, vmin);
+    _mm256_storeu_si256((__m256i *)lmax, vmax);
+
+    Points tail;
+    reduce_s32_scalar(buf + k, len - k, channels, &tail);
+
+    int min = tail.min, max = tail.max;
+    for (int i = 0; i < 8; i++) {
+        min = MIN(min, lmin[i] >> 8);
+        max = MAX(max, lmax[i] >> 8);
+    }
+
+    out->min = min;
+    out->max = max;
+}
+
+static const AnalysisKernel
+AVX2_KERNEL = {
+    .name = "avx2",
+    .reduce = {
+        reduce_u8_avx2,
+        reduce_s16_avx2,
+        reduce_s24_avx2,
+        reduce_s32_avx2,
+    },
+};
+
+#endif /* ANALYSIS_X86_KERNELS */
+
+
+static const AnalysisKernel *
+g_kernels[4] = { NULL };
+
+static const AnalysisKernel *
+g_kernel = &SCALAR_KERNEL;
+
+void
+analysis_kernels_init(void)
+{
+    static gboolean kernels_inited = FALSE;
+
+    if (kernels_inited) {
+        return;
+    }
+
+    int n = 0;
+    g_kernels[n++] = &SCALAR_KERNEL;
+
+#if defined(ANALYSIS_X86_KERNELS)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2")) {
+        g_kernels[n++] = &SSE2_KERNEL;
+    }
+
+    if (__builtin_cpu_supports("avx2")) {
+        g_kernels[n++] = &AVX2_KERNEL;
+    }
+#endif /* ANALYSIS_X86_KERNELS */
+
+    // The last entry is the most capable one
+    g_kernel = g_kernels[n - 1];
+
+    const char *override = getenv("WAVBREAKER_ANALYSIS_KERNEL");
+    if (override != NULL) {
+        for (int i = 0; i < n; i++) {
+            if (strcmp(g_kernels[i]->name, override) == 0) {
+                g_kernel = g_kernels[i];
+            }
+        }
+    }
+
+    g_debug("Using %s waveform analysis kernels", g_kernel->name);
+
+    kernels_inited = TRUE;
+}
+
+const AnalysisKernel *
+analysis_kernels_get(void)
+{
+    return g_kernel;
+}
+
+const AnalysisKernel * const *
+analysis_kernels_list(void)
+{
+    return g_kernels;
+}
@@ -0,0 +1,54 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "sample.h"
+
+#include <stddef.h>
+
+/**
+ * Reduce one sample block of interleaved PCM data to its min/max value.
+ * Only the first channel is considered, and min/max always include zero.
+ * 32-bit samples are scaled down to 24 bits so that amplitudes fit an int.
+ **/
+typedef void (*analysis_kernel_func)(const unsigned char *buf, size_t len, unsigned int channels, Points *out);
+
+typedef struct AnalysisKernel_ AnalysisKernel;
+struct AnalysisKernel_ {
+    const char *name;
+
+    /* indexed by (bytes per sample - 1): 8-bit unsigned, 16-bit LE,
+     * packed 24-bit LE and 32-bit LE */
+    analysis_kernel_func reduce[4];
+};
+
+/**
+ * Select the fastest kernel set supported by the CPU. Setting the
+ * environment variable WAVBREAKER_ANALYSIS_KERNEL to the name of a kernel
+ * set ("scalar", "sse2", "avx2") overrides the automatic selection.
+ **/
+void
+analysis_kernels_init(void);
+
+const AnalysisKernel *
+analysis_kernels_get(void);
+
+/* NULL-terminated list of all kernel sets usable on this CPU */
+const AnalysisKernel * const *
+analysis_kernels_list(void);
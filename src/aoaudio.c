@@ -20,56 +20,179 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <glib.h>
 #include <ao/ao.h>
 
 #include "aoaudio.h"
 
+/* How long an unused device stays open for the next play */
+#define AO_AUDIO_IDLE_TIMEOUT (30 * G_USEC_PER_SEC)
+
+/**
+ * The library and one device stay open between plays, so starting again
+ * (e.g. while scrubbing) does not pay for the driver initialization each
+ * time. The device is reopened when the sample format changes, and closed
+ * by a reaper thread once it was unused for AO_AUDIO_IDLE_TIMEOUT.
+ *
+ * The lock guards the device against the reaper; the (single) user writes
+ * without it between open and close.
+ *
+ * Closing does not drain the device: audio written by a play that was
+ * stopped is still being heard when the next play starts. drain_time
+ * keeps track of when the device runs dry, so that the next play knows
+ * when its first frame is heard.
+ **/
+
+static GMutex lock;
+static GCond cond;
+static gboolean initialized;
+static gboolean shutting_down;
+static GThread *reaper_thread;
 
 static ao_device *device;
+static ao_sample_format device_format;
+static gboolean in_use;
+static gboolean failed;
+static gint64 idle_deadline;
+static gint64 drain_time;
 
-void ao_audio_close_device()
+static void ao_audio_close_locked()
 {
     if (device) {
         ao_close(device);
         device = NULL;
+        drain_time = 0;
+    }
+}
+
+static gpointer ao_audio_reaper(gpointer data)
+{
+    g_mutex_lock(&lock);
+
+    while (!shutting_down) {
+        if (device == NULL || in_use) {
+            g_cond_wait(&cond, &lock);
+        } else if (g_get_monotonic_time() < idle_deadline) {
+            g_cond_wait_until(&cond, &lock, idle_deadline);
+        } else {
+            ao_audio_close_locked();
+        }
+    }
 
-        ao_shutdown();
+    g_mutex_unlock(&lock);
+
+    return NULL;
+}
+
+void ao_audio_close_device()
+{
+    g_mutex_lock(&lock);
+
+    in_use = FALSE;
+    idle_deadline = g_get_monotonic_time() + AO_AUDIO_IDLE_TIMEOUT;
+
+    // Don't keep a device around that stopped working
+    if (failed) {
+        ao_audio_close_locked();
+        failed = FALSE;
     }
+
+    g_cond_broadcast(&cond);
+    g_mutex_unlock(&lock);
 }
 
-int ao_audio_write(unsigned char *devbuf, int size)
+int ao_audio_write(const unsigned char *devbuf, int size)
 {
     if (device) {
+        gint64 started = g_get_monotonic_time();
+
         if (ao_play(device, (char *)devbuf, size) == 0) {
             fprintf(stderr, "Error in ao_play()\n");
+            failed = TRUE;
             return -1;
         }
+
+        // The device starts on new data once it ran dry, and plays at the sample rate
+        gint64 frame_size = MAX(device_format.channels * device_format.bits / 8, 1);
+        drain_time = MAX(drain_time, started) + size / frame_size * G_USEC_PER_SEC / MAX(device_format.rate, 1);
+
         return 0;
     }
 
     return -1;
 }
 
+gint64 ao_audio_get_drain_time()
+{
+    return drain_time;
+}
+
 int ao_audio_open_device(SampleInfo *sampleInfo)
 {
-    int default_driver;
     ao_sample_format format;
 
-    ao_initialize();
-
-    default_driver = ao_default_driver_id();
     memset(&format, 0, sizeof(format));
     format.bits = sampleInfo->bitsPerSample;
     format.channels = sampleInfo->channels;
     format.rate = sampleInfo->samplesPerSec;
     format.byte_format = AO_FMT_LITTLE;
 
-    device = ao_open_live(default_driver, &format, NULL);
+    g_mutex_lock(&lock);
+
+    if (!initialized) {
+        ao_initialize();
+        initialized = TRUE;
+        reaper_thread = g_thread_new("ao_reaper", ao_audio_reaper, NULL);
+    }
+
+    if (device && (device_format.bits != format.bits ||
+                   device_format.channels != format.channels ||
+                   device_format.rate != format.rate)) {
+        ao_audio_close_locked();
+    }
 
     if (device == NULL) {
-        fprintf(stderr, "Cannot open default libao device\n");
-        return -1;
+        device = ao_open_live(ao_default_driver_id(), &format, NULL);
+
+        if (device == NULL) {
+            g_mutex_unlock(&lock);
+            fprintf(stderr, "Cannot open default libao device\n");
+            return -1;
+        }
+
+        device_format = format;
     }
 
+    in_use = TRUE;
+    failed = FALSE;
+
+    g_mutex_unlock(&lock);
+
     return 0;
 }
+
+void ao_audio_shutdown()
+{
+    g_mutex_lock(&lock);
+
+    if (!initialized) {
+        g_mutex_unlock(&lock);
+        return;
+    }
+
+    shutting_down = TRUE;
+    g_cond_broadcast(&cond);
+    g_mutex_unlock(&lock);
+
+    g_thread_join(g_steal_pointer(&reaper_thread));
+
+    g_mutex_lock(&lock);
+
+    ao_audio_close_locked();
+    ao_shutdown();
+
+    initialized = FALSE;
+    shutting_down = FALSE;
+
+    g_mutex_unlock(&lock);
+}
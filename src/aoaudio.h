@@ -22,8 +22,25 @@
 
 #include "sample_info.h"
 
-void ao_audio_close_device();
+#include <glib.h>
+
+/**
+ * Open (or reuse) the device for the format, call ao_audio_close_device()
+ * when done. The device stays open for the next play until it was idle
+ * for a while, or until ao_audio_shutdown().
+ **/
 int ao_audio_open_device(SampleInfo *);
-int ao_audio_write(unsigned char *, int);
+void ao_audio_close_device();
+int ao_audio_write(const unsigned char *, int);
+
+/**
+ * Monotonic time at which the device will have played everything written
+ * to it (in the past if it is idle); also covers earlier plays, whose
+ * audio is not dropped when the device is closed.
+ **/
+gint64 ao_audio_get_drain_time();
+
+/* Close the device (if still open) and shut down libao */
+void ao_audio_shutdown();
 
 #endif /* AOAUDIO_H */
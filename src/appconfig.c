@@ -21,6 +21,8 @@
 
 #include "appconfig.h"
 #include "sample_info.h"
+#include "encoder.h"
+#include "format.h"
 
 #include "gettext.h"
 
@@ -65,6 +67,21 @@ static int silence_percentage = 2;
 /* Draw moodbar in main window */
 static int show_moodbar = 1;
 
+/* Tracks written in parallel when splitting (0 = one per CPU) */
+static int split_jobs = 0;
+
+/* Write all tracks in one sequential pass over the source file */
+static int split_single_pass = 0;
+
+/* Output codec of split tracks (enum OutputCodec, 0 = same as source) */
+static int split_codec = 0;
+
+/* Page cache handling when writing split tracks (enum FormatWritePolicy, 0 = cache-friendly) */
+static int split_write_policy = 0;
+
+/* Seconds played before and after each break when auditioning */
+static int audition_seconds = 3;
+
 /* function prototypes */
 static int appconfig_read_file();
 static void default_all_strings();
@@ -158,6 +175,56 @@ void appconfig_set_show_moodbar(int x)
     show_moodbar = x;
 }
 
+int appconfig_get_split_jobs()
+{
+    return split_jobs;
+}
+
+void appconfig_set_split_jobs(int x)
+{
+    split_jobs = MAX(x, 0);
+}
+
+int appconfig_get_split_single_pass()
+{
+    return split_single_pass;
+}
+
+void appconfig_set_split_single_pass(int x)
+{
+    split_single_pass = x;
+}
+
+int appconfig_get_split_codec()
+{
+    return split_codec;
+}
+
+void appconfig_set_split_codec(int x)
+{
+    split_codec = encoder_codec_is_available(x) ? x : OUTPUT_CODEC_SOURCE;
+}
+
+int appconfig_get_split_write_policy()
+{
+    return split_write_policy;
+}
+
+void appconfig_set_split_write_policy(int x)
+{
+    split_write_policy = (format_write_policy_get_name(x) != NULL) ? x : FORMAT_WRITE_POLICY_CACHE_FRIENDLY;
+}
+
+int appconfig_get_audition_seconds()
+{
+    return audition_seconds;
+}
+
+void appconfig_set_audition_seconds(int x)
+{
+    audition_seconds = CLAMP(x, 1, 60);
+}
+
 int appconfig_get_use_outputdir()
 {
     return use_outputdir;
@@ -276,6 +343,11 @@ struct ConfigOption_ {
 
     OPTION(silence_percentage, INTEGER),
     OPTION(show_moodbar, BOOLEAN),
+    OPTION(split_jobs, INTEGER),
+    OPTION(split_single_pass, BOOLEAN),
+    OPTION(split_codec, INTEGER),
+    OPTION(split_write_policy, INTEGER),
+    OPTION(audition_seconds, INTEGER),
 #undef OPTION
     { NULL, INVALID, NULL, NULL },
 };
@@ -59,6 +59,16 @@ int appconfig_get_silence_percentage();
 void appconfig_set_silence_percentage(int x);
 int appconfig_get_show_moodbar();
 void appconfig_set_show_moodbar(int x);
+int appconfig_get_split_jobs();
+void appconfig_set_split_jobs(int x);
+int appconfig_get_split_single_pass();
+void appconfig_set_split_single_pass(int x);
+int appconfig_get_split_codec();
+void appconfig_set_split_codec(int x);
+int appconfig_get_split_write_policy();
+void appconfig_set_split_write_policy(int x);
+int appconfig_get_audition_seconds();
+void appconfig_set_audition_seconds(int x);
 
 #endif /* APPCONFIG_H */
 
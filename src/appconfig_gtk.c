@@ -23,6 +23,8 @@
 #include "appconfig_gtk.h"
 
 #include "sample_info.h"
+#include "encoder.h"
+#include "format.h"
 #include "popupmessage.h"
 #include "wavbreaker.h"
 
@@ -61,6 +63,11 @@ static GtkWidget *etree_cd_length_label = NULL;
 static GtkWidget *etree_cd_length_entry = NULL;
 
 static GtkWidget *silence_spin_button = NULL;
+static GtkWidget *split_jobs_spin_button = NULL;
+static GtkWidget *split_single_pass_toggle = NULL;
+static GtkWidget *split_codec_combo = NULL;
+static GtkWidget *split_write_policy_combo = NULL;
+static GtkWidget *audition_seconds_spin_button = NULL;
 
 /* Forward declarations */
 static void open_select_outputdir();
@@ -166,6 +173,11 @@ on_appconfig_close(GtkWidget *widget, GdkEvent *event, gpointer user_data)
     appconfig_set_etree_filename_suffix(gtk_entry_get_text(GTK_ENTRY(etree_filename_suffix_entry)));
     appconfig_set_etree_cd_length(gtk_entry_get_text(GTK_ENTRY(etree_cd_length_entry)));
     appconfig_set_silence_percentage( gtk_spin_button_get_value_as_int( GTK_SPIN_BUTTON(silence_spin_button)));
+    appconfig_set_split_jobs(gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(split_jobs_spin_button)));
+    appconfig_set_split_single_pass(gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(split_single_pass_toggle)) ? 1 : 0);
+    appconfig_set_split_codec(encoder_codec_from_name(gtk_combo_box_get_active_id(GTK_COMBO_BOX(split_codec_combo))));
+    appconfig_set_split_write_policy(format_write_policy_from_name(gtk_combo_box_get_active_id(GTK_COMBO_BOX(split_write_policy_combo))));
+    appconfig_set_audition_seconds(gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(audition_seconds_spin_button)));
 
     wavbreaker_update_listmodel();
 
@@ -242,6 +254,69 @@ void appconfig_show(GtkWidget *main_window)
     gtk_grid_attach(GTK_GRID(grid), silence_spin_button,
         1, 2, 1, 1);
 
+    split_jobs_spin_button = gtk_spin_button_new_with_range(0.0, 64.0, 1.0);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(split_jobs_spin_button), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(split_jobs_spin_button), appconfig_get_split_jobs());
+
+    label = gtk_label_new(_("Tracks written in parallel (0 = one per CPU):"));
+    g_object_set(G_OBJECT(label), "xalign", 0.0f, "yalign", 0.5f, NULL);
+
+    gtk_grid_attach(GTK_GRID(grid), label,
+        0, 3, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), split_jobs_spin_button,
+        1, 3, 1, 1);
+
+    split_single_pass_toggle = gtk_check_button_new_with_label(_("Read the source file only once when splitting"));
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(split_single_pass_toggle), appconfig_get_split_single_pass() ? TRUE : FALSE);
+    gtk_grid_attach(GTK_GRID(grid), split_single_pass_toggle,
+        0, 4, 2, 1);
+
+    split_codec_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(split_codec_combo),
+            encoder_codec_get_name(OUTPUT_CODEC_SOURCE), _("Same as source file"));
+    if (encoder_codec_is_available(OUTPUT_CODEC_FLAC)) {
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(split_codec_combo),
+                encoder_codec_get_name(OUTPUT_CODEC_FLAC), _("FLAC"));
+    }
+    gtk_combo_box_set_active_id(GTK_COMBO_BOX(split_codec_combo), encoder_codec_get_name(appconfig_get_split_codec()));
+
+    label = gtk_label_new(_("Format of split tracks:"));
+    g_object_set(G_OBJECT(label), "xalign", 0.0f, "yalign", 0.5f, NULL);
+
+    gtk_grid_attach(GTK_GRID(grid), label,
+        0, 5, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), split_codec_combo,
+        1, 5, 1, 1);
+
+    split_write_policy_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(split_write_policy_combo),
+            format_write_policy_get_name(FORMAT_WRITE_POLICY_CACHE_FRIENDLY), _("Keep tracks out of the page cache"));
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(split_write_policy_combo),
+            format_write_policy_get_name(FORMAT_WRITE_POLICY_THROUGHPUT), _("Maximum throughput"));
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(split_write_policy_combo),
+            format_write_policy_get_name(FORMAT_WRITE_POLICY_DIRECT), _("Direct I/O (O_DIRECT)"));
+    gtk_combo_box_set_active_id(GTK_COMBO_BOX(split_write_policy_combo), format_write_policy_get_name(appconfig_get_split_write_policy()));
+
+    label = gtk_label_new(_("Writing split tracks:"));
+    g_object_set(G_OBJECT(label), "xalign", 0.0f, "yalign", 0.5f, NULL);
+
+    gtk_grid_attach(GTK_GRID(grid), label,
+        0, 6, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), split_write_policy_combo,
+        1, 6, 1, 1);
+
+    audition_seconds_spin_button = gtk_spin_button_new_with_range(1.0, 60.0, 1.0);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(audition_seconds_spin_button), 0);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(audition_seconds_spin_button), appconfig_get_audition_seconds());
+
+    label = gtk_label_new(_("Seconds played around each break in audition:"));
+    g_object_set(G_OBJECT(label), "xalign", 0.0f, "yalign", 0.5f, NULL);
+
+    gtk_grid_attach(GTK_GRID(grid), label,
+        0, 7, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), audition_seconds_spin_button,
+        1, 7, 1, 1);
+
     /* Etree Filename Suffix */
 
     grid = gtk_grid_new();
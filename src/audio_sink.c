@@ -0,0 +1,392 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include "audio_sink.h"
+#include "aoaudio.h"
+#include "format.h"
+#include "format_wav.h"
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+/* Audio the null sink lets a writer get ahead of the simulated device */
+#define AUDIO_SINK_NULL_QUEUE_USEC (50 * 1000)
+
+/* libao: the live default device, kept open between plays by aoaudio.c */
+
+static AudioSink *
+ao_sink_create(const AudioSinkModule *self, const char *argument, char **error_message)
+{
+    return g_new0(AudioSink, 1);
+}
+
+static void
+ao_sink_destroy(AudioSink *self)
+{
+    g_free(self);
+}
+
+static int
+ao_sink_open(AudioSink *self, const SampleInfo *sample_info)
+{
+    SampleInfo format = *sample_info;
+
+    return ao_audio_open_device(&format);
+}
+
+static int
+ao_sink_write(AudioSink *self, const unsigned char *buf, size_t len)
+{
+    return ao_audio_write(buf, len);
+}
+
+static void
+ao_sink_close(AudioSink *self)
+{
+    ao_audio_close_device();
+}
+
+static gint64
+ao_sink_get_drain_time(AudioSink *self)
+{
+    return ao_audio_get_drain_time();
+}
+
+/* null: discards the audio, optionally at the pace of a device */
+
+typedef struct NullSink_ NullSink;
+struct NullSink_ {
+    AudioSink hdr;
+
+    guint rate;
+    size_t frame_size;
+    gint64 origin; /* monotonic time at which frame 0 was (or would have been) played */
+    uint64_t frames;
+};
+
+static AudioSink *
+null_sink_create(const AudioSinkModule *self, const char *argument, char **error_message)
+{
+    NullSink *sink = g_new0(NullSink, 1);
+
+    return &sink->hdr;
+}
+
+static void
+null_sink_destroy(AudioSink *self)
+{
+    g_free(self);
+}
+
+static int
+null_sink_open(AudioSink *self, const SampleInfo *sample_info)
+{
+    NullSink *sink = (NullSink *)self;
+
+    sink->rate = MAX(sample_info->samplesPerSec, 1);
+    sink->frame_size = MAX(sample_info->blockAlign, 1);
+    sink->origin = 0;
+    sink->frames = 0;
+
+    return 0;
+}
+
+static int
+null_sink_write(AudioSink *self, const unsigned char *buf, size_t len)
+{
+    NullSink *sink = (NullSink *)self;
+
+    if (!self->mod->realtime) {
+        return 0;
+    }
+
+    // Like a device: it starts (again, after running dry) on new data, and
+    // blocks the writer while a full queue is waiting to be played
+    gint64 now = g_get_monotonic_time();
+    gint64 queued_until = sink->origin + (gint64)(sink->frames * G_USEC_PER_SEC / sink->rate);
+
+    if (sink->origin == 0 || queued_until <= now) {
+        sink->origin = now - (gint64)(sink->frames * G_USEC_PER_SEC / sink->rate);
+    }
+
+    sink->frames += len / sink->frame_size;
+    queued_until = sink->origin + (gint64)(sink->frames * G_USEC_PER_SEC / sink->rate);
+
+    if (queued_until - AUDIO_SINK_NULL_QUEUE_USEC > now) {
+        g_usleep(queued_until - AUDIO_SINK_NULL_QUEUE_USEC - now);
+    }
+
+    return 0;
+}
+
+static void
+null_sink_close(AudioSink *self)
+{
+    NullSink *sink = (NullSink *)self;
+
+    if (!self->mod->realtime || sink->origin == 0) {
+        return;
+    }
+
+    // Play out the queue, as the device would
+    gint64 queued_until = sink->origin + (gint64)(sink->frames * G_USEC_PER_SEC / sink->rate);
+    gint64 now = g_get_monotonic_time();
+    if (queued_until > now) {
+        g_usleep(queued_until - now);
+    }
+}
+
+/* wav: all plays one after another in a WAV file of the first play's format */
+
+typedef struct WavSink_ WavSink;
+struct WavSink_ {
+    AudioSink hdr;
+
+    gchar *filename;
+    FILE *fp;
+    SampleInfo format;
+    uint64_t data_bytes;
+    gboolean failed;
+};
+
+static AudioSink *
+wav_sink_create(const AudioSinkModule *self, const char *argument, char **error_message)
+{
+    if (argument == NULL || *argument == '\0') {
+        format_module_set_error_message(error_message, "Usage: %s", self->usage);
+        return NULL;
+    }
+
+    WavSink *sink = g_new0(WavSink, 1);
+
+    sink->filename = g_strdup(argument);
+    sink->fp = g_fopen(sink->filename, "wb");
+    if (sink->fp == NULL) {
+        format_module_set_error_message(error_message, "Could not create %s: %s", sink->filename, strerror(errno));
+        g_free(sink->filename);
+        g_free(sink);
+        return NULL;
+    }
+
+    return &sink->hdr;
+}
+
+static void
+wav_sink_destroy(AudioSink *self)
+{
+    WavSink *sink = (WavSink *)self;
+
+    if (sink->format.channels != 0) {
+        // Now the size is known
+        if (fseek(sink->fp, 0, SEEK_SET) != 0 ||
+                wav_write_file_header(sink->fp, &sink->format, sink->data_bytes) != 0) {
+            g_warning("Could not finish %s", sink->filename);
+        }
+    }
+
+    if (fclose(sink->fp) != 0) {
+        g_warning("Could not write %s: %s", sink->filename, strerror(errno));
+    }
+
+    g_free(sink->filename);
+    g_free(sink);
+}
+
+static int
+wav_sink_open(AudioSink *self, const SampleInfo *sample_info)
+{
+    WavSink *sink = (WavSink *)self;
+
+    if (sink->failed) {
+        return -1;
+    }
+
+    if (sink->format.channels == 0) {
+        sink->format = *sample_info;
+        sink->format.avgBytesPerSec = sample_info->samplesPerSec * sample_info->blockAlign;
+
+        // Placeholder sizes, see wav_sink_destroy()
+        if (wav_write_file_header(sink->fp, &sink->format, 0) != 0) {
+            sink->failed = TRUE;
+            return -1;
+        }
+    } else if (sink->format.channels != sample_info->channels ||
+               sink->format.samplesPerSec != sample_info->samplesPerSec ||
+               sink->format.bitsPerSample != sample_info->bitsPerSample) {
+        g_warning("%s: the sample format can't change between plays", sink->filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+wav_sink_write(AudioSink *self, const unsigned char *buf, size_t len)
+{
+    WavSink *sink = (WavSink *)self;
+
+    if (fwrite(buf, 1, len, sink->fp) != len) {
+        g_warning("Could not write %s: %s", sink->filename, strerror(errno));
+        sink->failed = TRUE;
+        return -1;
+    }
+
+    sink->data_bytes += len;
+
+    return 0;
+}
+
+static void
+wav_sink_close(AudioSink *self)
+{
+    WavSink *sink = (WavSink *)self;
+
+    fflush(sink->fp);
+}
+
+static const AudioSinkModule
+AUDIO_SINK_MODULES[] = {
+    {
+        .name = "ao",
+        .usage = "ao",
+        .description = "Default audio device (libao)",
+        .realtime = TRUE,
+        .create = ao_sink_create,
+        .destroy = ao_sink_destroy,
+        .open = ao_sink_open,
+        .write = ao_sink_write,
+        .close = ao_sink_close,
+        .get_drain_time = ao_sink_get_drain_time,
+    },
+    {
+        .name = "null",
+        .usage = "null",
+        .description = "Discard the audio at the pace of playback",
+        .realtime = TRUE,
+        .create = null_sink_create,
+        .destroy = null_sink_destroy,
+        .open = null_sink_open,
+        .write = null_sink_write,
+        .close = null_sink_close,
+    },
+    {
+        .name = "null-fast",
+        .usage = "null-fast",
+        .description = "Discard the audio as fast as it is produced",
+        .realtime = FALSE,
+        .create = null_sink_create,
+        .destroy = null_sink_destroy,
+        .open = null_sink_open,
+        .write = null_sink_write,
+        .close = null_sink_close,
+    },
+    {
+        .name = "wav",
+        .usage = "wav:FILE",
+        .description = "Write the audio to a WAV file, as fast as it is produced",
+        .realtime = FALSE,
+        .create = wav_sink_create,
+        .destroy = wav_sink_destroy,
+        .open = wav_sink_open,
+        .write = wav_sink_write,
+        .close = wav_sink_close,
+    },
+};
+
+AudioSink *
+audio_sink_new(const char *name, char **error_message)
+{
+    const char *colon = strchr(name, ':');
+    size_t name_len = (colon != NULL) ? (size_t)(colon - name) : strlen(name);
+
+    for (size_t i = 0; i < G_N_ELEMENTS(AUDIO_SINK_MODULES); i++) {
+        const AudioSinkModule *mod = &AUDIO_SINK_MODULES[i];
+
+        if (strlen(mod->name) != name_len || strncmp(mod->name, name, name_len) != 0) {
+            continue;
+        }
+
+        AudioSink *sink = mod->create(mod, (colon != NULL) ? colon + 1 : NULL, error_message);
+        if (sink != NULL) {
+            sink->mod = mod;
+        }
+
+        return sink;
+    }
+
+    format_module_set_error_message(error_message, "Unknown audio sink: '%s'", name);
+    return NULL;
+}
+
+void
+audio_sink_print_usage(FILE *fp, const char *indent)
+{
+    for (size_t i = 0; i < G_N_ELEMENTS(AUDIO_SINK_MODULES); i++) {
+        const AudioSinkModule *mod = &AUDIO_SINK_MODULES[i];
+
+        fprintf(fp, "%s%-10s %s\n", indent, mod->usage, mod->description);
+    }
+}
+
+gboolean
+audio_sink_is_realtime(AudioSink *sink)
+{
+    return sink->mod->realtime;
+}
+
+int
+audio_sink_open(AudioSink *sink, const SampleInfo *sample_info)
+{
+    return sink->mod->open(sink, sample_info);
+}
+
+int
+audio_sink_write(AudioSink *sink, const unsigned char *buf, size_t len)
+{
+    gint64 started = g_get_monotonic_time();
+
+    int result = sink->mod->write(sink, buf, len);
+
+    sink->write_time += g_get_monotonic_time() - started;
+    if (result == 0) {
+        sink->bytes_written += len;
+    }
+
+    return result;
+}
+
+gint64
+audio_sink_get_drain_time(AudioSink *sink)
+{
+    return (sink->mod->get_drain_time != NULL) ? sink->mod->get_drain_time(sink) : 0;
+}
+
+void
+audio_sink_close(AudioSink *sink)
+{
+    sink->mod->close(sink);
+}
+
+void
+audio_sink_free(AudioSink *sink)
+{
+    sink->mod->destroy(sink);
+}
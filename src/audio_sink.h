@@ -0,0 +1,111 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "sample_info.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <glib.h>
+
+/**
+ * Audio sinks
+ *
+ * Where playback goes: the live libao device ("ao", the default), nowhere
+ * at the pace of a device ("null") or as fast as it is produced
+ * ("null-fast"), or into a WAV file ("wav:FILE") that can be compared to
+ * the source. The latter work without sound hardware, e.g. to benchmark
+ * the playback pipeline or to check its output.
+ *
+ * A sink is opened and closed once per play, and written to by a single
+ * (the playback output) thread in between.
+ **/
+
+typedef struct AudioSinkModule_ AudioSinkModule;
+typedef struct AudioSink_ AudioSink;
+
+struct AudioSinkModule_ {
+    const char *name;
+    const char *usage;
+    const char *description;
+
+    /* TRUE if write() blocks at the pace of playback, so that the audio is
+     * heard as the sample rate clock runs; otherwise it counts as played
+     * as soon as it was written */
+    gboolean realtime;
+
+    /* argument is the part of the name after the colon, or NULL */
+    AudioSink *(*create)(const AudioSinkModule *self, const char *argument, char **error_message);
+    void (*destroy)(AudioSink *self);
+
+    int (*open)(AudioSink *self, const SampleInfo *sample_info);
+    int (*write)(AudioSink *self, const unsigned char *buf, size_t len);
+    void (*close)(AudioSink *self);
+
+    /* Optional: see audio_sink_get_drain_time() */
+    gint64 (*get_drain_time)(AudioSink *self);
+};
+
+struct AudioSink_ {
+    const AudioSinkModule *mod;
+
+    // Totals of all plays, updated by the writing thread (read them while
+    // nothing is playing)
+    uint64_t bytes_written;
+    gint64 write_time; /* microseconds spent in write() */
+};
+
+/**
+ * Create the sink described by name ("ao", "null", "null-fast" or
+ * "wav:FILE"). Returns NULL and sets error_message if it is unknown or
+ * can't be created.
+ **/
+AudioSink *
+audio_sink_new(const char *name, char **error_message);
+
+/* Print the usage and description of all sinks, one per line */
+void
+audio_sink_print_usage(FILE *fp, const char *indent);
+
+gboolean
+audio_sink_is_realtime(AudioSink *sink);
+
+/* Returns 0 on success; the sink must be closed in any case */
+int
+audio_sink_open(AudioSink *sink, const SampleInfo *sample_info);
+
+/* Returns 0 on success, blocks at the pace of playback for realtime sinks */
+int
+audio_sink_write(AudioSink *sink, const unsigned char *buf, size_t len);
+
+/**
+ * Monotonic time at which the audio written so far -- including that of
+ * earlier plays still queued in the device -- will have been played, so
+ * the next write is heard from then on. 0 if the sink doesn't know or has
+ * nothing queued.
+ **/
+gint64
+audio_sink_get_drain_time(AudioSink *sink);
+
+void
+audio_sink_close(AudioSink *sink);
+
+/* Not while it is open; a WAV file is finished here */
+void
+audio_sink_free(AudioSink *sink);
@@ -0,0 +1,265 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include "audition.h"
+
+#include <string.h>
+
+/* Read in pieces, so that stopping does not wait for a whole region */
+#define AUDITION_READ_SIZE (256 * 1024)
+
+typedef struct AuditionRegion_ AuditionRegion;
+struct AuditionRegion_ {
+    unsigned long position;
+    unsigned long start_pos;
+    GBytes *data;
+};
+
+struct Audition_ {
+    OpenedAudioFile *reader;
+    unsigned long context;
+    unsigned long num_bytes;
+
+    GThread *thread;
+
+    // Protects everything below
+    GMutex mutex;
+    GCond cond;
+    gboolean stop;
+
+    unsigned long queue[AUDITION_MAX_REGIONS];
+    guint queue_length;
+
+    AuditionRegion regions[AUDITION_MAX_REGIONS];
+    guint num_regions;
+};
+
+static AuditionRegion *
+audition_find_region(Audition *audition, unsigned long position)
+{
+    for (guint i = 0; i < audition->num_regions; i++) {
+        if (audition->regions[i].position == position) {
+            return &audition->regions[i];
+        }
+    }
+
+    return NULL;
+}
+
+static gboolean
+audition_is_queued(Audition *audition, unsigned long position)
+{
+    for (guint i = 0; i < audition->queue_length; i++) {
+        if (audition->queue[i] == position) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+audition_unqueue(Audition *audition, unsigned long position)
+{
+    guint kept = 0;
+    for (guint i = 0; i < audition->queue_length; i++) {
+        if (audition->queue[i] != position) {
+            audition->queue[kept++] = audition->queue[i];
+        }
+    }
+    audition->queue_length = kept;
+}
+
+/* Read the region around position, or NULL if stopped or the read failed */
+static GBytes *
+audition_read_region(Audition *audition, unsigned long position, unsigned long *start_pos)
+{
+    unsigned long start = position - MIN(position, audition->context);
+    unsigned long end = MIN(position + audition->context, audition->num_bytes);
+    size_t size = (end > start) ? end - start : 0;
+
+    unsigned char *buf = g_malloc(MAX(size, 1));
+    size_t done = 0;
+
+    while (done < size) {
+        g_mutex_lock(&audition->mutex);
+        gboolean stop = audition->stop || !audition_is_queued(audition, position);
+        g_mutex_unlock(&audition->mutex);
+
+        if (stop) {
+            g_free(buf);
+            return NULL;
+        }
+
+        long read = format_read_samples(audition->reader, buf + done, MIN(size - done, AUDITION_READ_SIZE), start + done);
+        if (read <= 0) {
+            break;
+        }
+
+        done += read;
+    }
+
+    if (done < size) {
+        // Short file or read error: play what there is, from the file
+        g_warning("Could not read audition region at %lu", position);
+        g_free(buf);
+        return NULL;
+    }
+
+    *start_pos = start;
+    return g_bytes_new_take(buf, size);
+}
+
+static gpointer
+audition_prefetch_thread(gpointer user_data)
+{
+    Audition *audition = user_data;
+
+    g_mutex_lock(&audition->mutex);
+
+    while (!audition->stop) {
+        // The first queued break that has no region yet
+        gboolean found = FALSE;
+        unsigned long position = 0;
+
+        for (guint i = 0; i < audition->queue_length && !found; i++) {
+            position = audition->queue[i];
+            found = (audition_find_region(audition, position) == NULL);
+        }
+
+        if (!found) {
+            g_cond_wait(&audition->cond, &audition->mutex);
+            continue;
+        }
+
+        g_mutex_unlock(&audition->mutex);
+
+        unsigned long start_pos = 0;
+        GBytes *data = audition_read_region(audition, position, &start_pos);
+
+        g_mutex_lock(&audition->mutex);
+
+        if (data == NULL) {
+            // Don't try again, the break is played from the file
+            audition_unqueue(audition, position);
+            continue;
+        }
+
+        if (!audition_is_queued(audition, position) || audition->num_regions == AUDITION_MAX_REGIONS) {
+            // The queue changed while we were reading
+            g_bytes_unref(data);
+            continue;
+        }
+
+        audition->regions[audition->num_regions++] = (AuditionRegion) {
+            .position = position,
+            .start_pos = start_pos,
+            .data = data,
+        };
+    }
+
+    g_mutex_unlock(&audition->mutex);
+
+    return NULL;
+}
+
+Audition *
+audition_new(OpenedAudioFile *reader, unsigned long context)
+{
+    Audition *audition = g_new0(Audition, 1);
+
+    audition->reader = reader;
+    audition->context = context;
+    audition->num_bytes = reader->sample_info.numBytes;
+
+    g_mutex_init(&audition->mutex);
+    g_cond_init(&audition->cond);
+
+    audition->thread = g_thread_new("audition_prefetch", audition_prefetch_thread, audition);
+
+    return audition;
+}
+
+unsigned long
+audition_get_context(Audition *audition)
+{
+    return audition->context;
+}
+
+void
+audition_set_queue(Audition *audition, const unsigned long *positions, guint n)
+{
+    g_mutex_lock(&audition->mutex);
+
+    audition->queue_length = MIN(n, AUDITION_MAX_REGIONS);
+    memcpy(audition->queue, positions, audition->queue_length * sizeof(*positions));
+
+    guint kept = 0;
+    for (guint i = 0; i < audition->num_regions; i++) {
+        AuditionRegion *region = &audition->regions[i];
+
+        if (audition_is_queued(audition, region->position)) {
+            audition->regions[kept++] = *region;
+        } else {
+            g_bytes_unref(region->data);
+        }
+    }
+    audition->num_regions = kept;
+
+    g_cond_signal(&audition->cond);
+    g_mutex_unlock(&audition->mutex);
+}
+
+GBytes *
+audition_get_region(Audition *audition, unsigned long position, unsigned long *start_pos)
+{
+    GBytes *result = NULL;
+
+    g_mutex_lock(&audition->mutex);
+
+    AuditionRegion *region = audition_find_region(audition, position);
+    if (region != NULL) {
+        result = g_bytes_ref(region->data);
+        *start_pos = region->start_pos;
+    }
+
+    g_mutex_unlock(&audition->mutex);
+
+    return result;
+}
+
+void
+audition_free(Audition *audition)
+{
+    g_mutex_lock(&audition->mutex);
+    audition->stop = TRUE;
+    g_cond_signal(&audition->cond);
+    g_mutex_unlock(&audition->mutex);
+
+    g_thread_join(audition->thread);
+
+    for (guint i = 0; i < audition->num_regions; i++) {
+        g_bytes_unref(audition->regions[i].data);
+    }
+
+    g_cond_clear(&audition->cond);
+    g_mutex_clear(&audition->mutex);
+    g_free(audition);
+}
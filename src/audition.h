@@ -0,0 +1,65 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "format.h"
+
+/**
+ * Break audition prefetch
+ *
+ * Auditioning plays a few seconds around each track break in turn. A
+ * background thread reads (or decodes) the regions around the next breaks
+ * into memory ahead of time, so moving on to the next break starts at once
+ * instead of waiting for a seek, which is slow in compressed files.
+ *
+ * Positions are PCM byte offsets of the breaks; a region starts up to
+ * context bytes before its break and ends up to context bytes after it.
+ **/
+
+/* Regions kept in memory at most (the current break and the next ones) */
+#define AUDITION_MAX_REGIONS 4
+
+typedef struct Audition_ Audition;
+
+/* reader is used by the prefetch thread only, until the audition is freed */
+Audition *
+audition_new(OpenedAudioFile *reader, unsigned long context);
+
+unsigned long
+audition_get_context(Audition *audition);
+
+/**
+ * Set the breaks to prefetch, in the order they will be played (at most
+ * AUDITION_MAX_REGIONS are used). Regions of other breaks are dropped.
+ **/
+void
+audition_set_queue(Audition *audition, const unsigned long *positions, guint n);
+
+/**
+ * The region around position as a new reference, and where it starts in
+ * the file, or NULL if it was not (completely) read yet.
+ **/
+GBytes *
+audition_get_region(Audition *audition, unsigned long position, unsigned long *start_pos);
+
+/* Stop and join the prefetch thread, free all regions */
+void
+audition_free(Audition *audition);
@@ -24,8 +24,17 @@
 #include "appinfo.h"
 #include "sample.h"
 #include "format.h"
+#include "analysis.h"
+#include "analysis_kernels.h"
+#include "peakcache.h"
+#include "audio_sink.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Progress output is refreshed at most this often */
+#define CLI_PROGRESS_INTERVAL_MS 33
 
 
 static void
@@ -83,33 +92,87 @@ cmd_list(int argc, char *argv[])
     return 0;
 }
 
+/* Discard the queued events, TRUE if the FINISHED one was among them */
+static gboolean
+cli_progress_drain(ProgressChannel *progress)
+{
+    gboolean finished = FALSE;
+
+    ProgressEvent event;
+    while (progress_channel_pop(progress, &event)) {
+        finished = finished || (event.type == PROGRESS_EVENT_FINISHED);
+        progress_event_clear(&event);
+    }
+
+    return finished;
+}
+
 static int
 cmd_analyze(int argc, char *argv[])
 {
+    const char *sink_name = "ao";
+    int preview_seconds = 10;
+
+    while (argc > 1 && g_str_has_prefix(argv[1], "--")) {
+        int consumed = 1;
+
+        if (argc > 2 && strcmp(argv[1], "--sink") == 0) {
+            sink_name = argv[2];
+            consumed = 2;
+        } else if (argc > 2 && strcmp(argv[1], "--seconds") == 0) {
+            preview_seconds = MAX(atoi(argv[2]), 0);
+            consumed = 2;
+        } else {
+            argc = 0;
+            break;
+        }
+
+        argv[consumed] = argv[0];
+        argv += consumed;
+        argc -= consumed;
+    }
+
     if (argc != 2) {
-        printf("Usage: %s [filename.wav]\n", argv[0]);
+        printf("Usage: %s [--sink S] [--seconds N] [filename.wav]\n", argv[0]);
+        printf("  --sink S         Where the preview is played:\n");
+        audio_sink_print_usage(stdout, "                     ");
+        printf("  --seconds N      Stop the preview after N seconds (default 10, 0 = whole file)\n");
+        return 1;
+    }
+
+    char *error_message = NULL;
+    AudioSink *sink = audio_sink_new(sink_name, &error_message);
+    if (sink == NULL) {
+        printf("%s\n", error_message);
+        g_free(error_message);
         return 1;
     }
 
     sample_init();
 
-    char *error_message = NULL;
-    Sample *sample = sample_open(argv[1], &error_message);
+    ProgressChannel *progress = progress_channel_new(CLI_PROGRESS_INTERVAL_MS, NULL, NULL, NULL);
+
+    Sample *sample = sample_open(argv[1], progress, &error_message);
     if (sample == NULL) {
         printf("Could not open %s: %s\n", argv[1], error_message);
         g_free(error_message);
+        progress_channel_unref(progress);
+        audio_sink_free(sink);
         return 2;
     }
 
     sample_print_file_info(sample);
+    sample_set_audio_sink(sample, sink);
 
     gint64 analyze_started = g_get_monotonic_time();
 
     do {
-        fprintf(stderr, "\r\033[KAnalyzing... [%3.0f%%]", 100.0 * sample_get_load_percentage(sample));
+        fprintf(stderr, "\r\033[KAnalyzing... [%3.0f%%]", 100.0 * progress_channel_get_fraction(progress));
         fflush(stderr);
-        g_usleep(G_USEC_PER_SEC / 30);
-    } while (!sample_is_loaded(sample));
+        progress_channel_wait(progress);
+    } while (!cli_progress_drain(progress));
+
+    progress_channel_unref(progress);
 
     fprintf(stderr, "\r\033[KAnalyzing... [DONE]\n");
     fflush(stderr);
@@ -122,6 +185,22 @@ cmd_analyze(int argc, char *argv[])
             (double)analyze_duration / (float)G_USEC_PER_SEC,
             (unsigned long long)num_sample_blocks * G_USEC_PER_SEC / analyze_duration);
 
+    AnalysisStats stats;
+    sample_get_analysis_stats(sample, &stats);
+
+    if (stats.from_cache) {
+        gchar *cache_filename = peakcache_get_filename(sample_get_filename(sample));
+        printf("Peaks loaded from cache: %s\n", cache_filename);
+        g_free(cache_filename);
+    } else if (stats.duration > 0) {
+        printf("Analysis pass (%u worker%s%s): %.1f MiB in %.2f seconds = %.1f MiB/s, %llu blocks/sec\n",
+                stats.workers, (stats.workers == 1) ? "" : "s", stats.mapped ? ", mmap" : "",
+                (double)stats.bytes / (1024.0 * 1024.0),
+                (double)stats.duration / (double)G_USEC_PER_SEC,
+                (double)stats.bytes / (1024.0 * 1024.0) * G_USEC_PER_SEC / stats.duration,
+                (unsigned long long)stats.blocks * G_USEC_PER_SEC / stats.duration);
+    }
+
     gint64 started = g_get_monotonic_time();
 
     sample_play(sample, 0);
@@ -132,58 +211,30 @@ cmd_analyze(int argc, char *argv[])
         fprintf(stderr, "\r\033[KPreviewing... [%lu]", pos);
         fflush(stderr);
         g_usleep(G_USEC_PER_SEC / 30);
-    } while (sample_is_playing(sample) && g_get_monotonic_time() < started + G_USEC_PER_SEC * 10);
+    } while (sample_is_playing(sample) &&
+             (preview_seconds == 0 || g_get_monotonic_time() < started + G_USEC_PER_SEC * preview_seconds));
 
     fprintf(stderr, "\r\033[KPreviewing... [DONE]\n");
     fflush(stderr);
 
     sample_stop(sample);
 
-    sample_close(sample);
-
-    return 0;
-}
-
-struct SplitFinished {
-    GMutex mutex;
-    GCond cond;
-    gboolean finished;
-};
-
-static void
-split_on_file_changed(guint position, guint total, const char *filename, void *user_data)
-{
-    if (position != 1) {
-        printf("\r\033[K");
-    }
-
-    printf("Split %d/%d: %s\n", position, total, filename);
-}
-
-static void
-split_on_file_progress_changed(double percentage, void *user_data)
-{
-    printf("\r\033[K%3.0f %%", 100 * percentage);
-    fflush(stdout);
-}
+    gint64 preview_duration = MAX(g_get_monotonic_time() - started, 1);
+    double audio_seconds = (double)sample_get_play_marker(sample) / CD_BLOCKS_PER_SEC;
 
-static void
-split_on_error(const char *message, void *user_data)
-{
-    g_warning("Error writing file: %s", message);
-}
+    printf("Preview (%s): %.2f seconds of audio in %.2f seconds (%.1fx real time), %.1f MiB at %.1f MiB/s, %u underrun%s\n",
+            sink_name, audio_seconds, (double)preview_duration / G_USEC_PER_SEC,
+            audio_seconds * G_USEC_PER_SEC / preview_duration,
+            (double)sink->bytes_written / (1024.0 * 1024.0),
+            (double)sink->bytes_written / (1024.0 * 1024.0) * G_USEC_PER_SEC / preview_duration,
+            sample_get_play_underruns(sample), (sample_get_play_underruns(sample) == 1) ? "" : "s");
 
-static void
-split_on_finished(void *user_data)
-{
-    struct SplitFinished *finished = user_data;
+    sample_close(sample);
+    audio_sink_free(sink);
 
-    printf("\r\033[KSplit finished.\n");
+    sample_shutdown();
 
-    g_mutex_lock(&finished->mutex);
-    finished->finished = TRUE;
-    g_cond_signal(&finished->cond);
-    g_mutex_unlock(&finished->mutex);
+    return 0;
 }
 
 static gboolean
@@ -196,12 +247,24 @@ split_is_cancelled(void *user_data)
 static enum OverwriteDecision
 split_ask_overwrite(const char *filename, void *user_data)
 {
+    const enum OverwriteDecision *policy = user_data;
+
+    // --overwrite or --skip-existing, don't ask
+    if (*policy != OVERWRITE_DECISION_ASK) {
+        return *policy;
+    }
+
     char answer = 0;
 
     while (answer != 'y' && answer != 'n' && answer != 'a' && answer != 's') {
         printf("\r\033[KFile '%s' exist, overwrite? ([y]es/[n]no/[a]ll/[s]kip all) ", filename);
         fflush(stdout);
-        scanf("%c", &answer);
+
+        if (scanf(" %c", &answer) != 1) {
+            // Nobody to ask (end of input), keep the existing files
+            printf("\n");
+            return OVERWRITE_DECISION_SKIP_ALL;
+        }
     }
 
     if (answer == 'y') {
@@ -218,8 +281,67 @@ split_ask_overwrite(const char *filename, void *user_data)
 static int
 cmd_split(int argc, char *argv[])
 {
+    WriteOptions options = {
+        .jobs = appconfig_get_split_jobs(),
+        .single_pass = appconfig_get_split_single_pass(),
+        .codec = appconfig_get_split_codec(),
+        .write_policy = appconfig_get_split_write_policy(),
+    };
+
+    enum OverwriteDecision overwrite_policy = OVERWRITE_DECISION_ASK;
+
+    while (argc > 1 && g_str_has_prefix(argv[1], "--")) {
+        int consumed = 1;
+
+        if (argc > 2 && strcmp(argv[1], "--jobs") == 0) {
+            options.jobs = MAX(atoi(argv[2]), 0);
+            consumed = 2;
+        } else if (strcmp(argv[1], "--single-pass") == 0) {
+            options.single_pass = TRUE;
+        } else if (strcmp(argv[1], "--rewrite-all") == 0) {
+            options.rewrite_all = TRUE;
+        } else if (strcmp(argv[1], "--overwrite") == 0) {
+            overwrite_policy = OVERWRITE_DECISION_OVERWRITE_ALL;
+        } else if (strcmp(argv[1], "--skip-existing") == 0) {
+            overwrite_policy = OVERWRITE_DECISION_SKIP_ALL;
+        } else if (argc > 2 && strcmp(argv[1], "--codec") == 0) {
+            int codec = encoder_codec_from_name(argv[2]);
+            if (codec == -1 || !encoder_codec_is_available(codec)) {
+                printf("Unsupported output codec: '%s'\n", argv[2]);
+                return 1;
+            }
+
+            options.codec = codec;
+            consumed = 2;
+        } else if (argc > 2 && strcmp(argv[1], "--write-policy") == 0) {
+            int policy = format_write_policy_from_name(argv[2]);
+            if (policy == -1) {
+                printf("Unknown write policy: '%s'\n", argv[2]);
+                return 1;
+            }
+
+            options.write_policy = policy;
+            consumed = 2;
+        } else {
+            argc = 0;
+            break;
+        }
+
+        argv[consumed] = argv[0];
+        argv += consumed;
+        argc -= consumed;
+    }
+
     if (argc != 4) {
-        printf("Usage: %s [audio_file.wav] [track_breaks.txt] [output_folder]\n", argv[0]);
+        printf("Usage: %s [--jobs N] [--single-pass] [--codec C] [--write-policy P] [--rewrite-all] [--overwrite|--skip-existing] [audio_file.wav] [track_breaks.txt] [output_folder]\n", argv[0]);
+        printf("  --jobs N         Number of tracks written in parallel (0 = one per CPU)\n");
+        printf("  --single-pass    Read the audio file once, front to back, writing tracks in order\n");
+        printf("  --codec C        Output format: source (default)%s\n", encoder_codec_is_available(OUTPUT_CODEC_FLAC) ? ", flac" : "");
+        printf("  --write-policy P cache (default): keep written tracks out of the page cache,\n");
+        printf("                   throughput: leave caching to the kernel, direct: use O_DIRECT\n");
+        printf("  --rewrite-all    Also write tracks that are unchanged since the last split\n");
+        printf("  --overwrite      Replace existing files without asking\n");
+        printf("  --skip-existing  Keep existing files without asking\n");
         return 1;
     }
 
@@ -238,11 +360,14 @@ cmd_split(int argc, char *argv[])
 
     printf("Using audio file: %s\n", audio_filename);
 
+    ProgressChannel *load_progress = progress_channel_new(CLI_PROGRESS_INTERVAL_MS, NULL, NULL, NULL);
+
     char *error_message = NULL;
-    Sample *sample = sample_open(audio_filename, &error_message);
+    Sample *sample = sample_open(audio_filename, load_progress, &error_message);
     if (sample == NULL) {
         printf("Could not open %s: %s\n", argv[1], error_message);
         g_free(error_message);
+        progress_channel_unref(load_progress);
         return 2;
     }
 
@@ -250,8 +375,9 @@ cmd_split(int argc, char *argv[])
 
     printf("Scanning audio file...\n");
     do {
-        g_usleep(G_USEC_PER_SEC / 10);
-    } while (!sample_is_loaded(sample));
+        progress_channel_wait(load_progress);
+    } while (!cli_progress_drain(load_progress));
+    progress_channel_unref(load_progress);
     printf("File analyzed, %lu blocks\n", sample_get_num_sample_blocks(sample));
 
     TrackBreakList *list = track_break_list_new(sample_get_basename_without_extension(sample));
@@ -266,33 +392,51 @@ cmd_split(int argc, char *argv[])
 
         printf("Using output folder: %s\n", output_folder);
 
-        struct SplitFinished split_finished;
-        g_mutex_init(&split_finished.mutex);
-        g_cond_init(&split_finished.cond);
-        split_finished.finished = FALSE;
+        ProgressChannel *progress = progress_channel_new(CLI_PROGRESS_INTERVAL_MS, NULL, NULL, NULL);
 
         WriteStatusCallbacks
         write_status_callbacks = {
-            .on_file_changed = split_on_file_changed,
-            .on_file_progress_changed = split_on_file_progress_changed,
-            .on_error = split_on_error,
-            .on_finished = split_on_finished,
+            .progress = progress,
 
             .is_cancelled = split_is_cancelled,
             .ask_overwrite = split_ask_overwrite,
 
-            .user_data = &split_finished,
+            .user_data = &overwrite_policy,
         };
 
-        sample_write_files(sample, list, &write_status_callbacks, output_folder);
+        sample_write_files(sample, list, &write_status_callbacks, output_folder, &options);
+
+        gboolean finished = FALSE;
+        while (!finished) {
+            progress_channel_wait(progress);
+
+            ProgressEvent event;
+            while (progress_channel_pop(progress, &event)) {
+                switch (event.type) {
+                    case PROGRESS_EVENT_ITEM_STARTED:
+                        // Tracks are started in order, but several may be running at once
+                        printf("\r\033[KSplit %d/%d: %s\n", event.position, event.total, event.text);
+                        break;
+                    case PROGRESS_EVENT_ERROR:
+                        g_warning("Error writing file: %s", event.text);
+                        break;
+                    case PROGRESS_EVENT_FINISHED:
+                        finished = TRUE;
+                        break;
+                    default:
+                        break;
+                }
+
+                progress_event_clear(&event);
+            }
 
-        g_mutex_lock(&split_finished.mutex);
-        while (!split_finished.finished) {
-            g_cond_wait(&split_finished.cond, &split_finished.mutex);
+            printf("\r\033[K%3.0f %%", 100 * progress_channel_get_fraction(progress));
+            fflush(stdout);
         }
-        g_mutex_unlock(&split_finished.mutex);
-        g_mutex_clear(&split_finished.mutex);
-        g_cond_clear(&split_finished.cond);
+
+        printf("\r\033[KSplit finished.\n");
+
+        progress_channel_unref(progress);
     } else {
         printf("Could not open/parse %s\n", list_filename);
         exitcode = 3;
@@ -304,6 +448,137 @@ cmd_split(int argc, char *argv[])
     return exitcode;
 }
 
+static int
+cmd_peaks_build(const char *filename)
+{
+    char *error_message = NULL;
+    OpenedAudioFile *oaf = format_open_file(filename, FORMAT_OPEN_DEFAULT, &error_message);
+    if (oaf == NULL) {
+        printf("%s: %s\n", filename, error_message);
+        g_free(error_message);
+        return 1;
+    }
+
+    int result = 0;
+
+    GraphData graph_data = { 0 };
+    AnalysisStats stats;
+
+    if (!analysis_prepare(oaf, &graph_data) || !analysis_run(oaf, &graph_data, NULL, NULL, NULL, &stats)) {
+        printf("%s: Analysis failed\n", filename);
+        result = 1;
+    } else if (!peakcache_write(oaf, &graph_data, &error_message)) {
+        printf("%s: %s\n", filename, error_message);
+        g_free(error_message);
+        result = 1;
+    } else {
+        gchar *cache_filename = peakcache_get_filename(filename);
+        printf("%s: %lu blocks in %.2f seconds -> %s\n", filename, graph_data.numSamples,
+                (double)stats.duration / (double)G_USEC_PER_SEC, cache_filename);
+        g_free(cache_filename);
+    }
+
+    analysis_free(&graph_data);
+    format_close_file(oaf);
+
+    return result;
+}
+
+static int
+cmd_peaks_verify(const char *filename)
+{
+    char *error_message = NULL;
+    OpenedAudioFile *oaf = format_open_file(filename, FORMAT_OPEN_DEFAULT, &error_message);
+    if (oaf == NULL) {
+        printf("%s: %s\n", filename, error_message);
+        g_free(error_message);
+        return 1;
+    }
+
+    int result = 1;
+
+    GraphData cached = { 0 };
+    PeakCache *cache = peakcache_open(oaf, &cached, &error_message);
+    if (cache == NULL) {
+        printf("%s: %s\n", filename, error_message);
+        g_free(error_message);
+        format_close_file(oaf);
+        return 1;
+    }
+
+    // The key matches, now check that the contents match a fresh analysis
+    GraphData fresh = { 0 };
+    if (!analysis_prepare(oaf, &fresh) || !analysis_run(oaf, &fresh, NULL, NULL, NULL, NULL)) {
+        printf("%s: Analysis failed\n", filename);
+    } else if (fresh.numSamples != cached.numSamples ||
+            fresh.maxSampleValue != cached.maxSampleValue ||
+            fresh.maxSampleAmp != cached.maxSampleAmp ||
+            fresh.minSampleAmp != cached.minSampleAmp ||
+            memcmp(fresh.data, cached.data, fresh.numSamples * sizeof(Points)) != 0) {
+        printf("%s: Peak cache does not match the audio data\n", filename);
+    } else {
+        printf("%s: OK (%lu blocks)\n", filename, cached.numSamples);
+        result = 0;
+    }
+
+    analysis_free(&fresh);
+    peakcache_close(cache);
+    format_close_file(oaf);
+
+    return result;
+}
+
+static int
+cmd_peaks(int argc, char *argv[])
+{
+    const char *action = (argc > 1) ? argv[1] : "";
+    gboolean purge = (strcmp(action, "purge") == 0);
+
+    if ((!purge && argc < 3) || (!purge && strcmp(action, "build") != 0 && strcmp(action, "verify") != 0)) {
+        printf("Usage: %s build|verify [file] ...\n", argv[0]);
+        printf("       %s purge [--all] [file] ...\n", argv[0]);
+        printf("\nWithout files, purge removes out-of-date caches (or all of them with --all).\n");
+        gchar *directory = peakcache_get_directory();
+        printf("Cache directory: %s\n", directory);
+        g_free(directory);
+        return 1;
+    }
+
+    format_init();
+    analysis_kernels_init();
+
+    int failed = 0;
+
+    if (purge) {
+        gboolean all = (argc > 2 && strcmp(argv[2], "--all") == 0);
+
+        if (argc == 2 || (all && argc == 3)) {
+            int removed = peakcache_purge_directory(all);
+            printf("Removed %d cache file%s\n", removed, (removed == 1) ? "" : "s");
+            return 0;
+        }
+
+        for (int i=all ? 3 : 2; i<argc; ++i) {
+            if (!peakcache_purge(argv[i])) {
+                printf("%s: No peak cache\n", argv[i]);
+                ++failed;
+            }
+        }
+
+        return failed ? 1 : 0;
+    }
+
+    for (int i=2; i<argc; ++i) {
+        if (strcmp(action, "build") == 0) {
+            failed += cmd_peaks_build(argv[i]);
+        } else {
+            failed += cmd_peaks_verify(argv[i]);
+        }
+    }
+
+    return failed ? 1 : 0;
+}
+
 static int
 cmd_version(int argc, char *argv[])
 {
@@ -323,6 +598,7 @@ cmd_version(int argc, char *argv[])
 int cmd_wavgen(int argc, char *argv[]);
 int cmd_wavinfo(int argc, char *argv[]);
 int cmd_wavmerge(int argc, char *argv[]);
+int cmd_wavbench(int argc, char *argv[]);
 
 struct SubCommand {
     const char *name;
@@ -344,6 +620,8 @@ int main(int argc, char *argv[])
         { "gen", cmd_wavgen, "Generate example WAV files (formerly 'wavgen')" },
         { "info", cmd_wavinfo, "Print audio format information (WAV/MP2/MP3/OGG) (formerly 'wavinfo')" },
         { "merge", cmd_wavmerge, "Merge multiple WAV files into a single file (formerly 'wavmerge')" },
+        { "peaks", cmd_peaks, "Build, verify or purge cached waveform peaks" },
+        { "bench", cmd_wavbench, "Benchmark the waveform analysis kernels or a file" },
         { "version", cmd_version, "Print version and software information" },
         { NULL, NULL, NULL },
     };
@@ -21,6 +21,7 @@
 #include <math.h>
 
 #include "draw.h"
+#include "analysis.h"
 
 static void draw_sample_surface(struct WaveformSurface *self, struct WaveformSurfaceDrawContext *ctx);
 static void draw_summary_surface(struct WaveformSurface *self, struct WaveformSurfaceDrawContext *ctx);
@@ -181,8 +182,10 @@ draw_sample_surface(struct WaveformSurface *self, struct WaveformSurfaceDrawCont
         height = allocation.height;
     }
 
+    unsigned long analyzed = ctx->graphData ? analysis_get_analyzed_blocks(ctx->graphData) : 0;
+
     if (self->surface != NULL && self->width == width && self->height == height && self->offset == ctx->pixmap_offset &&
-        (ctx->moodbarData && ctx->moodbarData->numFrames) == self->moodbar) {
+        (ctx->moodbarData && ctx->moodbarData->numFrames) == self->moodbar && self->analyzed == analyzed) {
         return;
     }
 
@@ -222,7 +225,12 @@ draw_sample_surface(struct WaveformSurface *self, struct WaveformSurfaceDrawCont
     /* draw sample graph */
     int tb_index = 0;
     GList *tbl = ctx->list->breaks;
-    for (i = 0; i < width && i < ctx->graphData->numSamples; i++) {
+    for (i = 0; i < width && i + ctx->pixmap_offset < ctx->graphData->numSamples; i++) {
+        /* leave blocks that have not been analyzed yet blank */
+        if (!analysis_is_block_valid(ctx->graphData, i + ctx->pixmap_offset)) {
+            continue;
+        }
+
         y_min = ctx->graphData->data[i + ctx->pixmap_offset].min;
         y_max = ctx->graphData->data[i + ctx->pixmap_offset].max;
 
@@ -262,6 +270,7 @@ draw_sample_surface(struct WaveformSurface *self, struct WaveformSurfaceDrawCont
     self->height = height;
     self->offset = ctx->pixmap_offset;
     self->moodbar = ctx->moodbarData && ctx->moodbarData->numFrames;
+    self->analyzed = analyzed;
 }
 
 static void
@@ -272,7 +281,7 @@ draw_summary_surface(struct WaveformSurface *self, struct WaveformSurfaceDrawCon
     int y_min, y_max;
     int min, max;
     int scale;
-    int i, k;
+    int i;
     int loop_end, array_offset;
     int shade;
 
@@ -287,8 +296,10 @@ draw_summary_surface(struct WaveformSurface *self, struct WaveformSurfaceDrawCon
         height = allocation.height;
     }
 
+    unsigned long analyzed = ctx->graphData ? analysis_get_analyzed_blocks(ctx->graphData) : 0;
+
     if (self->surface != NULL && self->width == width && self->height == height &&
-        (ctx->moodbarData && ctx->moodbarData->numFrames) == self->moodbar) {
+        (ctx->moodbarData && ctx->moodbarData->numFrames) == self->moodbar && self->analyzed == analyzed) {
         return;
     }
 
@@ -335,24 +346,19 @@ draw_summary_surface(struct WaveformSurface *self, struct WaveformSurfaceDrawCon
     int tb_index = 0;
     GList *tbl = ctx->list->breaks;
     for (i = 0; i < width && i < ctx->graphData->numSamples; i++) {
-        min = max = 0;
         array_offset = (int)(i * x_scale);
+        loop_end = MAX((int)((i + 1) * x_scale), array_offset + 1);
 
-        if (x_scale != 1) {
-            loop_end = (int)x_scale;
-
-            for (k = 0; k < loop_end; k++) {
-                if (ctx->graphData->data[array_offset + k].max > max) {
-                    max = ctx->graphData->data[array_offset + k].max;
-                } else if (ctx->graphData->data[array_offset + k].min < min) {
-                    min = ctx->graphData->data[array_offset + k].min;
-                }
-            }
-        } else {
-            min = ctx->graphData->data[i].min;
-            max = ctx->graphData->data[i].max;
+        /* only draw the parts that have been analyzed so far */
+        if (!analysis_is_block_valid(ctx->graphData, array_offset)) {
+            continue;
         }
 
+        Points peaks;
+        analysis_get_peaks(ctx->graphData, array_offset, loop_end - array_offset, &peaks);
+        min = peaks.min;
+        max = peaks.max;
+
         y_min = min;
         y_max = max;
 
@@ -391,5 +397,6 @@ draw_summary_surface(struct WaveformSurface *self, struct WaveformSurfaceDrawCon
     self->width = width;
     self->height = height;
     self->moodbar = ctx->moodbarData && ctx->moodbarData->numFrames;
+    self->analyzed = analyzed;
 }
 
@@ -42,6 +42,8 @@ struct WaveformSurface {
     unsigned long height;
     unsigned long offset;
     gboolean moodbar;
+    // number of analyzed blocks when the surface was drawn
+    unsigned long analyzed;
 
     void (*draw)(struct WaveformSurface *, struct WaveformSurfaceDrawContext *);
 };
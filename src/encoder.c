@@ -0,0 +1,352 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include "encoder.h"
+#include "format.h"
+
+#include <glib/gstdio.h>
+
+#include <string.h>
+
+#if defined(HAVE_FLAC)
+#include <FLAC/stream_encoder.h>
+#endif
+
+#define ENCODER_BUFFER_SIZE (256 * 1024)
+#define ENCODER_NUM_BUFFERS 4
+
+/* FLAC default, a good trade-off between speed and size */
+#define ENCODER_FLAC_COMPRESSION_LEVEL 5
+
+struct Encoder_ {
+    enum OutputCodec codec;
+    gchar *filename;
+    SampleInfo sample_info;
+
+    GThread *thread;
+
+    EncoderBuffer buffers[ENCODER_NUM_BUFFERS];
+    GAsyncQueue *free_buffers;   /* to be filled by the writer */
+    GAsyncQueue *queued_buffers; /* to be encoded, see encoder_finish() */
+
+    volatile gint failed;
+
+#if defined(HAVE_FLAC)
+    FLAC__StreamEncoder *flac;
+    FLAC__int32 *samples;
+#endif
+};
+
+static const struct {
+    enum OutputCodec codec;
+    const char *name;
+    const char *file_extension;
+} encoder_codecs[] = {
+    { OUTPUT_CODEC_SOURCE, "source", NULL },
+    { OUTPUT_CODEC_FLAC, "flac", ".flac" },
+};
+
+int
+encoder_codec_from_name(const char *name)
+{
+    for (size_t i=0; i<G_N_ELEMENTS(encoder_codecs); ++i) {
+        if (g_ascii_strcasecmp(encoder_codecs[i].name, name) == 0) {
+            return encoder_codecs[i].codec;
+        }
+    }
+
+    return -1;
+}
+
+const char *
+encoder_codec_get_name(enum OutputCodec codec)
+{
+    for (size_t i=0; i<G_N_ELEMENTS(encoder_codecs); ++i) {
+        if (encoder_codecs[i].codec == codec) {
+            return encoder_codecs[i].name;
+        }
+    }
+
+    return NULL;
+}
+
+const char *
+encoder_codec_get_file_extension(enum OutputCodec codec)
+{
+    for (size_t i=0; i<G_N_ELEMENTS(encoder_codecs); ++i) {
+        if (encoder_codecs[i].codec == codec) {
+            return encoder_codecs[i].file_extension;
+        }
+    }
+
+    return NULL;
+}
+
+gboolean
+encoder_codec_is_available(enum OutputCodec codec)
+{
+    switch (codec) {
+        case OUTPUT_CODEC_SOURCE:
+            return TRUE;
+        case OUTPUT_CODEC_FLAC:
+#if defined(HAVE_FLAC)
+            return TRUE;
+#else
+            return FALSE;
+#endif
+        default:
+            return FALSE;
+    }
+}
+
+#if defined(HAVE_FLAC)
+static gboolean
+encoder_flac_init(Encoder *encoder, uint64_t num_bytes, char **error_message)
+{
+    const SampleInfo *si = &encoder->sample_info;
+
+    if (si->bitsPerSample > FLAC__REFERENCE_CODEC_MAX_BITS_PER_SAMPLE) {
+        format_module_set_error_message(error_message, "FLAC does not support %d-bit samples", si->bitsPerSample);
+        return FALSE;
+    }
+
+    encoder->flac = FLAC__stream_encoder_new();
+    if (encoder->flac == NULL) {
+        format_module_set_error_message(error_message, "Could not create FLAC encoder");
+        return FALSE;
+    }
+
+    FLAC__stream_encoder_set_channels(encoder->flac, si->channels);
+    FLAC__stream_encoder_set_bits_per_sample(encoder->flac, si->bitsPerSample);
+    FLAC__stream_encoder_set_sample_rate(encoder->flac, si->samplesPerSec);
+    FLAC__stream_encoder_set_compression_level(encoder->flac, ENCODER_FLAC_COMPRESSION_LEVEL);
+    FLAC__stream_encoder_set_total_samples_estimate(encoder->flac, num_bytes / si->blockAlign);
+
+    FLAC__StreamEncoderInitStatus status = FLAC__stream_encoder_init_file(encoder->flac, encoder->filename, NULL, NULL);
+    if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+        format_module_set_error_message(error_message, "Could not create %s: %s",
+                encoder->filename, FLAC__StreamEncoderInitStatusString[status]);
+        FLAC__stream_encoder_delete(g_steal_pointer(&encoder->flac));
+        return FALSE;
+    }
+
+    encoder->samples = g_new(FLAC__int32, ENCODER_BUFFER_SIZE / (si->blockAlign / si->channels));
+
+    return TRUE;
+}
+
+static gboolean
+encoder_flac_encode(Encoder *encoder, const EncoderBuffer *buffer)
+{
+    const SampleInfo *si = &encoder->sample_info;
+
+    // Samples are little-endian, 8-bit ones unsigned; smaller samples are
+    // left-justified in their container (e.g. 20 bits in 3 bytes)
+    int bytes_per_sample = si->blockAlign / si->channels;
+    int shift = bytes_per_sample * 8 - si->bitsPerSample;
+    size_t num_samples = buffer->len / bytes_per_sample;
+
+    const unsigned char *src = buffer->data;
+    FLAC__int32 *dst = encoder->samples;
+
+    switch (bytes_per_sample) {
+        case 1:
+            for (size_t i=0; i<num_samples; ++i) {
+                dst[i] = ((FLAC__int32)src[i] - 128) >> shift;
+            }
+            break;
+        case 2:
+            for (size_t i=0; i<num_samples; ++i, src += 2) {
+                dst[i] = (int16_t)(src[0] | (src[1] << 8)) >> shift;
+            }
+            break;
+        case 3:
+            for (size_t i=0; i<num_samples; ++i, src += 3) {
+                dst[i] = ((int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24)) >> 8) >> shift;
+            }
+            break;
+        case 4:
+            for (size_t i=0; i<num_samples; ++i, src += 4) {
+                dst[i] = (int32_t)((uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24)) >> shift;
+            }
+            break;
+        default:
+            return FALSE;
+    }
+
+    if (!FLAC__stream_encoder_process_interleaved(encoder->flac, dst, num_samples / si->channels)) {
+        g_warning("FLAC encoder error: %s", FLAC__StreamEncoderStateString[FLAC__stream_encoder_get_state(encoder->flac)]);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+encoder_flac_finish(Encoder *encoder, gboolean ok)
+{
+    // Writes the final STREAMINFO (total samples, MD5) and closes the file
+    if (!FLAC__stream_encoder_finish(encoder->flac) && ok) {
+        g_warning("FLAC encoder error: %s", FLAC__StreamEncoderStateString[FLAC__stream_encoder_get_state(encoder->flac)]);
+        ok = FALSE;
+    }
+
+    FLAC__stream_encoder_delete(g_steal_pointer(&encoder->flac));
+    g_free(g_steal_pointer(&encoder->samples));
+
+    return ok;
+}
+#endif /* HAVE_FLAC */
+
+static gboolean
+encoder_encode(Encoder *encoder, const EncoderBuffer *buffer)
+{
+    switch (encoder->codec) {
+#if defined(HAVE_FLAC)
+        case OUTPUT_CODEC_FLAC:
+            return encoder_flac_encode(encoder, buffer);
+#endif
+        default:
+            return FALSE;
+    }
+}
+
+static gpointer
+encoder_thread(gpointer data)
+{
+    Encoder *encoder = data;
+
+    EncoderBuffer *buffer;
+    while ((buffer = g_async_queue_pop(encoder->queued_buffers)) != encoder->buffers + ENCODER_NUM_BUFFERS) {
+        // After an error, keep recycling buffers so that the writer never blocks
+        if (buffer->len > 0 && !g_atomic_int_get(&encoder->failed) && !encoder_encode(encoder, buffer)) {
+            g_atomic_int_set(&encoder->failed, TRUE);
+        }
+
+        g_async_queue_push(encoder->free_buffers, buffer);
+    }
+
+    return NULL;
+}
+
+Encoder *
+encoder_start(enum OutputCodec codec, const char *filename, const SampleInfo *sample_info, uint64_t num_bytes, char **error_message)
+{
+    if (!encoder_codec_is_available(codec) || codec == OUTPUT_CODEC_SOURCE) {
+        format_module_set_error_message(error_message, "Output codec not supported");
+        return NULL;
+    }
+
+    Encoder *encoder = g_new0(Encoder, 1);
+
+    encoder->codec = codec;
+    encoder->filename = g_strdup(filename);
+    encoder->sample_info = *sample_info;
+
+    gboolean ok = FALSE;
+
+    switch (codec) {
+#if defined(HAVE_FLAC)
+        case OUTPUT_CODEC_FLAC:
+            ok = encoder_flac_init(encoder, num_bytes, error_message);
+            break;
+#endif
+        default:
+            break;
+    }
+
+    if (!ok) {
+        g_free(encoder->filename);
+        g_free(encoder);
+        return NULL;
+    }
+
+    encoder->free_buffers = g_async_queue_new();
+    encoder->queued_buffers = g_async_queue_new();
+
+    for (int i=0; i<ENCODER_NUM_BUFFERS; ++i) {
+        EncoderBuffer *buffer = &encoder->buffers[i];
+
+        buffer->size = ENCODER_BUFFER_SIZE - ENCODER_BUFFER_SIZE % sample_info->blockAlign;
+        buffer->data = g_malloc(buffer->size);
+
+        g_async_queue_push(encoder->free_buffers, buffer);
+    }
+
+    encoder->thread = g_thread_new("encoder", encoder_thread, encoder);
+
+    return encoder;
+}
+
+EncoderBuffer *
+encoder_get_buffer(Encoder *encoder)
+{
+    EncoderBuffer *buffer = g_async_queue_pop(encoder->free_buffers);
+    buffer->len = 0;
+
+    return buffer;
+}
+
+gboolean
+encoder_push_buffer(Encoder *encoder, EncoderBuffer *buffer)
+{
+    // Only whole sample frames are encoded
+    buffer->len -= buffer->len % encoder->sample_info.blockAlign;
+
+    g_async_queue_push(encoder->queued_buffers, buffer);
+
+    return !g_atomic_int_get(&encoder->failed);
+}
+
+int
+encoder_finish(Encoder *encoder, gboolean abort)
+{
+    // One past the last buffer marks the end of the input (NULL can't be queued)
+    g_async_queue_push(encoder->queued_buffers, encoder->buffers + ENCODER_NUM_BUFFERS);
+    g_thread_join(encoder->thread);
+
+    gboolean ok = !abort && !g_atomic_int_get(&encoder->failed);
+
+    switch (encoder->codec) {
+#if defined(HAVE_FLAC)
+        case OUTPUT_CODEC_FLAC:
+            ok = encoder_flac_finish(encoder, ok);
+            break;
+#endif
+        default:
+            break;
+    }
+
+    if (!ok) {
+        // Don't leave a truncated track behind
+        g_unlink(encoder->filename);
+    }
+
+    for (int i=0; i<ENCODER_NUM_BUFFERS; ++i) {
+        g_free(encoder->buffers[i].data);
+    }
+
+    g_async_queue_unref(encoder->queued_buffers);
+    g_async_queue_unref(encoder->free_buffers);
+    g_free(encoder->filename);
+    g_free(encoder);
+
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,87 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "sample_info.h"
+
+#include <glib.h>
+#include <stdint.h>
+
+/**
+ * Encoding split tracks
+ *
+ * By default, tracks are written in the format of the source file. With an
+ * output codec, the decoded PCM data (as returned by format_read_samples())
+ * is passed to an encoder running on a thread of its own: the writer fills
+ * buffers taken from a small pool and queues them, so decoding and encoding
+ * overlap and the memory per track is bounded.
+ **/
+
+enum OutputCodec {
+    OUTPUT_CODEC_SOURCE = 0, /* same format as the source, no encoding */
+    OUTPUT_CODEC_FLAC = 1,
+};
+
+typedef struct Encoder_ Encoder;
+
+typedef struct EncoderBuffer_ EncoderBuffer;
+struct EncoderBuffer_ {
+    unsigned char *data;
+    size_t size; /* allocated, a multiple of the block align */
+    size_t len;  /* filled by the writer */
+};
+
+/* Codec for a name ("flac"), -1 if unknown */
+int
+encoder_codec_from_name(const char *name);
+
+const char *
+encoder_codec_get_name(enum OutputCodec codec);
+
+/* File extension including the dot, NULL for OUTPUT_CODEC_SOURCE */
+const char *
+encoder_codec_get_file_extension(enum OutputCodec codec);
+
+/* FALSE if wavbreaker was built without support for codec */
+gboolean
+encoder_codec_is_available(enum OutputCodec codec);
+
+/**
+ * Create filename and start the encoder thread. num_bytes (PCM) is only
+ * used as an estimate for the stream header. Returns NULL and sets
+ * error_message if the encoder could not be set up.
+ **/
+Encoder *
+encoder_start(enum OutputCodec codec, const char *filename, const SampleInfo *sample_info, uint64_t num_bytes, char **error_message);
+
+/* Wait for a free buffer (blocks while all buffers are queued) */
+EncoderBuffer *
+encoder_get_buffer(Encoder *encoder);
+
+/* Queue a filled buffer, returns FALSE if encoding has already failed */
+gboolean
+encoder_push_buffer(Encoder *encoder, EncoderBuffer *buffer);
+
+/**
+ * Signal the end of the input and wait for the encoder thread. If abort
+ * is TRUE or encoding failed, the output file is removed. Frees encoder,
+ * returns 0 on success and -1 on error (as format_write_file()).
+ **/
+int
+encoder_finish(Encoder *encoder, gboolean abort);
@@ -0,0 +1,249 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include "export_manifest.h"
+#include "format.h"
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define EXPORT_MANIFEST_VERSION 2
+#define EXPORT_MANIFEST_GROUP "export"
+#define EXPORT_MANIFEST_TRACK_PREFIX "track "
+#define EXPORT_MANIFEST_EXTENSION ".wavbreaker-manifest"
+
+/* Bytes hashed at the start and at the end of an output file */
+#define EXPORT_MANIFEST_CHECKSUM_BYTES (64 * 1024)
+
+ExportManifest *
+export_manifest_new(const char *output_dir, const char *source_filename, const char *codec)
+{
+    GStatBuf st;
+    if (g_stat(source_filename, &st) != 0) {
+        return NULL;
+    }
+
+    ExportManifest *manifest = g_new0(ExportManifest, 1);
+
+    manifest->output_dir = g_strdup(output_dir);
+    manifest->source = g_path_get_basename(source_filename);
+    manifest->source_size = st.st_size;
+    manifest->source_mtime = st.st_mtime;
+    manifest->codec = g_strdup(codec);
+
+    gchar *basename = g_strconcat(".", manifest->source, EXPORT_MANIFEST_EXTENSION, NULL);
+    manifest->filename = g_build_filename(output_dir, basename, NULL);
+    g_free(basename);
+
+    return manifest;
+}
+
+static void
+export_manifest_clear_records(ExportManifest *manifest)
+{
+    for (guint i = 0; i < manifest->num_records; i++) {
+        g_free(manifest->records[i].name);
+        g_free(manifest->records[i].checksum);
+    }
+
+    g_free(g_steal_pointer(&manifest->records));
+    manifest->num_records = 0;
+}
+
+gboolean
+export_manifest_load(ExportManifest *manifest)
+{
+    GKeyFile *keyfile = g_key_file_new();
+
+    if (!g_key_file_load_from_file(keyfile, manifest->filename, G_KEY_FILE_NONE, NULL)) {
+        g_key_file_free(keyfile);
+        return FALSE;
+    }
+
+    gchar *source = g_key_file_get_string(keyfile, EXPORT_MANIFEST_GROUP, "source", NULL);
+    gchar *codec = g_key_file_get_string(keyfile, EXPORT_MANIFEST_GROUP, "codec", NULL);
+
+    gboolean current = (g_key_file_get_integer(keyfile, EXPORT_MANIFEST_GROUP, "version", NULL) == EXPORT_MANIFEST_VERSION &&
+            g_strcmp0(source, manifest->source) == 0 &&
+            g_key_file_get_uint64(keyfile, EXPORT_MANIFEST_GROUP, "source_size", NULL) == manifest->source_size &&
+            g_key_file_get_int64(keyfile, EXPORT_MANIFEST_GROUP, "source_mtime", NULL) == manifest->source_mtime &&
+            g_strcmp0(codec, manifest->codec) == 0);
+
+    g_free(codec);
+    g_free(source);
+
+    if (!current) {
+        g_debug("Ignoring stale export manifest %s", manifest->filename);
+        g_key_file_free(keyfile);
+        return FALSE;
+    }
+
+    gsize num_groups = 0;
+    gchar **groups = g_key_file_get_groups(keyfile, &num_groups);
+
+    export_manifest_clear_records(manifest);
+    manifest->records = g_new0(ExportManifestRecord, num_groups);
+
+    for (gsize i = 0; i < num_groups; i++) {
+        if (!g_str_has_prefix(groups[i], EXPORT_MANIFEST_TRACK_PREFIX)) {
+            continue;
+        }
+
+        ExportManifestRecord record = {
+            .name = g_key_file_get_string(keyfile, groups[i], "file", NULL),
+            .start_pos = g_key_file_get_uint64(keyfile, groups[i], "start", NULL),
+            .end_pos = g_key_file_get_uint64(keyfile, groups[i], "end", NULL),
+            .size = g_key_file_get_uint64(keyfile, groups[i], "size", NULL),
+            .mtime = g_key_file_get_int64(keyfile, groups[i], "mtime", NULL),
+            .checksum = g_key_file_get_string(keyfile, groups[i], "checksum", NULL),
+        };
+
+        // Names must stay inside the output directory
+        if (record.name == NULL || record.checksum == NULL || record.end_pos == 0 ||
+                strchr(record.name, G_DIR_SEPARATOR) != NULL || strchr(record.name, '/') != NULL) {
+            g_free(record.name);
+            g_free(record.checksum);
+            continue;
+        }
+
+        manifest->records[manifest->num_records++] = record;
+    }
+
+    g_strfreev(groups);
+    g_key_file_free(keyfile);
+
+    return TRUE;
+}
+
+void
+export_manifest_add(ExportManifest *manifest, const ExportManifestRecord *record)
+{
+    manifest->records = g_renew(ExportManifestRecord, manifest->records, manifest->num_records + 1);
+
+    manifest->records[manifest->num_records++] = (ExportManifestRecord) {
+        .name = g_strdup(record->name),
+        .start_pos = record->start_pos,
+        .end_pos = record->end_pos,
+        .size = record->size,
+        .mtime = record->mtime,
+        .checksum = g_strdup(record->checksum),
+    };
+}
+
+gboolean
+export_manifest_save(ExportManifest *manifest, char **error_message)
+{
+    GKeyFile *keyfile = g_key_file_new();
+
+    g_key_file_set_integer(keyfile, EXPORT_MANIFEST_GROUP, "version", EXPORT_MANIFEST_VERSION);
+    g_key_file_set_string(keyfile, EXPORT_MANIFEST_GROUP, "source", manifest->source);
+    g_key_file_set_uint64(keyfile, EXPORT_MANIFEST_GROUP, "source_size", manifest->source_size);
+    g_key_file_set_int64(keyfile, EXPORT_MANIFEST_GROUP, "source_mtime", manifest->source_mtime);
+    g_key_file_set_string(keyfile, EXPORT_MANIFEST_GROUP, "codec", manifest->codec);
+
+    for (guint i = 0; i < manifest->num_records; i++) {
+        const ExportManifestRecord *record = &manifest->records[i];
+
+        gchar *group = g_strdup_printf(EXPORT_MANIFEST_TRACK_PREFIX "%u", i + 1);
+
+        g_key_file_set_string(keyfile, group, "file", record->name);
+        g_key_file_set_uint64(keyfile, group, "start", record->start_pos);
+        g_key_file_set_uint64(keyfile, group, "end", record->end_pos);
+        g_key_file_set_uint64(keyfile, group, "size", record->size);
+        g_key_file_set_int64(keyfile, group, "mtime", record->mtime);
+        g_key_file_set_string(keyfile, group, "checksum", record->checksum);
+
+        g_free(group);
+    }
+
+    GError *error = NULL;
+    gboolean result = g_key_file_save_to_file(keyfile, manifest->filename, &error);
+    if (!result) {
+        format_module_set_error_message(error_message, "Could not save %s: %s", manifest->filename, error->message);
+        g_error_free(error);
+    }
+
+    g_key_file_free(keyfile);
+
+    return result;
+}
+
+void
+export_manifest_free(ExportManifest *manifest)
+{
+    export_manifest_clear_records(manifest);
+
+    g_free(manifest->codec);
+    g_free(manifest->source);
+    g_free(manifest->filename);
+    g_free(manifest->output_dir);
+    g_free(manifest);
+}
+
+gchar *
+export_manifest_checksum(const char *filename, uint64_t *size, gint64 *mtime)
+{
+    FILE *fp = g_fopen(filename, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    GStatBuf st;
+    if (g_stat(filename, &st) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    unsigned char *buf = g_malloc(EXPORT_MANIFEST_CHECKSUM_BYTES);
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    gboolean ok = TRUE;
+
+    // The head, then the tail (or whatever follows the head in shorter files)
+    uint64_t offsets[] = { 0, MAX((uint64_t)st.st_size, 2 * EXPORT_MANIFEST_CHECKSUM_BYTES) - EXPORT_MANIFEST_CHECKSUM_BYTES };
+    size_t num_offsets = ((uint64_t)st.st_size > EXPORT_MANIFEST_CHECKSUM_BYTES) ? 2 : 1;
+
+    for (size_t i=0; i<num_offsets && ok; ++i) {
+
+        size_t len = 0;
+        if (fseeko(fp, offsets[i], SEEK_SET) != 0) {
+            ok = FALSE;
+        } else {
+            len = fread(buf, 1, EXPORT_MANIFEST_CHECKSUM_BYTES, fp);
+            ok = !ferror(fp);
+        }
+
+        g_checksum_update(checksum, buf, len);
+    }
+
+    gchar *result = ok ? g_strdup(g_checksum_get_string(checksum)) : NULL;
+
+    g_checksum_free(checksum);
+    g_free(buf);
+    fclose(fp);
+
+    if (result != NULL) {
+        *size = st.st_size;
+        *mtime = st.st_mtime;
+    }
+
+    return result;
+}
@@ -0,0 +1,93 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+/**
+ * Export manifest
+ *
+ * A split leaves a small key file next to its outputs (one per source file,
+ * hidden) that records which source range and codec each output file was
+ * written from, with its size, modification time and a checksum. The next
+ * split of the same, unchanged source into the same directory can then keep
+ * (or just rename) outputs whose range did not change instead of writing
+ * them again.
+ **/
+
+typedef struct ExportManifestRecord_ ExportManifestRecord;
+struct ExportManifestRecord_ {
+    gchar *name;             /* output file, relative to the output directory */
+    unsigned long start_pos; /* PCM byte range in the source */
+    unsigned long end_pos;   /* exclusive, never 0 */
+    uint64_t size;           /* of the output file */
+    gint64 mtime;            /* of the output file, catches edits the checksum doesn't cover */
+    gchar *checksum;         /* see export_manifest_checksum() */
+};
+
+typedef struct ExportManifest_ ExportManifest;
+struct ExportManifest_ {
+    gchar *output_dir;
+    gchar *filename; /* of the manifest itself */
+
+    // The export the records belong to
+    gchar *source;   /* basename of the source file */
+    uint64_t source_size;
+    gint64 source_mtime;
+    gchar *codec;    /* see encoder_codec_get_name() */
+
+    ExportManifestRecord *records;
+    guint num_records;
+};
+
+/**
+ * Create an empty manifest for splitting source_filename into output_dir
+ * with codec. Returns NULL if the source file can't be stat'ed.
+ **/
+ExportManifest *
+export_manifest_new(const char *output_dir, const char *source_filename, const char *codec);
+
+/**
+ * Read the records of the previous export from disk. Returns FALSE (and
+ * leaves the manifest empty) if there is none, or if it was written for a
+ * different version of the source or a different codec.
+ **/
+gboolean
+export_manifest_load(ExportManifest *manifest);
+
+/* The record is copied */
+void
+export_manifest_add(ExportManifest *manifest, const ExportManifestRecord *record);
+
+/* Replace the manifest on disk (atomically) */
+gboolean
+export_manifest_save(ExportManifest *manifest, char **error_message);
+
+void
+export_manifest_free(ExportManifest *manifest);
+
+/**
+ * Checksum (SHA-256) of the first and last 64 KiB of filename, which
+ * covers the headers and tags; the size and modification time are compared
+ * separately. Returns NULL if the file can't be read, sets *size and
+ * *mtime otherwise.
+ **/
+gchar *
+export_manifest_checksum(const char *filename, uint64_t *size, gint64 *mtime);
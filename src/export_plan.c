@@ -0,0 +1,413 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include "export_plan.h"
+#include "format.h"
+
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <string.h>
+#if !defined(G_OS_WIN32)
+#include <sys/statvfs.h>
+#endif
+
+/* Headers, tags and seek tables on top of the audio data */
+#define EXPORT_PLAN_HEADER_BYTES (64 * 1024)
+
+/* Appended to the new name of a reused output while it is being moved */
+#define EXPORT_PLAN_MOVE_SUFFIX ".wavbreaker-move"
+
+static uint64_t
+export_plan_estimate_size(unsigned long start_pos, unsigned long end_pos,
+                          const SampleInfo *sample_info, uint64_t file_size, enum OutputCodec codec)
+{
+    uint64_t num_bytes = sample_info->numBytes;
+    uint64_t end = (end_pos != 0) ? MIN(end_pos, num_bytes) : num_bytes;
+    uint64_t pcm_bytes = (end > start_pos) ? end - start_pos : 0;
+
+    if (codec != OUTPUT_CODEC_SOURCE || num_bytes == 0) {
+        // Encoded output is (almost always) smaller than the PCM data
+        return pcm_bytes + EXPORT_PLAN_HEADER_BYTES;
+    }
+
+    // Copied from the source, so the same share of the source file
+    return (uint64_t)((double)pcm_bytes * file_size / num_bytes) + EXPORT_PLAN_HEADER_BYTES;
+}
+
+static uint64_t
+export_plan_get_available_bytes(const char *output_dir)
+{
+#if !defined(G_OS_WIN32)
+    struct statvfs st;
+    if (statvfs(output_dir, &st) == 0) {
+        return (uint64_t)st.f_bavail * st.f_frsize;
+    }
+#endif
+
+    return G_MAXUINT64;
+}
+
+ExportPlan *
+export_plan_new(TrackBreakList *list, const char *output_dir, const char *extension,
+                const SampleInfo *sample_info, uint64_t file_size, enum OutputCodec codec)
+{
+    ExportPlan *plan = g_new0(ExportPlan, 1);
+
+    plan->output_dir = g_strdup(output_dir);
+    plan->source_bytes = sample_info->numBytes;
+
+    guint num_enabled = 0;
+    for (GList *cur = list->breaks; cur != NULL; cur = g_list_next(cur)) {
+        TrackBreak *tb = cur->data;
+
+        if (tb->write) {
+            ++num_enabled;
+        }
+    }
+
+    plan->entries = g_new0(ExportPlanEntry, num_enabled);
+
+    // Canonical path -> position of the first track using it
+    GHashTable *paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    for (GList *cur = list->breaks; cur != NULL; cur = g_list_next(cur)) {
+        TrackBreak *tb = cur->data;
+
+        if (!tb->write) {
+            continue;
+        }
+
+        ExportPlanEntry *entry = &plan->entries[plan->num_entries++];
+        entry->position = plan->num_entries;
+
+        gchar *name = track_break_get_filename(tb, list);
+        if (extension != NULL && strstr(name, extension) == NULL) {
+            gchar *tmp = g_strconcat(name, extension, NULL);
+            g_free(name);
+            name = tmp;
+        }
+
+        entry->name = name;
+        entry->filename = g_build_filename(output_dir, name, NULL);
+
+        // The end of a track is the next break, written or not
+        TrackBreak *tb_next = (cur->next != NULL) ? cur->next->data : NULL;
+        entry->start_pos = tb->offset * sample_info->blockSize;
+        entry->end_pos = (tb_next != NULL) ? tb_next->offset * sample_info->blockSize : 0;
+        entry->estimated_size = export_plan_estimate_size(entry->start_pos, entry->end_pos, sample_info, file_size, codec);
+
+        GStatBuf st;
+        if (g_stat(entry->filename, &st) == 0) {
+            entry->exists = TRUE;
+            entry->existing_size = st.st_size;
+        }
+
+        gchar *path = g_canonicalize_filename(entry->filename, NULL);
+        gpointer first = g_hash_table_lookup(paths, path);
+        if (first != NULL) {
+            entry->collides_with = GPOINTER_TO_UINT(first);
+            g_free(path);
+        } else {
+            g_hash_table_insert(paths, path, GUINT_TO_POINTER(entry->position));
+        }
+    }
+
+    g_hash_table_unref(paths);
+
+    plan->available_bytes = export_plan_get_available_bytes(output_dir);
+
+    return plan;
+}
+
+/* The end of the range of entry, never 0 */
+static unsigned long
+export_plan_entry_end(const ExportPlan *plan, const ExportPlanEntry *entry)
+{
+    return (entry->end_pos != 0) ? MIN(entry->end_pos, plan->source_bytes) : plan->source_bytes;
+}
+
+void
+export_plan_match_manifest(ExportPlan *plan, const ExportManifest *previous)
+{
+    gboolean *checked = g_new0(gboolean, previous->num_records);
+
+    for (guint i = 0; i < plan->num_entries; i++) {
+        ExportPlanEntry *entry = &plan->entries[i];
+        unsigned long end_pos = export_plan_entry_end(plan, entry);
+
+        for (guint r = 0; r < previous->num_records && entry->reused_from == NULL; r++) {
+            const ExportManifestRecord *record = &previous->records[r];
+
+            if (checked[r] || record->start_pos != entry->start_pos || record->end_pos != end_pos) {
+                continue;
+            }
+
+            // Each output is used at most once, and only if it was not modified since
+            checked[r] = TRUE;
+
+            gchar *filename = g_build_filename(plan->output_dir, record->name, NULL);
+            uint64_t size = 0;
+            gint64 mtime = 0;
+            gchar *checksum = export_manifest_checksum(filename, &size, &mtime);
+
+            if (checksum != NULL && size == record->size && mtime == record->mtime &&
+                    strcmp(checksum, record->checksum) == 0) {
+                entry->reused_from = filename;
+                entry->reused_size = size;
+                entry->reused_mtime = mtime;
+                entry->reused_checksum = checksum;
+            } else {
+                g_free(checksum);
+                g_free(filename);
+            }
+        }
+    }
+
+    g_free(checked);
+
+    // Outputs that are kept or moved away are not in the way of any entry
+    for (guint i = 0; i < plan->num_entries; i++) {
+        ExportPlanEntry *entry = &plan->entries[i];
+
+        for (guint j = 0; j < plan->num_entries && entry->exists; j++) {
+            const char *reused_from = plan->entries[j].reused_from;
+
+            if (reused_from != NULL && strcmp(reused_from, entry->filename) == 0) {
+                entry->exists = FALSE;
+                entry->existing_size = 0;
+            }
+        }
+    }
+}
+
+void
+export_plan_resolve_overwrites(ExportPlan *plan, const WriteStatusCallbacks *callbacks)
+{
+    enum OverwriteDecision decision = OVERWRITE_DECISION_ASK;
+
+    for (guint i = 0; i < plan->num_entries; i++) {
+        ExportPlanEntry *entry = &plan->entries[i];
+
+        if (!entry->exists || callbacks->is_cancelled(callbacks->user_data)) {
+            continue;
+        }
+
+        if (decision == OVERWRITE_DECISION_ASK) {
+            decision = callbacks->ask_overwrite(entry->filename, callbacks->user_data);
+        }
+
+        entry->skip = (decision != OVERWRITE_DECISION_OVERWRITE && decision != OVERWRITE_DECISION_OVERWRITE_ALL);
+
+        if (decision != OVERWRITE_DECISION_SKIP_ALL && decision != OVERWRITE_DECISION_OVERWRITE_ALL) {
+            decision = OVERWRITE_DECISION_ASK;
+        }
+    }
+}
+
+gboolean
+export_plan_check(ExportPlan *plan, char **error_message)
+{
+    uint64_t required = 0;
+    uint64_t available = plan->available_bytes;
+
+    for (guint i = 0; i < plan->num_entries; i++) {
+        ExportPlanEntry *entry = &plan->entries[i];
+
+        if (entry->skip) {
+            continue;
+        }
+
+        if (entry->collides_with != 0) {
+            format_module_set_error_message(error_message, "Tracks %u and %u would both be written to %s",
+                    entry->collides_with, entry->position, entry->filename);
+            return FALSE;
+        }
+
+        // Reused outputs are already on the same filesystem
+        if (entry->reused_from != NULL) {
+            continue;
+        }
+
+        required += entry->estimated_size;
+
+        // Replaced files give their space back
+        if (entry->exists && available != G_MAXUINT64) {
+            available += entry->existing_size;
+        }
+    }
+
+    plan->required_bytes = required;
+
+    if (available != G_MAXUINT64 && required > available) {
+        gchar *required_str = g_format_size(required);
+        gchar *available_str = g_format_size(available);
+
+        format_module_set_error_message(error_message, "Not enough disk space: about %s needed, %s available",
+                required_str, available_str);
+
+        g_free(available_str);
+        g_free(required_str);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Give up reusing the output of entry, it will be written instead */
+static void
+export_plan_entry_drop_reused(ExportPlanEntry *entry)
+{
+    g_free(g_steal_pointer(&entry->reused_from));
+    g_free(g_steal_pointer(&entry->reused_checksum));
+    entry->reused_size = 0;
+    entry->reused_mtime = 0;
+}
+
+/* TRUE if name is the output path of an entry that is written or reused */
+static gboolean
+export_plan_is_target(const ExportPlan *plan, const char *filename)
+{
+    for (guint i = 0; i < plan->num_entries; i++) {
+        if (!plan->entries[i].skip && strcmp(plan->entries[i].filename, filename) == 0) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+gboolean
+export_plan_move_reused(ExportPlan *plan, char **error_message)
+{
+    // Where each moved output came from, to put it back if the move fails
+    gchar **origins = g_new0(gchar *, plan->num_entries);
+    gboolean dropped = FALSE;
+
+    // Out of the way first, so that outputs can take each other's names
+    for (guint i = 0; i < plan->num_entries; i++) {
+        ExportPlanEntry *entry = &plan->entries[i];
+
+        if (entry->skip || entry->reused_from == NULL || strcmp(entry->reused_from, entry->filename) == 0) {
+            continue;
+        }
+
+        gchar *tmp = g_strconcat(entry->filename, EXPORT_PLAN_MOVE_SUFFIX, NULL);
+
+        if (g_rename(entry->reused_from, tmp) != 0) {
+            g_warning("Could not rename %s: %s", entry->reused_from, strerror(errno));
+            export_plan_entry_drop_reused(entry);
+            dropped = TRUE;
+            g_free(tmp);
+        } else {
+            origins[i] = g_steal_pointer(&entry->reused_from);
+            entry->reused_from = tmp;
+        }
+    }
+
+    for (guint i = 0; i < plan->num_entries; i++) {
+        ExportPlanEntry *entry = &plan->entries[i];
+
+        if (entry->skip || entry->reused_from == NULL || strcmp(entry->reused_from, entry->filename) == 0) {
+            continue;
+        }
+
+        if (g_rename(entry->reused_from, entry->filename) != 0) {
+            g_warning("Could not rename %s: %s", entry->reused_from, strerror(errno));
+
+            // Keep the output: back under its old name if nothing else goes
+            // there, otherwise where it is now
+            if (!export_plan_is_target(plan, origins[i]) && !g_file_test(origins[i], G_FILE_TEST_EXISTS) &&
+                    g_rename(entry->reused_from, origins[i]) != 0) {
+                g_warning("Could not rename %s back: %s", entry->reused_from, strerror(errno));
+            }
+
+            export_plan_entry_drop_reused(entry);
+            dropped = TRUE;
+        } else {
+            g_free(entry->reused_from);
+            entry->reused_from = g_strdup(entry->filename);
+        }
+    }
+
+    for (guint i = 0; i < plan->num_entries; i++) {
+        g_free(origins[i]);
+    }
+    g_free(origins);
+
+    if (!dropped) {
+        return TRUE;
+    }
+
+    // The entries that are written instead were not counted by export_plan_check()
+    plan->available_bytes = export_plan_get_available_bytes(plan->output_dir);
+
+    return export_plan_check(plan, error_message);
+}
+
+void
+export_plan_update_manifest(ExportPlan *plan, ExportManifest *manifest)
+{
+    for (guint i = 0; i < plan->num_entries; i++) {
+        ExportPlanEntry *entry = &plan->entries[i];
+
+        if (entry->skip) {
+            continue;
+        }
+
+        ExportManifestRecord record = {
+            .name = entry->name,
+            .start_pos = entry->start_pos,
+            .end_pos = export_plan_entry_end(plan, entry),
+            .size = entry->reused_size,
+            .mtime = entry->reused_mtime,
+            .checksum = entry->reused_checksum,
+        };
+
+        gchar *checksum = NULL;
+        if (entry->reused_from == NULL && entry->written) {
+            record.checksum = checksum = export_manifest_checksum(entry->filename, &record.size, &record.mtime);
+        }
+
+        // Failed, cancelled or unreadable entries are written again next time
+        if (record.checksum != NULL) {
+            export_manifest_add(manifest, &record);
+        }
+
+        g_free(checksum);
+    }
+}
+
+void
+export_plan_free(ExportPlan *plan)
+{
+    for (guint i = 0; i < plan->num_entries; i++) {
+        ExportPlanEntry *entry = &plan->entries[i];
+
+        g_free(entry->name);
+        g_free(entry->filename);
+        g_free(entry->reused_from);
+        g_free(entry->reused_checksum);
+    }
+
+    g_free(plan->entries);
+    g_free(plan->output_dir);
+    g_free(plan);
+}
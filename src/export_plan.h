@@ -0,0 +1,114 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "sample.h"
+#include "export_manifest.h"
+
+/**
+ * Export planning
+ *
+ * Before a split touches the disk, all output paths are resolved in one
+ * pass, tracks that would end up in the same file are detected, existing
+ * files are settled with the overwrite callback and the estimated size of
+ * the output is checked against the free space of the target filesystem.
+ * Outputs of the previous export (see export_manifest.h) that hold the
+ * same range are kept or renamed. The write phase then only works through
+ * the remaining entries.
+ **/
+
+typedef struct ExportPlanEntry_ ExportPlanEntry;
+struct ExportPlanEntry_ {
+    guint position;          /* among the enabled tracks, starting at 1 */
+    gchar *name;             /* of the output file, relative to the output directory */
+    gchar *filename;         /* full path of the output file */
+    unsigned long start_pos; /* PCM byte range in the source */
+    unsigned long end_pos;   /* 0 = until the end of the source */
+    uint64_t estimated_size; /* of the output file, in bytes */
+    uint64_t existing_size;  /* of the file that is already there, if any */
+    gboolean exists;
+    guint collides_with;     /* position of an earlier track with the same path, 0 = none */
+    gboolean skip;           /* not to be written (existing, not overwritten) */
+
+    gchar *reused_from;      /* output of the previous export with the same data, NULL = write */
+    uint64_t reused_size;
+    gint64 reused_mtime;
+    gchar *reused_checksum;
+    gboolean written;        /* set by the writer on success */
+};
+
+typedef struct ExportPlan_ ExportPlan;
+struct ExportPlan_ {
+    gchar *output_dir;
+    unsigned long source_bytes; /* PCM data in the source, for open-ended ranges */
+
+    ExportPlanEntry *entries;
+    guint num_entries;
+
+    uint64_t required_bytes;  /* estimated, for the entries to be written */
+    uint64_t available_bytes; /* on the target filesystem, G_MAXUINT64 if unknown */
+};
+
+/**
+ * Resolve the output path of every enabled track. extension (including the
+ * dot) is appended unless the name already contains it; sample_info and
+ * file_size of the source are used to estimate the output sizes.
+ **/
+ExportPlan *
+export_plan_new(TrackBreakList *list, const char *output_dir, const char *extension,
+                const SampleInfo *sample_info, uint64_t file_size, enum OutputCodec codec);
+
+/**
+ * Match the entries against the outputs of the previous export: outputs
+ * that still have the recorded size, mtime and checksum are reused for entries
+ * with the same range, either in place or by renaming (e.g. after the
+ * numbering shifted). Call before resolving the overwrites.
+ **/
+void
+export_plan_match_manifest(ExportPlan *plan, const ExportManifest *previous);
+
+/**
+ * Settle existing files: ask once per file until the answer is one of the
+ * "all" decisions. Entries that are not overwritten are marked skip.
+ **/
+void
+export_plan_resolve_overwrites(ExportPlan *plan, const WriteStatusCallbacks *callbacks);
+
+/**
+ * Check for collisions and free space (after resolving overwrites).
+ * Returns FALSE and sets error_message if the plan can't be written.
+ **/
+gboolean
+export_plan_check(ExportPlan *plan, char **error_message);
+
+/**
+ * Rename reused outputs to their new names (after checking the plan).
+ * Entries whose output could not be moved are written instead; the output
+ * itself is kept. Returns FALSE and sets error_message if those entries
+ * no longer fit on the target filesystem.
+ **/
+gboolean
+export_plan_move_reused(ExportPlan *plan, char **error_message);
+
+/* Record the entries that were written or reused (after the write phase) */
+void
+export_plan_update_manifest(ExportPlan *plan, ExportManifest *manifest);
+
+void
+export_plan_free(ExportPlan *plan);
@@ -16,6 +16,11 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+/* pread(), posix_madvise(), posix_fadvise(), copy_file_range(), fallocate(), sync_file_range(), O_DIRECT */
+#define _GNU_SOURCE
+
+#include <config.h>
+
 #include "format.h"
 
 #include "format_wav.h"
@@ -24,9 +29,33 @@
 #include "format_ogg_vorbis.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <unistd.h>
+#if !defined(G_OS_WIN32)
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+#if defined(HAVE_SENDFILE)
+#include <sys/sendfile.h>
+#endif
+
+#define FORMAT_COPY_EXTENT (8 * 1024 * 1024)
+
+/* stdio buffer of output files, for formats written in small pieces (frames, pages) */
+#define FORMAT_OUTPUT_BUFFER_SIZE (256 * 1024)
+
+/* Alignment of O_DIRECT buffers, offsets and lengths (covers 512e and 4Kn disks) */
+#define FORMAT_DIRECT_ALIGN 4096
+
+enum FormatCopyMethod {
+    FORMAT_COPY_FILE_RANGE = 0,
+    FORMAT_COPY_SENDFILE,
+    FORMAT_COPY_BUFFER,
+};
 
 void
 format_module_set_error_message(char **error_message, const char *fmt, ...)
@@ -74,6 +103,10 @@ format_module_open_file(const FormatModule *self, OpenedAudioFile *file, const c
     file->fp = fp;
     file->file_size = st.st_size;
 
+#if defined(G_OS_WIN32)
+    g_mutex_init(&file->read_mutex);
+#endif
+
     return TRUE;
 }
 
@@ -84,13 +117,490 @@ opened_audio_file_close(OpenedAudioFile *file)
         g_free(g_steal_pointer(&file->details));
     }
 
+    if (file->mapped) {
+        g_mapped_file_unref(g_steal_pointer(&file->mapped));
+    }
+
     if (file->fp) {
         fclose(g_steal_pointer(&file->fp));
+
+#if defined(G_OS_WIN32)
+        g_mutex_clear(&file->read_mutex);
+#endif
     }
 
     g_free(g_steal_pointer(&file->filename));
 }
 
+long
+format_module_read_at(OpenedAudioFile *file, void *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+
+    if (file->mapped != NULL) {
+        gsize length = g_mapped_file_get_length(file->mapped);
+        if (offset >= length) {
+            return 0;
+        }
+
+        done = MIN(len, length - offset);
+        memcpy(buf, g_mapped_file_get_contents(file->mapped) + offset, done);
+
+        return done;
+    }
+
+#if defined(G_OS_WIN32)
+    // No pread(), serialize seek + read on the shared FILE instead
+    g_mutex_lock(&file->read_mutex);
+    if (_fseeki64(file->fp, offset, SEEK_SET) != 0) {
+        g_mutex_unlock(&file->read_mutex);
+        return -1;
+    }
+    done = fread(buf, 1, len, file->fp);
+    g_mutex_unlock(&file->read_mutex);
+#else
+    int fd = fileno(file->fp);
+
+    while (done < len) {
+        ssize_t ret = pread(fd, (char *)buf + done, len - done, offset + done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        if (ret == 0) {
+            break;
+        }
+
+        done += ret;
+    }
+#endif
+
+    return done;
+}
+
+static const struct {
+    enum FormatWritePolicy policy;
+    const char *name;
+} format_write_policies[] = {
+    { FORMAT_WRITE_POLICY_CACHE_FRIENDLY, "cache" },
+    { FORMAT_WRITE_POLICY_THROUGHPUT, "throughput" },
+    { FORMAT_WRITE_POLICY_DIRECT, "direct" },
+};
+
+gboolean
+format_module_map_file(OpenedAudioFile *file)
+{
+    GError *error = NULL;
+    GMappedFile *mapped = g_mapped_file_new(file->filename, FALSE, &error);
+    if (mapped == NULL) {
+        g_debug("Could not map %s, using read(): %s", file->filename, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    if (g_mapped_file_get_length(mapped) == 0) {
+        // Empty files have no mapping
+        g_mapped_file_unref(mapped);
+        return FALSE;
+    }
+
+    file->mapped = mapped;
+
+    return TRUE;
+}
+
+const unsigned char *
+format_module_map_range(OpenedAudioFile *file, uint64_t offset, size_t len, enum FormatAccess access)
+{
+    if (file->mapped == NULL || offset + len > g_mapped_file_get_length(file->mapped)) {
+        return NULL;
+    }
+
+    const unsigned char *data = (const unsigned char *)g_mapped_file_get_contents(file->mapped);
+
+#if !defined(G_OS_WIN32)
+    // Hints must start at a page boundary, the mapping itself is page-aligned
+    static long page_size = 0;
+    if (page_size == 0) {
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+
+    uint64_t aligned = offset - offset % page_size;
+    void *addr = (void *)(data + aligned);
+    size_t advise_len = len + (offset - aligned);
+
+    posix_madvise(addr, advise_len, (access == FORMAT_ACCESS_RANDOM) ? POSIX_MADV_RANDOM : POSIX_MADV_SEQUENTIAL);
+    posix_madvise(addr, advise_len, POSIX_MADV_WILLNEED);
+#endif
+
+    return data + offset;
+}
+
+FormatOutput *
+format_output_open(const char *filename, uint64_t size_hint, enum FormatWritePolicy policy)
+{
+    // O_DIRECT copies read back the block at the end of the header
+    FILE *fp = fopen(filename, (policy == FORMAT_WRITE_POLICY_DIRECT) ? "w+b" : "wb");
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    setvbuf(fp, NULL, _IOFBF, FORMAT_OUTPUT_BUFFER_SIZE);
+
+#if defined(HAVE_FALLOCATE)
+    // Keep the size, so that a file that ends up shorter (or is aborted) is not padded
+    if (size_hint > 0 && fallocate(fileno(fp), FALLOC_FL_KEEP_SIZE, 0, size_hint) != 0) {
+        g_debug("Could not preallocate %s: %s", filename, strerror(errno));
+    }
+#endif
+
+    FormatOutput *out = g_new0(FormatOutput, 1);
+
+    out->fp = fp;
+    out->policy = policy;
+
+    return out;
+}
+
+/**
+ * Start writeback of everything up to end that was not handed to it yet,
+ * wait for the previous extent (which should be on disk by now) and drop
+ * it from the page cache. Writing never gets more than an extent ahead of
+ * the disk this way, and the cache holds at most two extents of the file.
+ **/
+static void
+format_output_writeback(FormatOutput *out, uint64_t end)
+{
+    if (out->policy == FORMAT_WRITE_POLICY_THROUGHPUT || end <= out->written_back) {
+        return;
+    }
+
+#if !defined(G_OS_WIN32)
+    int fd = fileno(out->fp);
+
+#if defined(HAVE_SYNC_FILE_RANGE)
+    sync_file_range(fd, out->written_back, end - out->written_back, SYNC_FILE_RANGE_WRITE);
+
+    if (out->written_back > out->dropped) {
+        sync_file_range(fd, out->dropped, out->written_back - out->dropped,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    }
+#endif /* HAVE_SYNC_FILE_RANGE */
+
+    // Without sync_file_range(), only pages that happen to be clean are dropped
+    if (out->written_back > out->dropped) {
+        posix_fadvise(fd, out->dropped, out->written_back - out->dropped, POSIX_FADV_DONTNEED);
+        out->dropped = out->written_back;
+    }
+#endif /* !G_OS_WIN32 */
+
+    out->written_back = end;
+}
+
+void
+format_output_written(FormatOutput *out)
+{
+    if (out->policy == FORMAT_WRITE_POLICY_THROUGHPUT) {
+        return;
+    }
+
+    off_t pos = ftello(out->fp);
+    if (pos < 0 || (uint64_t)pos - out->written_back < FORMAT_COPY_EXTENT) {
+        return;
+    }
+
+    if (fflush(out->fp) == 0) {
+        format_output_writeback(out, pos);
+    }
+}
+
+int
+format_output_close(FormatOutput *out)
+{
+    int result = 0;
+
+    if (fflush(out->fp) != 0) {
+        result = -1;
+    }
+
+#if !defined(G_OS_WIN32)
+    if (result == 0 && out->policy != FORMAT_WRITE_POLICY_THROUGHPUT) {
+        int fd = fileno(out->fp);
+
+#if defined(HAVE_SYNC_FILE_RANGE)
+        // Everything, including the header that was written first
+        sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+#endif /* !G_OS_WIN32 */
+
+    if (fclose(out->fp) != 0) {
+        result = -1;
+    }
+
+    g_free(out);
+
+    return result;
+}
+
+static gboolean
+format_module_write_all(int fd, const unsigned char *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t ret = write(fd, buf + done, len - done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return FALSE;
+        }
+
+        done += ret;
+    }
+
+    return TRUE;
+}
+
+/* Copy one extent, returns the number of bytes copied (0 at EOF) or -1 */
+static long
+format_module_copy_extent(OpenedAudioFile *file, int out_fd, uint64_t offset, size_t len,
+                          enum FormatCopyMethod *method, unsigned char **buf)
+{
+#if defined(HAVE_COPY_FILE_RANGE)
+    if (*method == FORMAT_COPY_FILE_RANGE) {
+        loff_t off_in = offset;
+        ssize_t ret = copy_file_range(fileno(file->fp), &off_in, out_fd, NULL, len, 0);
+        if (ret >= 0 || (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP && errno != EPERM)) {
+            return ret;
+        }
+
+        // Not supported by the kernel or for this pair of file systems
+        g_debug("copy_file_range() failed (%s), falling back to sendfile()", strerror(errno));
+        *method = FORMAT_COPY_SENDFILE;
+    }
+#endif
+
+#if defined(HAVE_SENDFILE)
+    if (*method <= FORMAT_COPY_SENDFILE) {
+        off_t off_in = offset;
+        ssize_t ret = sendfile(out_fd, fileno(file->fp), &off_in, len);
+        if (ret >= 0 || (errno != ENOSYS && errno != EINVAL)) {
+            return ret;
+        }
+
+        g_debug("sendfile() failed (%s), falling back to buffered copy", strerror(errno));
+    }
+#endif
+
+    *method = FORMAT_COPY_BUFFER;
+
+    // Write straight from the mapping if possible, else through one large buffer
+    const unsigned char *data = format_module_map_range(file, offset, len, FORMAT_ACCESS_SEQUENTIAL);
+    if (data == NULL) {
+        if (*buf == NULL && (*buf = malloc(FORMAT_COPY_EXTENT)) == NULL) {
+            return -1;
+        }
+
+        long ret = format_module_read_at(file, *buf, len, offset);
+        if (ret <= 0) {
+            return ret;
+        }
+
+        len = ret;
+        data = *buf;
+    }
+
+    if (!format_module_write_all(out_fd, data, len)) {
+        return -1;
+    }
+
+    return len;
+}
+
+static gboolean
+format_module_pwrite_all(int fd, const unsigned char *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t ret = pwrite(fd, buf + done, len - done, offset + done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return FALSE;
+        }
+
+        done += ret;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Copy through an aligned buffer with O_DIRECT, starting at pos of out.
+ * Returns the number of bytes copied, -1 on error or if aborted, or -2 if
+ * O_DIRECT can't be used (nothing was written then).
+ **/
+static int64_t
+format_module_copy_direct(OpenedAudioFile *file, uint64_t offset, uint64_t len, FormatOutput *out, uint64_t pos,
+                          report_progress_func report_progress, void *report_progress_user_data)
+{
+#if defined(O_DIRECT)
+    int fd = fileno(out->fp);
+
+    void *buf = NULL;
+    if (posix_memalign(&buf, FORMAT_DIRECT_ALIGN, FORMAT_COPY_EXTENT) != 0) {
+        return -2;
+    }
+
+    // Only whole blocks can be written: start with the one holding the end
+    // of what is already there (e.g. the header), read back before O_DIRECT
+    uint64_t base = pos - pos % FORMAT_DIRECT_ALIGN;
+    size_t fill = pos % FORMAT_DIRECT_ALIGN;
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || (fill > 0 && pread(fd, buf, fill, base) != (ssize_t)fill) ||
+            fcntl(fd, F_SETFL, flags | O_DIRECT) != 0) {
+        // Not supported by the file system (e.g. tmpfs)
+        g_debug("O_DIRECT not available (%s), falling back to buffered writes", strerror(errno));
+        free(buf);
+        return -2;
+    }
+
+    int result = 0;
+    uint64_t done = 0;
+
+    while (done < len) {
+        long ret = format_module_read_at(file, (unsigned char *)buf + fill, MIN(len - done, FORMAT_COPY_EXTENT - fill), offset + done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret < 0) {
+            g_warning("Could not copy from %s: %s", file->filename, strerror(errno));
+            result = -1;
+            break;
+        }
+
+        if (ret == 0) {
+            // Source file is shorter than expected
+            break;
+        }
+
+        fill += ret;
+        done += ret;
+
+        if (fill == FORMAT_COPY_EXTENT) {
+            if (!format_module_pwrite_all(fd, buf, fill, base)) {
+                g_warning("Could not write to output file: %s", strerror(errno));
+                result = -1;
+                break;
+            }
+
+            base += fill;
+            fill = 0;
+        }
+
+        if (!report_progress((double)done / (double)len, report_progress_user_data)) {
+            result = -1;
+            break;
+        }
+    }
+
+    // Whole blocks with O_DIRECT, the rest (if any) through the page cache
+    size_t aligned = fill - fill % FORMAT_DIRECT_ALIGN;
+    if (result == 0 && aligned > 0 && !format_module_pwrite_all(fd, buf, aligned, base)) {
+        g_warning("Could not write to output file: %s", strerror(errno));
+        result = -1;
+    }
+
+    fcntl(fd, F_SETFL, flags);
+
+    if (result == 0 && fill > aligned && !format_module_pwrite_all(fd, (unsigned char *)buf + aligned, fill - aligned, base + aligned)) {
+        g_warning("Could not write to output file: %s", strerror(errno));
+        result = -1;
+    }
+
+    free(buf);
+
+    return (result == 0) ? (int64_t)done : -1;
+#else
+    return -2;
+#endif /* O_DIRECT */
+}
+
+gboolean
+format_module_copy_to_file(OpenedAudioFile *file, uint64_t offset, uint64_t len, FormatOutput *out,
+                           report_progress_func report_progress, void *report_progress_user_data)
+{
+    // Anything buffered (e.g. the header) must be written before the payload
+    if (fflush(out->fp) != 0) {
+        return FALSE;
+    }
+
+    int out_fd = fileno(out->fp);
+
+    // The kernel copies below move the file offset behind the back of stdio
+    off_t pos = lseek(out_fd, 0, SEEK_CUR);
+    if (pos < 0) {
+        return FALSE;
+    }
+
+    if (out->policy == FORMAT_WRITE_POLICY_DIRECT) {
+        int64_t ret = format_module_copy_direct(file, offset, len, out, pos, report_progress, report_progress_user_data);
+        if (ret != -2) {
+            return ret >= 0 && fseeko(out->fp, pos + ret, SEEK_SET) == 0;
+        }
+    }
+
+    enum FormatCopyMethod method = FORMAT_COPY_FILE_RANGE;
+    unsigned char *buf = NULL;
+    gboolean result = TRUE;
+    uint64_t done = 0;
+
+    while (done < len) {
+        long ret = format_module_copy_extent(file, out_fd, offset + done, MIN(len - done, FORMAT_COPY_EXTENT), &method, &buf);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret < 0) {
+            g_warning("Could not copy from %s: %s", file->filename, strerror(errno));
+            result = FALSE;
+            break;
+        }
+
+        if (ret == 0) {
+            // Source file is shorter than expected
+            break;
+        }
+
+        done += ret;
+
+        format_output_writeback(out, pos + done);
+
+        if (!report_progress((double)done / (double)len, report_progress_user_data)) {
+            result = FALSE;
+            break;
+        }
+    }
+
+    free(buf);
+
+    return result && fseeko(out->fp, pos + done, SEEK_SET) == 0;
+}
+
 static GList *
 g_modules = NULL;
 
@@ -121,6 +631,30 @@ format_init(void)
     }
 }
 
+int
+format_write_policy_from_name(const char *name)
+{
+    for (size_t i=0; i<G_N_ELEMENTS(format_write_policies); ++i) {
+        if (g_ascii_strcasecmp(format_write_policies[i].name, name) == 0) {
+            return format_write_policies[i].policy;
+        }
+    }
+
+    return -1;
+}
+
+const char *
+format_write_policy_get_name(enum FormatWritePolicy policy)
+{
+    for (size_t i=0; i<G_N_ELEMENTS(format_write_policies); ++i) {
+        if (format_write_policies[i].policy == policy) {
+            return format_write_policies[i].name;
+        }
+    }
+
+    return NULL;
+}
+
 void
 format_print_supported(void)
 {
@@ -137,8 +671,18 @@ format_print_supported(void)
     }
 }
 
+static void
+format_finish_open(OpenedAudioFile *file, int flags)
+{
+    file->open_flags = flags;
+
+    if (file->mod->random_access && !(flags & FORMAT_OPEN_NO_MMAP)) {
+        format_module_map_file(file);
+    }
+}
+
 OpenedAudioFile *
-format_open_file(const char *filename, char **error_message)
+format_open_file(const char *filename, int flags, char **error_message)
 {
     GList *cur = g_list_first(g_modules);
     while (cur != NULL) {
@@ -146,6 +690,7 @@ format_open_file(const char *filename, char **error_message)
 
         OpenedAudioFile *result = mod->open_file(mod, filename, error_message);
         if (result != NULL) {
+            format_finish_open(result, flags);
             return result;
         }
 
@@ -194,6 +739,20 @@ format_print_file_info(OpenedAudioFile *file)
     g_free(duration);
 }
 
+OpenedAudioFile *
+format_reopen_file(OpenedAudioFile *file, char **error_message)
+{
+    OpenedAudioFile *result = (file->mod->reopen_file != NULL) ?
+        file->mod->reopen_file(file, error_message) :
+        file->mod->open_file(file->mod, file->filename, error_message);
+
+    if (result != NULL) {
+        format_finish_open(result, file->open_flags);
+    }
+
+    return result;
+}
+
 void
 format_close_file(OpenedAudioFile *file)
 {
@@ -206,8 +765,66 @@ format_read_samples(OpenedAudioFile *file, unsigned char *buf, size_t buf_size,
     return file->mod->read_samples(file, buf, buf_size, start_pos);
 }
 
+const unsigned char *
+format_map_samples(OpenedAudioFile *file, unsigned long start_pos, size_t *len, enum FormatAccess access)
+{
+    if (file->mod->map_samples == NULL) {
+        return NULL;
+    }
+
+    return file->mod->map_samples(file, start_pos, len, access);
+}
+
 int
-format_write_file(OpenedAudioFile *file, const char *output_filename, unsigned long start_pos, unsigned long end_pos, report_progress_func report_progress, void *report_progress_user_data)
+format_write_file(OpenedAudioFile *file, const char *output_filename, unsigned long start_pos, unsigned long end_pos, enum FormatWritePolicy write_policy, report_progress_func report_progress, void *report_progress_user_data)
+{
+    return file->mod->write_file(file, output_filename, start_pos, end_pos, write_policy, report_progress, report_progress_user_data);
+}
+
+struct FormatTrackProgress {
+    FormatTrack *track;
+    gboolean aborted;
+};
+
+static gboolean
+format_track_progress(double progress, void *user_data)
+{
+    struct FormatTrackProgress *progress_data = user_data;
+    FormatTrack *track = progress_data->track;
+
+    if (!track->report_progress(progress, track->report_progress_user_data)) {
+        progress_data->aborted = TRUE;
+    }
+
+    return !progress_data->aborted;
+}
+
+void
+format_write_tracks(OpenedAudioFile *file, FormatTrack *tracks, size_t num_tracks)
 {
-    return file->mod->write_file(file, output_filename, start_pos, end_pos, report_progress, report_progress_user_data);
+#if !defined(G_OS_WIN32)
+    // Full readahead for the whole file, pages behind the current position can be dropped early
+    posix_fadvise(fileno(file->fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    if (file->mod->write_tracks != NULL) {
+        file->mod->write_tracks(file, tracks, num_tracks);
+        return;
+    }
+
+    // Byte ranges (WAV, CDDA): copying the tracks in order reads the source front to back
+    gboolean aborted = FALSE;
+
+    for (size_t i=0; i<num_tracks; ++i) {
+        if (aborted) {
+            tracks[i].result = -1;
+            continue;
+        }
+
+        struct FormatTrackProgress progress_data = { &tracks[i], FALSE };
+
+        tracks[i].result = format_write_file(file, tracks[i].filename, tracks[i].start_pos, tracks[i].end_pos,
+                                             tracks[i].write_policy, format_track_progress, &progress_data);
+        aborted = progress_data.aborted;
+    }
 }
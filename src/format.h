@@ -28,18 +28,63 @@
 typedef struct FormatModule_ FormatModule;
 typedef struct OpenedAudioFile_ OpenedAudioFile;
 
-typedef void (*report_progress_func)(double progress, void *user_data);
+/* Expected access pattern, passed to the kernel as madvise() hint */
+enum FormatAccess {
+    FORMAT_ACCESS_SEQUENTIAL = 0, /* analysis, export, continuous playback */
+    FORMAT_ACCESS_RANDOM,         /* scrubbing: don't read ahead past the range */
+};
+
+/* How output files are written, see format_output_open() */
+enum FormatWritePolicy {
+    FORMAT_WRITE_POLICY_CACHE_FRIENDLY = 0, /* write back and drop finished extents from the page cache */
+    FORMAT_WRITE_POLICY_THROUGHPUT,         /* leave writeback and caching to the kernel */
+    FORMAT_WRITE_POLICY_DIRECT,             /* bulk copies with O_DIRECT, bypassing the page cache */
+};
+
+/* Returns FALSE if writing should be aborted (the output file is left incomplete) */
+typedef gboolean (*report_progress_func)(double progress, void *user_data);
+
+/* One output file of format_write_tracks() */
+typedef struct FormatTrack_ FormatTrack;
+struct FormatTrack_ {
+    const char *filename;
+    unsigned long start_pos;
+    unsigned long end_pos; /* 0 = until the end of the file */
+    enum FormatWritePolicy write_policy;
+
+    report_progress_func report_progress;
+    void *report_progress_user_data;
+
+    int result; /* set by the writer, as returned by write_file() */
+};
 
 struct FormatModule_ {
     const char *name;
     const char *library_name;
     const char *default_file_extension;
 
+    /* TRUE if read_samples() is a plain byte-addressable read of the file,
+     * so that several handles can read distinct ranges concurrently */
+    gboolean random_access;
+
     OpenedAudioFile *(*open_file)(const FormatModule *self, const char *filename, char **error_message);
     void (*close_file)(const FormatModule *self, OpenedAudioFile *file);
 
+    /* Optional: open another independent handle (own decoder state) for the
+     * same file, reusing what open_file() found out; default is open_file() */
+    OpenedAudioFile *(*reopen_file)(OpenedAudioFile *self, char **error_message);
+
+    /* Optional: up to *len bytes of sample data at start_pos (in the same
+     * layout as read_samples()) straight from the file mapping; returns NULL
+     * if the file is not mapped, otherwise sets *len to the available bytes */
+    const unsigned char *(*map_samples)(OpenedAudioFile *self, unsigned long start_pos, size_t *len, enum FormatAccess access);
+
     long (*read_samples)(OpenedAudioFile *self, unsigned char *buf, size_t buf_size, unsigned long start_pos);
-    int (*write_file)(OpenedAudioFile *self, const char *output_filename, unsigned long start_pos, unsigned long end_pos, report_progress_func report_progress, void *report_progress_user_data);
+    int (*write_file)(OpenedAudioFile *self, const char *output_filename, unsigned long start_pos, unsigned long end_pos, enum FormatWritePolicy write_policy, report_progress_func report_progress, void *report_progress_user_data);
+
+    /* Optional: write all tracks in one front-to-back pass over the source,
+     * for formats whose write_file() has to scan the file (see format_write_tracks()) */
+    void (*write_tracks)(OpenedAudioFile *self, FormatTrack *tracks, size_t num_tracks);
 };
 
 typedef const FormatModule *(*format_module_load_func)(void);
@@ -55,17 +100,92 @@ struct OpenedAudioFile_ {
     SampleInfo sample_info;
     char *details;
     uint64_t file_size;
+    GMappedFile *mapped; /* NULL if the file could not be mapped */
+    int open_flags;      /* as passed to format_open_file(), kept for reopening */
+#if defined(G_OS_WIN32)
+    GMutex read_mutex;
+#endif
 };
 
 gboolean
 format_module_filename_extension_check(const FormatModule *self, const char *filename, const char *extension);
 
+/**
+ * An output file being written by a format module. Data may be written
+ * through fp, followed by format_output_written(); the page cache is
+ * managed according to the write policy it was opened with.
+ **/
+typedef struct FormatOutput_ FormatOutput;
+struct FormatOutput_ {
+    FILE *fp;
+    enum FormatWritePolicy policy;
+
+    uint64_t written_back; /* writeback started for everything before */
+    uint64_t dropped;      /* written back and dropped from the page cache */
+};
+
+/**
+ * Create (or truncate) filename for writing. If size_hint is not 0, the
+ * blocks for that many bytes are allocated up front (without changing the
+ * file size), so the file system can lay out the file in one piece.
+ * Returns NULL on error.
+ **/
+FormatOutput *
+format_output_open(const char *filename, uint64_t size_hint, enum FormatWritePolicy policy);
+
+/* To be called after writing through out->fp, hands full extents to writeback */
+void
+format_output_written(FormatOutput *out);
+
+/* Flush, write back (depending on the policy) and close; returns 0 or -1 on error */
+int
+format_output_close(FormatOutput *out);
+
 gboolean
 format_module_open_file(const FormatModule *self, OpenedAudioFile *file, const char *filename, char **error_message);
 
 void
 opened_audio_file_close(OpenedAudioFile *file);
 
+/**
+ * Read up to len bytes at offset of the file without using the FILE
+ * position, so that several threads (analysis, playback, export) can read
+ * from the same OpenedAudioFile concurrently. Returns the number of bytes
+ * read (short only at the end of the file) or -1 on error.
+ **/
+long
+format_module_read_at(OpenedAudioFile *file, void *buf, size_t len, uint64_t offset);
+
+/**
+ * Copy len bytes at offset of the file to out (after anything already
+ * written to it) in large extents,
+ * calling report_progress after each. The data is moved inside the kernel
+ * with copy_file_range() (or sendfile()) where supported, else written from
+ * the mapping or a large buffer; with FORMAT_WRITE_POLICY_DIRECT, it is
+ * written with O_DIRECT from an aligned buffer if the file system allows.
+ * Returns FALSE on error or if aborted.
+ **/
+gboolean
+format_module_copy_to_file(OpenedAudioFile *file, uint64_t offset, uint64_t len, FormatOutput *out,
+                           report_progress_func report_progress, void *report_progress_user_data);
+
+/**
+ * Map the whole file read-only, format_module_read_at() then copies from
+ * the mapping. Called by format_open_file() for random_access modules
+ * (unless FORMAT_OPEN_NO_MMAP is given). Returns FALSE if the file cannot
+ * be mapped, reads fall back to pread() in that case.
+ **/
+gboolean
+format_module_map_file(OpenedAudioFile *file);
+
+/**
+ * Pointer to len bytes at offset into the mapping, after passing the access
+ * hint for that range to the kernel. Returns NULL if the file is not mapped
+ * or the range is outside of it.
+ **/
+const unsigned char *
+format_module_map_range(OpenedAudioFile *file, uint64_t offset, size_t len, enum FormatAccess access);
+
 
 /* Public API */
 
@@ -75,17 +195,51 @@ format_init(void);
 void
 format_print_supported(void);
 
+/* Configuration name of a policy ("cache", "throughput", "direct") and back, -1 if unknown */
+int
+format_write_policy_from_name(const char *name);
+
+const char *
+format_write_policy_get_name(enum FormatWritePolicy policy);
+
+enum FormatOpenFlags {
+    FORMAT_OPEN_DEFAULT = 0,
+    FORMAT_OPEN_NO_MMAP = 1 << 0, /* read with pread(), even if the file could be mapped */
+};
+
+/* flags: a combination of FormatOpenFlags */
 OpenedAudioFile *
-format_open_file(const char *filename, char **error_message);
+format_open_file(const char *filename, int flags, char **error_message);
 
 void
 format_print_file_info(OpenedAudioFile *file);
 
+OpenedAudioFile *
+format_reopen_file(OpenedAudioFile *file, char **error_message);
+
 void
 format_close_file(OpenedAudioFile *file);
 
 long
 format_read_samples(OpenedAudioFile *file, unsigned char *buf, size_t buf_size, unsigned long start_pos);
 
+/**
+ * Zero-copy alternative to format_read_samples(): returns a pointer to at
+ * most *len bytes of sample data and updates *len, or NULL if the format or
+ * file does not support it (use format_read_samples() then). The pointer
+ * stays valid until the file is closed.
+ **/
+const unsigned char *
+format_map_samples(OpenedAudioFile *file, unsigned long start_pos, size_t *len, enum FormatAccess access);
+
 int
-format_write_file(OpenedAudioFile *file, const char *output_filename, unsigned long start_pos, unsigned long end_pos, report_progress_func report_progress, void *report_progress_user_data);
+format_write_file(OpenedAudioFile *file, const char *output_filename, unsigned long start_pos, unsigned long end_pos, enum FormatWritePolicy write_policy, report_progress_func report_progress, void *report_progress_user_data);
+
+/**
+ * Write tracks (sorted by start_pos, not overlapping, gaps are skipped) reading
+ * the source once, sequentially and never seeking backwards; each track is
+ * started after the previous one is finished. If report_progress returns
+ * FALSE, that and all remaining tracks fail.
+ **/
+void
+format_write_tracks(OpenedAudioFile *file, FormatTrack *tracks, size_t num_tracks);
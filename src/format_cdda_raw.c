@@ -95,18 +95,14 @@ cdda_raw_read_samples(OpenedAudioFile *self, unsigned char *buf, size_t buf_size
 {
     OpenedCDDAFile *cdda = (OpenedCDDAFile *)self;
 
-    size_t i = 0;
-    size_t ret;
-
-    if (fseek(cdda->hdr.fp, start_pos, SEEK_SET)) {
-        return -1;
-    }
+    long i = 0;
+    long ret;
 
     if (start_pos > cdda->file_size) {
         return -1;
     }
 
-    ret = fread(buf, 1, buf_size, cdda->hdr.fp);
+    ret = format_module_read_at(&cdda->hdr, buf, buf_size, start_pos);
 
 #if G_BYTE_ORDER == G_LITTLE_ENDIAN
     for (i = 0; i < ret / 4; i++) {
@@ -128,69 +124,43 @@ cdda_raw_read_samples(OpenedAudioFile *self, unsigned char *buf, size_t buf_size
 }
 
 int
-cdda_raw_write_file(OpenedAudioFile *self, const char *output_filename, unsigned long start_pos, unsigned long end_pos, report_progress_func report_progress, void *report_progress_user_data)
+cdda_raw_write_file(OpenedAudioFile *self, const char *output_filename, unsigned long start_pos, unsigned long end_pos, enum FormatWritePolicy write_policy, report_progress_func report_progress, void *report_progress_user_data)
 {
     OpenedCDDAFile *cdda = (OpenedCDDAFile *)self;
 
-    int buf_size = cdda->hdr.sample_info.blockSize;
-
-    size_t ret;
-    FILE *new_fp;
-    unsigned long cur_pos;
-    unsigned char buf[buf_size];
+    FormatOutput *out;
 
-    if (end_pos == 0) {
-        if (fseek(cdda->hdr.fp, 0, SEEK_END)) {
-            return -1;
-        }
-
-        end_pos = ftell(cdda->hdr.fp);
+    if (end_pos == 0 || end_pos > cdda->file_size) {
+        end_pos = cdda->file_size;
     }
 
-    if ((new_fp = fopen(output_filename, "wb")) == NULL) {
-        g_warning("Error opening %s for writing", output_filename);
+    if (start_pos > end_pos) {
         return -1;
     }
 
-    cur_pos = start_pos;
-
-    if (fseek(cdda->hdr.fp, cur_pos, SEEK_SET)) {
-        fclose(new_fp);
+    if ((out = format_output_open(output_filename, end_pos - start_pos, write_policy)) == NULL) {
+        g_warning("Error opening %s for writing", output_filename);
         return -1;
     }
 
     report_progress(0.0, report_progress_user_data);
 
-    if (cur_pos > cdda->file_size) {
-        fclose(new_fp);
+    // Raw data is copied as-is, there is no header
+    if (!format_module_copy_to_file(&cdda->hdr, start_pos, end_pos - start_pos, out,
+                                    report_progress, report_progress_user_data)) {
+        g_warning("Error writing to file %s", output_filename);
+        format_output_close(out);
         return -1;
     }
 
-    if (cur_pos + buf_size > end_pos) {
-        buf_size = end_pos - cur_pos;
-    }
-
-    while ((ret = fread(buf, 1, buf_size, cdda->hdr.fp)) > 0 &&
-            cur_pos < end_pos) {
-
-        if ((fwrite(buf, 1, ret, new_fp)) < ret) {
-            g_warning("Error writing to file %s", output_filename);
-            fclose(new_fp);
-            return -1;
-        }
-        cur_pos += ret;
-
-        report_progress((double)(cur_pos - start_pos) / (double)(end_pos - start_pos), report_progress_user_data);
-
-        if (cur_pos + buf_size > end_pos) {
-            buf_size = end_pos - cur_pos;
-        }
+    if (format_output_close(out) != 0) {
+        g_warning("Error writing to file %s", output_filename);
+        return -1;
     }
 
     report_progress(1.0, report_progress_user_data);
 
-    fclose(new_fp);
-    return ret;
+    return 0;
 }
 
 static const FormatModule
@@ -198,6 +168,7 @@ CDDA_RAW_FORMAT_MODULE = {
     .name = "CD Digital Audio (Big-Endian)",
     .library_name = "built-in",
     .default_file_extension = ".cdda.raw",
+    .random_access = TRUE,
 
     .open_file = cdda_raw_open_file,
     .close_file = cdda_raw_close_file,
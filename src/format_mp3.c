@@ -26,16 +26,80 @@
 //#define WAVBREAKER_MP3_DEBUG
 
 #include <stdint.h>
+#include <inttypes.h>
 #include <mpg123.h>
 
+#define MP3_INDEX_READ_SIZE (1024 * 1024)
+
+typedef struct MP3Frame_ MP3Frame;
+struct MP3Frame_ {
+    uint64_t offset;
+    uint64_t sample_position;
+    uint32_t size;
+    uint32_t samples;
+};
+
+/**
+ * Offsets, sizes and cumulative sample positions of all frames, built on
+ * the first export and shared by all handles of the same file. The seek
+ * index of mpg123 is copied once when the file is opened, so reopened
+ * handles never touch the decoder of another thread.
+ **/
+typedef struct MP3FrameIndex_ MP3FrameIndex;
+struct MP3FrameIndex_ {
+    gint ref_count;
+
+    GMutex mutex;
+    gboolean built;
+
+    MP3Frame *frames;
+    size_t num_frames;
+
+    off_t *seek_offsets;
+    off_t seek_step;
+    size_t seek_fill;
+};
+
 typedef struct OpenedMP3File_ OpenedMP3File;
 struct OpenedMP3File_ {
     OpenedAudioFile hdr;
 
     mpg123_handle *mpg123;
     size_t mpg123_offset;
+
+    MP3FrameIndex *frame_index;
 };
 
+static MP3FrameIndex *
+mp3_frame_index_new(void)
+{
+    MP3FrameIndex *index = g_new0(MP3FrameIndex, 1);
+
+    index->ref_count = 1;
+    g_mutex_init(&index->mutex);
+
+    return index;
+}
+
+static MP3FrameIndex *
+mp3_frame_index_ref(MP3FrameIndex *index)
+{
+    g_atomic_int_inc(&index->ref_count);
+
+    return index;
+}
+
+static void
+mp3_frame_index_unref(MP3FrameIndex *index)
+{
+    if (g_atomic_int_dec_and_test(&index->ref_count)) {
+        g_mutex_clear(&index->mutex);
+        g_free(index->frames);
+        g_free(index->seek_offsets);
+        g_free(index);
+    }
+}
+
 static long
 mp3_read_samples(OpenedAudioFile *self, unsigned char *buf, size_t buf_size, unsigned long start_pos)
 {
@@ -50,7 +114,9 @@ retry:
         mp3->mpg123_offset = start_pos;
     }
 
-    if (mpg123_read(mp3->mpg123, buf, buf_size, &result) == MPG123_OK) {
+    int err = mpg123_read(mp3->mpg123, buf, buf_size, &result);
+    if (err == MPG123_OK || err == MPG123_DONE) {
+        // With large reads, the final chunk is returned together with MPG123_DONE
         mp3->mpg123_offset += result;
         return result;
     } else {
@@ -76,25 +142,43 @@ mp3_parse_header(uint32_t header, uint32_t *bitrate, uint32_t *frequency, uint32
     int f = ((header >> 10) & 0x0003);
     int g = ((header >> 9) & 0x0001);
 
+    static const int BITRATES_V1_L1[] = { -1, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, -1 };
     static const int BITRATES_V1_L2[] = { -1, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, -1 };
     static const int BITRATES_V1_L3[] = { -1, 32, 40, 48, 56, 64, 80,  96, 112, 128, 160, 192, 224, 256, 320, -1 };
+    static const int BITRATES_V2_L1[] = { -1, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, -1 };
+    static const int BITRATES_V2_L23[] = { -1, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, -1 };
     static const int FREQUENCIES[] = { 44100, 48000, 32000, 0 };
 
+    static const int MPEG_1 = 0x3;    /* 0b11 */
+    static const int MPEG_2 = 0x2;    /* 0b10, 0b00 is MPEG 2.5 */
+    static const int LAYER_I = 0x3;   /* 0b11 */
     static const int LAYER_II = 0x2;  /* 0b10 */
     static const int LAYER_III = 0x1; /* 0b01 */
 
     if (a != 0x7ff /* sync */ ||
-            b != 0x3 /* MPEG1 */ ||
-            (c != LAYER_II && c != LAYER_III) ||
+            b == 0x1 /* reserved version */ ||
+            c == 0x0 /* reserved layer */ ||
             e == 0x0 /* freeform bitrate */ || e == 0xf /* invalid bitrate */ ||
             f == 0x3 /* invalid frequency */) {
         return FALSE;
     }
 
-    *bitrate = (c == LAYER_III) ? BITRATES_V1_L3[e] : BITRATES_V1_L2[e];
-    *frequency = FREQUENCIES[f];
-    *samples = 1152;
-    *framesize = (int)((*samples) / 8 * 1000 * (*bitrate) / (*frequency)) + g /* padding */;
+    if (b == MPEG_1) {
+        *bitrate = (c == LAYER_III) ? BITRATES_V1_L3[e] : (c == LAYER_II) ? BITRATES_V1_L2[e] : BITRATES_V1_L1[e];
+        *frequency = FREQUENCIES[f];
+    } else {
+        *bitrate = (c == LAYER_I) ? BITRATES_V2_L1[e] : BITRATES_V2_L23[e];
+        *frequency = FREQUENCIES[f] / ((b == MPEG_2) ? 2 : 4);
+    }
+
+    if (c == LAYER_I) {
+        *samples = 384;
+        *framesize = ((int)(12 * 1000 * (*bitrate) / (*frequency)) + g /* padding */) * 4;
+    } else {
+        // MPEG 2 and 2.5 Layer III frames have half the samples of MPEG 1 ones
+        *samples = (c == LAYER_III && b != MPEG_1) ? 576 : 1152;
+        *framesize = (int)((*samples) / 8 * 1000 * (*bitrate) / (*frequency)) + g /* padding */;
+    }
 
 #if defined(WAVBREAKER_MP3_DEBUG)
     static const char *VERSIONS[] = { "MPEG 2.5", NULL, "MPEG 2", "MPEG 1" };
@@ -110,107 +194,446 @@ mp3_parse_header(uint32_t header, uint32_t *bitrate, uint32_t *frequency, uint32
     return TRUE;
 }
 
-int
-mp3_write_file(OpenedAudioFile *self, const char *output_filename, unsigned long start_pos, unsigned long end_pos, report_progress_func report_progress, void *report_progress_user_data)
+static uint64_t
+mp3_skip_id3v2_tag(OpenedMP3File *mp3)
 {
-    OpenedMP3File *mp3 = (OpenedMP3File *)self;
+    unsigned char tag[10];
 
-    start_pos /= mp3->hdr.sample_info.blockSize;
-    end_pos /= mp3->hdr.sample_info.blockSize;
+    if (format_module_read_at(&mp3->hdr, tag, sizeof(tag), 0) != sizeof(tag) || memcmp(tag, "ID3", 3) != 0 ||
+            ((tag[6] | tag[7] | tag[8] | tag[9]) & 0x80) != 0) {
+        return 0;
+    }
 
-    uint32_t start_samples = start_pos * mp3->hdr.sample_info.samplesPerSec / CD_BLOCKS_PER_SEC;
-    uint32_t end_samples = end_pos * mp3->hdr.sample_info.samplesPerSec / CD_BLOCKS_PER_SEC;
+    // Synchsafe size of the tag excluding the header (and footer, if flagged)
+    uint64_t size = ((uint64_t)tag[6] << 21) | (tag[7] << 14) | (tag[8] << 7) | tag[9];
 
-    if (end_samples == 0) {
-        end_samples = mp3->hdr.sample_info.numBytes / mp3->hdr.sample_info.blockAlign;
-    }
+    return sizeof(tag) + size + ((tag[5] & 0x10) ? sizeof(tag) : 0);
+}
 
-    FILE *output_file = fopen(output_filename, "wb");
+/**
+ * Sequential frame scanner: at each offset that does not start a frame, move
+ * on by one byte, after a frame continue right behind it. The file is read
+ * front to back in MP3_INDEX_READ_SIZE chunks, never seeking backwards.
+ **/
+typedef struct MP3Scanner_ MP3Scanner;
+struct MP3Scanner_ {
+    OpenedMP3File *mp3;
+
+    unsigned char *buf;
+    uint64_t buf_offset;
+    size_t buf_len;
+
+    uint64_t file_offset;
+    uint64_t last_frame_end;
+    uint64_t sample_position;
+};
 
-    if (!output_file) {
-        g_warning("Could not open '%s' for writing", output_filename);
-        return -1;
-    }
+static void
+mp3_scanner_init(MP3Scanner *scanner, OpenedMP3File *mp3)
+{
+    memset(scanner, 0, sizeof(*scanner));
 
-    fseek(mp3->hdr.fp, 0, SEEK_SET);
+    scanner->mp3 = mp3;
+    scanner->buf = g_malloc(MP3_INDEX_READ_SIZE);
+    scanner->file_offset = scanner->last_frame_end = mp3_skip_id3v2_tag(mp3);
+}
 
-    report_progress(0.0, report_progress_user_data);
+static void
+mp3_scanner_clear(MP3Scanner *scanner)
+{
+    g_free(scanner->buf);
+}
 
-    uint32_t header = 0x00000000;
-    uint32_t sample_position = 0;
-    uint32_t file_offset = 0;
-    uint32_t last_frame_end = 0;
-    uint32_t frames_written = 0;
+/* Pointer to len bytes at offset (not before the previous one), NULL at the end of the file */
+static const unsigned char *
+mp3_scanner_get(MP3Scanner *scanner, uint64_t offset, size_t len)
+{
+    uint64_t buf_end = scanner->buf_offset + scanner->buf_len;
 
-    while (!feof(mp3->hdr.fp)) {
-        fseek(mp3->hdr.fp, file_offset, SEEK_SET);
+    if (offset + len > buf_end) {
+        // Keep what is left of the buffer and append the following data
+        size_t keep = (offset < buf_end) ? buf_end - offset : 0;
+        memmove(scanner->buf, scanner->buf + (offset - scanner->buf_offset), keep);
+
+        scanner->buf_offset = offset;
+        scanner->buf_len = keep;
+
+        long ret = format_module_read_at(&scanner->mp3->hdr, scanner->buf + keep, MP3_INDEX_READ_SIZE - keep, offset + keep);
+        if (ret > 0) {
+            scanner->buf_len += ret;
+        }
 
-        int a = fgetc(mp3->hdr.fp);
-        if (a == EOF) {
-            break;
+        if (offset + len > scanner->buf_offset + scanner->buf_len) {
+            return NULL;
         }
+    }
+
+    return scanner->buf + (offset - scanner->buf_offset);
+}
 
-        header = ((header & 0xffffff) << 8) | (a & 0xff);
+/* Find the next frame, returns FALSE at the end of the file (a truncated last frame is ignored) */
+static gboolean
+mp3_scanner_next(MP3Scanner *scanner, MP3Frame *frame, const unsigned char **data)
+{
+    const unsigned char *p;
+
+    while ((p = mp3_scanner_get(scanner, scanner->file_offset, 4)) != NULL) {
+        uint32_t header = ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
 
         uint32_t bitrate = 0;
         uint32_t frequency = 0;
         uint32_t samples = 0;
         uint32_t framesize = 0;
 
-        if (mp3_parse_header(header, &bitrate, &frequency, &samples, &framesize)) {
-            uint32_t frame_start = file_offset - 3;
+        if (!mp3_parse_header(header, &bitrate, &frequency, &samples, &framesize)) {
+            scanner->file_offset++;
+            continue;
+        }
 
-            if (last_frame_end < frame_start) {
-                g_warning("Skipped non-frame data in MP3 @ 0x%08x (%d bytes)",
-                        last_frame_end, frame_start - last_frame_end);
-            }
+        if ((p = mp3_scanner_get(scanner, scanner->file_offset, framesize)) == NULL) {
+            g_warning("Truncated MP3 frame @ 0x%08" PRIx64, scanner->file_offset);
+            return FALSE;
+        }
 
-            if (start_samples <= sample_position) {
-                // Write this frame to the output file
-                char *buf = malloc(framesize);
-                fseek(mp3->hdr.fp, frame_start, SEEK_SET);
-                if (fread(buf, 1, framesize, mp3->hdr.fp) != framesize) {
-                    g_warning("Tried to read over the end of the input file");
-                    break;
-                }
-                if (fwrite(buf, 1, framesize, output_file) != framesize) {
-                    g_warning("Failed to write %d bytes to output file", framesize);
-                    break;
-                }
-                free(buf);
-
-                frames_written++;
-
-                report_progress((double)(sample_position - start_samples) / (double)(end_samples - start_samples), report_progress_user_data);
-
-                if (end_samples <= sample_position + samples) {
-                    // Done writing this part
-                    break;
-                }
-            }
+        if (scanner->last_frame_end < scanner->file_offset) {
+            g_warning("Skipped non-frame data in MP3 @ 0x%08" PRIx64 " (%" PRIu64 " bytes)",
+                    scanner->last_frame_end, scanner->file_offset - scanner->last_frame_end);
+        }
+
+        *frame = (MP3Frame) {
+            .offset = scanner->file_offset,
+            .sample_position = scanner->sample_position,
+            .size = framesize,
+            .samples = samples,
+        };
+
+        if (data != NULL) {
+            *data = p;
+        }
 
-            sample_position += samples;
+        scanner->sample_position += samples;
+        scanner->file_offset += framesize;
+        scanner->last_frame_end = scanner->file_offset;
 
-            file_offset = frame_start + framesize;
-            last_frame_end = file_offset;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void
+mp3_frame_index_build(OpenedMP3File *mp3, MP3FrameIndex *index)
+{
+    size_t allocated = 1024;
+    index->frames = g_new(MP3Frame, allocated);
+    index->num_frames = 0;
+
+    MP3Scanner scanner;
+    mp3_scanner_init(&scanner, mp3);
+
+    MP3Frame frame;
+    while (mp3_scanner_next(&scanner, &frame, NULL)) {
+        if (index->num_frames == allocated) {
+            allocated *= 2;
+            index->frames = g_renew(MP3Frame, index->frames, allocated);
+        }
+
+        index->frames[index->num_frames++] = frame;
+    }
+
+    mp3_scanner_clear(&scanner);
+
+    g_debug("Indexed %zu MP3 frames (%" PRIu64 " samples) in '%s'",
+            index->num_frames, scanner.sample_position, mp3->hdr.filename);
+}
+
+static const MP3FrameIndex *
+mp3_get_frame_index(OpenedMP3File *mp3)
+{
+    MP3FrameIndex *index = mp3->frame_index;
+
+    g_mutex_lock(&index->mutex);
+
+    if (!index->built) {
+        mp3_frame_index_build(mp3, index);
+        index->built = TRUE;
+    }
+
+    g_mutex_unlock(&index->mutex);
+
+    return index;
+}
+
+/* First frame (or num_frames) whose last sample is at or after sample_position */
+static size_t
+mp3_frame_index_find_end(const MP3FrameIndex *index, uint64_t sample_position)
+{
+    size_t lo = 0;
+    size_t hi = index->num_frames;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const MP3Frame *frame = &index->frames[mid];
+
+        if (frame->sample_position + frame->samples < sample_position) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* First frame (or num_frames) starting at or after sample_position */
+static size_t
+mp3_frame_index_find_start(const MP3FrameIndex *index, uint64_t sample_position)
+{
+    size_t lo = 0;
+    size_t hi = index->num_frames;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
 
-            header = 0x00000000;
+        if (index->frames[mid].sample_position < sample_position) {
+            lo = mid + 1;
         } else {
-            file_offset++;
+            hi = mid;
         }
     }
 
+    return lo;
+}
+
+struct MP3CopyProgress {
+    report_progress_func report_progress;
+    void *report_progress_user_data;
+
+    uint64_t done;
+    uint64_t run;
+    uint64_t total;
+};
+
+static gboolean
+mp3_copy_progress(double progress, void *user_data)
+{
+    struct MP3CopyProgress *copy = user_data;
+
+    return copy->report_progress((copy->done + progress * copy->run) / (double)copy->total,
+                                 copy->report_progress_user_data);
+}
+
+/* Frames are cut at CD block boundaries of the decoded samples */
+static void
+mp3_get_sample_range(OpenedMP3File *mp3, unsigned long start_pos, unsigned long end_pos, uint64_t *start_samples, uint64_t *end_samples)
+{
+    const SampleInfo *si = &mp3->hdr.sample_info;
+
+    *start_samples = (uint64_t)(start_pos / si->blockSize) * si->samplesPerSec / CD_BLOCKS_PER_SEC;
+    *end_samples = (uint64_t)(end_pos / si->blockSize) * si->samplesPerSec / CD_BLOCKS_PER_SEC;
+
+    if (*end_samples == 0) {
+        *end_samples = si->numBytes / si->blockAlign;
+    }
+}
+
+int
+mp3_write_file(OpenedAudioFile *self, const char *output_filename, unsigned long start_pos, unsigned long end_pos, enum FormatWritePolicy write_policy, report_progress_func report_progress, void *report_progress_user_data)
+{
+    OpenedMP3File *mp3 = (OpenedMP3File *)self;
+
+    uint64_t start_samples;
+    uint64_t end_samples;
+    mp3_get_sample_range(mp3, start_pos, end_pos, &start_samples, &end_samples);
+
+    const MP3FrameIndex *index = mp3_get_frame_index(mp3);
+
+    // All frames starting at start_samples, up to and including the one containing end_samples
+    size_t first = mp3_frame_index_find_start(index, start_samples);
+    size_t last = MAX(first, mp3_frame_index_find_end(index, end_samples));
+    size_t end = MIN(last + 1, index->num_frames);
+
+    struct MP3CopyProgress copy = {
+        .report_progress = report_progress,
+        .report_progress_user_data = report_progress_user_data,
+        .done = 0,
+        .run = 0,
+        .total = 0,
+    };
+
+    if (first < end) {
+        copy.total = index->frames[end - 1].offset + index->frames[end - 1].size - index->frames[first].offset;
+    }
+
+    // At most copy.total bytes, less if there is non-frame data in between
+    FormatOutput *out = format_output_open(output_filename, copy.total, write_policy);
+
+    if (!out) {
+        g_warning("Could not open '%s' for writing", output_filename);
+        return -1;
+    }
+
+    report_progress(0.0, report_progress_user_data);
+
+    // Frames are copied in runs, leaving out any non-frame data between them
+    size_t i = first;
+    while (i < end) {
+        size_t j = i + 1;
+        while (j < end && index->frames[j].offset == index->frames[j - 1].offset + index->frames[j - 1].size) {
+            j++;
+        }
+
+        copy.run = index->frames[j - 1].offset + index->frames[j - 1].size - index->frames[i].offset;
+
+        if (!format_module_copy_to_file(&mp3->hdr, index->frames[i].offset, copy.run, out,
+                                        mp3_copy_progress, &copy)) {
+            format_output_close(out);
+            return -1;
+        }
+
+        copy.done += copy.run;
+        i = j;
+    }
+
+    if (format_output_close(out) != 0) {
+        g_warning("Error writing to file %s", output_filename);
+        return -1;
+    }
+
     report_progress(1.0, report_progress_user_data);
 
 #if defined(WAVBREAKER_MP3_DEBUG)
-    g_debug("Wrote %d MP3 frames from '%s' to '%s'", frames_written, sample_file, output_filename);
+    g_debug("Wrote %zu MP3 frames from '%s' to '%s'", end - first, mp3->hdr.filename, output_filename);
 #endif /* WAVBREAKER_MP3_DEBUG */
 
-    fclose(output_file);
-
     return 0;
 }
 
+struct MP3Track {
+    FormatTrack *track;
+
+    uint64_t start_samples;
+    uint64_t end_samples;
+
+    FormatOutput *out;
+    gboolean finished;
+};
+
+static void
+mp3_track_finish(struct MP3Track *t, int result)
+{
+    if (t->out != NULL && format_output_close(g_steal_pointer(&t->out)) != 0 && result == 0) {
+        g_warning("Error writing to file %s", t->track->filename);
+        result = -1;
+    }
+
+    t->track->result = result;
+    t->finished = TRUE;
+
+    if (result == 0) {
+        t->track->report_progress(1.0, t->track->report_progress_user_data);
+    }
+}
+
+/* Returns FALSE if writing was aborted */
+static gboolean
+mp3_track_write_frame(struct MP3Track *t, const MP3Frame *frame, const unsigned char *data)
+{
+    FormatTrack *track = t->track;
+
+    if (t->out == NULL) {
+        // The size is not known without the frame index
+        if ((t->out = format_output_open(track->filename, 0, track->write_policy)) == NULL) {
+            g_warning("Could not open '%s' for writing", track->filename);
+            mp3_track_finish(t, -1);
+            return TRUE;
+        }
+
+        if (!track->report_progress(0.0, track->report_progress_user_data)) {
+            return FALSE;
+        }
+    }
+
+    if (fwrite(data, 1, frame->size, t->out->fp) != frame->size) {
+        g_warning("Failed to write %d bytes to output file", frame->size);
+        mp3_track_finish(t, -1);
+        return TRUE;
+    }
+
+    format_output_written(t->out);
+
+    if (t->end_samples <= frame->sample_position + frame->samples) {
+        mp3_track_finish(t, 0);
+    } else if (!track->report_progress((double)(frame->sample_position - t->start_samples) /
+                                       (double)(t->end_samples - t->start_samples), track->report_progress_user_data)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Scan the file once and route each frame to the tracks that include it
+ * (with the same selection as mp3_write_file()), without the frame index.
+ **/
+static void
+mp3_write_tracks(OpenedAudioFile *self, FormatTrack *tracks, size_t num_tracks)
+{
+    OpenedMP3File *mp3 = (OpenedMP3File *)self;
+
+    struct MP3Track *ts = g_new0(struct MP3Track, num_tracks);
+
+    for (size_t i=0; i<num_tracks; ++i) {
+        ts[i].track = &tracks[i];
+        mp3_get_sample_range(mp3, tracks[i].start_pos, tracks[i].end_pos, &ts[i].start_samples, &ts[i].end_samples);
+    }
+
+    MP3Scanner scanner;
+    mp3_scanner_init(&scanner, mp3);
+
+    size_t current = 0;
+    gboolean aborted = FALSE;
+
+    MP3Frame frame;
+    const unsigned char *data;
+
+    while (!aborted && current < num_tracks && mp3_scanner_next(&scanner, &frame, &data)) {
+        for (size_t i=current; i<num_tracks && ts[i].start_samples <= frame.sample_position; ++i) {
+            if (!ts[i].finished && !mp3_track_write_frame(&ts[i], &frame, data)) {
+                aborted = TRUE;
+                break;
+            }
+        }
+
+        while (current < num_tracks && ts[current].finished) {
+            current++;
+        }
+    }
+
+    mp3_scanner_clear(&scanner);
+
+    for (size_t i=current; i<num_tracks; ++i) {
+        if (ts[i].finished) {
+            continue;
+        }
+
+        if (aborted) {
+            mp3_track_finish(&ts[i], -1);
+        } else {
+            // Reached the end of the file (as mp3_write_file(), possibly with no frames at all)
+            if (ts[i].out == NULL && (ts[i].out = format_output_open(tracks[i].filename, 0, tracks[i].write_policy)) == NULL) {
+                g_warning("Could not open '%s' for writing", tracks[i].filename);
+                mp3_track_finish(&ts[i], -1);
+                continue;
+            }
+
+            mp3_track_finish(&ts[i], 0);
+        }
+    }
+
+    g_free(ts);
+}
+
 static void
 mp3_close_file(const FormatModule *self, OpenedAudioFile *file)
 {
@@ -218,9 +641,28 @@ mp3_close_file(const FormatModule *self, OpenedAudioFile *file)
 
     opened_audio_file_close(&mp3->hdr);
     mpg123_close(g_steal_pointer(&mp3->mpg123));
+    if (mp3->frame_index != NULL) {
+        mp3_frame_index_unref(g_steal_pointer(&mp3->frame_index));
+    }
     g_free(mp3);
 }
 
+static gboolean
+mp3_set_output_format(OpenedMP3File *mp3, char **error_message)
+{
+    SampleInfo *si = &mp3->hdr.sample_info;
+
+    mpg123_format_none(mp3->mpg123);
+    if (mpg123_format(mp3->mpg123, si->samplesPerSec,
+                      (si->channels == 1) ? MPG123_STEREO : MPG123_MONO,
+                      MPG123_ENC_SIGNED_16) != MPG123_OK) {
+        format_module_set_error_message(error_message, "Failed to set mpg123 format");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 static OpenedAudioFile *
 mp3_open_file(const FormatModule *self, const char *filename, char **error_message)
 {
@@ -241,6 +683,7 @@ mp3_open_file(const FormatModule *self, const char *filename, char **error_messa
     SampleInfo *si = &mp3->hdr.sample_info;
 
     mp3->mpg123_offset = 0;
+    mp3->frame_index = mp3_frame_index_new();
 
     if ((mp3->mpg123 = mpg123_new(NULL, NULL)) == NULL) {
         format_module_set_error_message(error_message, "Failed to create MP3 decoder");
@@ -264,6 +707,16 @@ mp3_open_file(const FormatModule *self, const char *filename, char **error_messa
             goto error;
         }
 
+        // Keep a copy of the seek index for mp3_reopen_file()
+        MP3FrameIndex *index = mp3->frame_index;
+        off_t *offsets = NULL;
+        if (mpg123_index(mp3->mpg123, &offsets, &index->seek_step, &index->seek_fill) != MPG123_OK) {
+            format_module_set_error_message(error_message, "Could not get MP3 seek index");
+            goto error;
+        }
+        index->seek_offsets = g_new(off_t, MAX(index->seek_fill, 1));
+        memcpy(index->seek_offsets, offsets, index->seek_fill * sizeof(off_t));
+
         struct mpg123_frameinfo fi;
         memset(&fi, 0, sizeof(fi));
 
@@ -305,11 +758,7 @@ mp3_open_file(const FormatModule *self, const char *filename, char **error_messa
 
             mp3->hdr.details = g_strdup_printf("MPEG-%s Layer %s, %s, %d kbps", mpeg_version, layer, mode, fi.bitrate);
 
-            mpg123_format_none(mp3->mpg123);
-            if (mpg123_format(mp3->mpg123, si->samplesPerSec,
-                              (si->channels == 1) ? MPG123_STEREO : MPG123_MONO,
-                              MPG123_ENC_SIGNED_16) != MPG123_OK) {
-                format_module_set_error_message(error_message, "Failed to set mpg123 format");
+            if (!mp3_set_output_format(mp3, error_message)) {
                 goto error;
             }
         }
@@ -326,6 +775,52 @@ error:
     return NULL;
 }
 
+static OpenedAudioFile *
+mp3_reopen_file(OpenedAudioFile *self, char **error_message)
+{
+    OpenedMP3File *orig = (OpenedMP3File *)self;
+
+    OpenedMP3File *mp3 = g_new0(OpenedMP3File, 1);
+
+    if (!format_module_open_file(self->mod, &mp3->hdr, self->filename, error_message)) {
+        g_free(mp3);
+        return NULL;
+    }
+
+    mp3->hdr.sample_info = self->sample_info;
+    mp3->hdr.details = g_strdup(self->details);
+    mp3->mpg123_offset = 0;
+    mp3->frame_index = mp3_frame_index_ref(orig->frame_index);
+
+    if ((mp3->mpg123 = mpg123_new(NULL, NULL)) == NULL) {
+        format_module_set_error_message(error_message, "Failed to create MP3 decoder");
+        goto error;
+    }
+
+    if (mpg123_open(mp3->mpg123, mp3->hdr.filename) != MPG123_OK) {
+        format_module_set_error_message(error_message, "mpg123_open() failed");
+        goto error;
+    }
+
+    // Use the seek index copied at open time instead of running mpg123_scan() again
+    const MP3FrameIndex *index = mp3->frame_index;
+    if (mpg123_set_index(mp3->mpg123, index->seek_offsets, index->seek_step, index->seek_fill) != MPG123_OK) {
+        format_module_set_error_message(error_message, "Could not copy MP3 seek index");
+        goto error;
+    }
+
+    if (!mp3_set_output_format(mp3, error_message)) {
+        goto error;
+    }
+
+    return &mp3->hdr;
+
+error:
+    mp3_close_file(self->mod, &mp3->hdr);
+
+    return NULL;
+}
+
 static const FormatModule
 MP3_FORMAT_MODULE = {
     .name = "MPEG Audio Layer I/II/III",
@@ -334,9 +829,11 @@ MP3_FORMAT_MODULE = {
 
     .open_file = mp3_open_file,
     .close_file = mp3_close_file,
+    .reopen_file = mp3_reopen_file,
 
     .read_samples = mp3_read_samples,
     .write_file = mp3_write_file,
+    .write_tracks = mp3_write_tracks,
 };
 
 const FormatModule *
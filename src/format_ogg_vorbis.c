@@ -27,7 +27,43 @@
 
 #include <stdint.h>
 #include <inttypes.h>
+#include <string.h>
 
+#define OGG_READ_SIZE (64 * 1024)
+
+/* Vorbis streams start with the identification, comment and setup header */
+#define OGG_VORBIS_HEADERS 3
+
+typedef struct OGGPage_ OGGPage;
+struct OGGPage_ {
+    uint64_t offset;
+    ogg_int64_t granule;
+};
+
+/**
+ * Offsets and granule positions of all pages of the Vorbis stream that end
+ * a packet, and the header packets, built on the first export and shared
+ * by all handles of the same file. Only the first logical stream of a
+ * chained file is indexed.
+ **/
+typedef struct OGGPageIndex_ OGGPageIndex;
+struct OGGPageIndex_ {
+    gint ref_count;
+
+    GMutex mutex;
+    gboolean headers_built; /* headers and serial */
+    gboolean built;         /* pages */
+    gboolean valid;         /* TRUE if the Vorbis headers were found */
+
+    int serial;
+    vorbis_info info;
+    vorbis_comment comment;
+    ogg_packet headers[OGG_VORBIS_HEADERS];
+    uint64_t audio_offset;
+
+    OGGPage *pages;
+    size_t num_pages;
+};
 
 typedef struct OpenedOGGVorbisFile_ OpenedOGGVorbisFile;
 struct OpenedOGGVorbisFile_ {
@@ -35,8 +71,48 @@ struct OpenedOGGVorbisFile_ {
 
     OggVorbis_File ogg_vorbis_file;
     size_t ogg_vorbis_offset;
+
+    OGGPageIndex *page_index;
 };
 
+static OGGPageIndex *
+ogg_page_index_new(void)
+{
+    OGGPageIndex *index = g_new0(OGGPageIndex, 1);
+
+    index->ref_count = 1;
+    g_mutex_init(&index->mutex);
+
+    vorbis_info_init(&index->info);
+    vorbis_comment_init(&index->comment);
+
+    return index;
+}
+
+static OGGPageIndex *
+ogg_page_index_ref(OGGPageIndex *index)
+{
+    g_atomic_int_inc(&index->ref_count);
+
+    return index;
+}
+
+static void
+ogg_page_index_unref(OGGPageIndex *index)
+{
+    if (g_atomic_int_dec_and_test(&index->ref_count)) {
+        for (int i=0; i<OGG_VORBIS_HEADERS; ++i) {
+            g_free(index->headers[i].packet);
+        }
+
+        vorbis_comment_clear(&index->comment);
+        vorbis_info_clear(&index->info);
+        g_mutex_clear(&index->mutex);
+        g_free(index->pages);
+        g_free(index);
+    }
+}
+
 static long
 ogg_vorbis_read_samples(OpenedAudioFile *self, unsigned char *buf, size_t buf_size, unsigned long start_pos)
 {
@@ -69,27 +145,630 @@ ogg_vorbis_read_samples(OpenedAudioFile *self, unsigned char *buf, size_t buf_si
     return result;
 }
 
+static void
+ogg_page_index_build(OpenedOGGVorbisFile *ogg, OGGPageIndex *index, gboolean headers_only)
+{
+    size_t allocated = 1024;
+
+    if (!headers_only) {
+        index->pages = g_new(OGGPage, allocated);
+        index->num_pages = 0;
+    }
+
+    ogg_sync_state oy;
+    ogg_stream_state os;
+    ogg_sync_init(&oy);
+
+    gboolean stream_inited = FALSE;
+    int num_headers = index->valid ? OGG_VORBIS_HEADERS : 0;
+
+    uint64_t read_offset = 0;
+    uint64_t page_offset = 0;
+
+    while (TRUE) {
+        ogg_page og;
+        long n = ogg_sync_pageseek(&oy, &og);
+
+        if (n < 0) {
+            // Skipped -n bytes that are not part of a page
+            page_offset += -n;
+            continue;
+        } else if (n == 0) {
+            char *buf = ogg_sync_buffer(&oy, OGG_READ_SIZE);
+            long ret = format_module_read_at(&ogg->hdr, buf, OGG_READ_SIZE, read_offset);
+            if (ret <= 0) {
+                break;
+            }
+
+            ogg_sync_wrote(&oy, ret);
+            read_offset += ret;
+            continue;
+        }
+
+        uint64_t offset = page_offset;
+        page_offset += n;
+
+        if (!stream_inited) {
+            index->serial = ogg_page_serialno(&og);
+            ogg_stream_init(&os, index->serial);
+            stream_inited = TRUE;
+        } else if (ogg_page_serialno(&og) != index->serial) {
+            continue;
+        }
+
+        if (num_headers < OGG_VORBIS_HEADERS) {
+            ogg_stream_pagein(&os, &og);
+
+            ogg_packet op;
+            while (num_headers < OGG_VORBIS_HEADERS && ogg_stream_packetout(&os, &op) == 1) {
+                if (vorbis_synthesis_headerin(&index->info, &index->comment, &op) != 0) {
+                    g_warning("Invalid Vorbis header packet in '%s'", ogg->hdr.filename);
+                    goto out;
+                }
+
+                index->headers[num_headers] = op;
+                index->headers[num_headers].packet = g_malloc(op.bytes);
+                memcpy(index->headers[num_headers].packet, op.packet, op.bytes);
+                ++num_headers;
+            }
+
+            // The setup header ends a page, audio data starts on the next one
+            index->audio_offset = page_offset;
+            index->valid = (num_headers == OGG_VORBIS_HEADERS);
+
+            if (index->valid && headers_only) {
+                break;
+            }
+            continue;
+        } else if (offset < index->audio_offset) {
+            // Headers already parsed in an earlier (headers_only) pass
+            continue;
+        }
+
+        if (ogg_page_granulepos(&og) != -1) {
+            if (index->num_pages == allocated) {
+                allocated *= 2;
+                index->pages = g_renew(OGGPage, index->pages, allocated);
+            }
+
+            index->pages[index->num_pages++] = (OGGPage) {
+                .offset = offset,
+                .granule = ogg_page_granulepos(&og),
+            };
+        }
+
+        if (ogg_page_eos(&og)) {
+            if (read_offset < ogg->hdr.file_size) {
+                g_warning("Only the first logical stream of '%s' can be split", ogg->hdr.filename);
+            }
+            break;
+        }
+    }
+
+out:
+    if (stream_inited) {
+        ogg_stream_clear(&os);
+    }
+    ogg_sync_clear(&oy);
+
+    if (!headers_only) {
+        g_debug("Indexed %zu Ogg pages in '%s'", index->num_pages, ogg->hdr.filename);
+    }
+}
+
+/**
+ * The header packets are read from the start of the file on first use,
+ * the page index (a full scan) only if with_pages is TRUE.
+ **/
+static const OGGPageIndex *
+ogg_get_page_index(OpenedOGGVorbisFile *ogg, gboolean with_pages)
+{
+    OGGPageIndex *index = ogg->page_index;
+
+    g_mutex_lock(&index->mutex);
+
+    if (!index->headers_built) {
+        ogg_page_index_build(ogg, index, !with_pages);
+        index->headers_built = TRUE;
+        index->built = with_pages;
+    } else if (with_pages && !index->built && index->valid) {
+        ogg_page_index_build(ogg, index, FALSE);
+        index->built = TRUE;
+    }
+
+    g_mutex_unlock(&index->mutex);
+
+    return index;
+}
+
+/* Number of pages whose granule position is at or before granule */
+static size_t
+ogg_page_index_count_until(const OGGPageIndex *index, ogg_int64_t granule)
+{
+    size_t lo = 0;
+    size_t hi = index->num_pages;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (index->pages[mid].granule <= granule) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/**
+ * Output stream of a single track. Source packets are passed in with their
+ * granule position (the sample position at their end); each one is held
+ * back until the next arrives, so that the last can be flagged end of stream.
+ **/
+struct OGGSplit {
+    ogg_stream_state out;
+    FormatOutput *output;
+
+    ogg_int64_t start;
+    ogg_int64_t end;
+
+    gboolean started;
+    gboolean finished;
+    ogg_int64_t packetno;
+
+    unsigned char *held;
+    long held_bytes;
+    long held_allocated;
+    ogg_int64_t held_granule;
+    gboolean have_held;
+};
+
+static gboolean
+ogg_split_write_pages(struct OGGSplit *split, gboolean flush)
+{
+    ogg_page og;
+
+    while (flush ? ogg_stream_flush(&split->out, &og) : ogg_stream_pageout(&split->out, &og)) {
+        if (fwrite(og.header, 1, og.header_len, split->output->fp) != (size_t)og.header_len ||
+                fwrite(og.body, 1, og.body_len, split->output->fp) != (size_t)og.body_len) {
+            return FALSE;
+        }
+    }
+
+    format_output_written(split->output);
+
+    return TRUE;
+}
+
+static gboolean
+ogg_split_emit(struct OGGSplit *split, unsigned char *data, long bytes, ogg_int64_t granule, gboolean last)
+{
+    ogg_packet op = {
+        .packet = data,
+        .bytes = bytes,
+        .b_o_s = (split->packetno == 0),
+        .e_o_s = last,
+        .granulepos = granule,
+        .packetno = split->packetno++,
+    };
+
+    ogg_stream_packetin(&split->out, &op);
+
+    // The first audio page ends with the first packet that produces samples (the one after
+    // the priming packet), its granule position makes the decoder discard those before start
+    return ogg_split_write_pages(split, last || op.packetno < OGG_VORBIS_HEADERS || op.packetno == OGG_VORBIS_HEADERS + 1);
+}
+
+static void
+ogg_split_hold(struct OGGSplit *split, const ogg_packet *op, ogg_int64_t granule)
+{
+    if (op->bytes > split->held_allocated) {
+        split->held_allocated = op->bytes;
+        split->held = g_realloc(split->held, split->held_allocated);
+    }
+
+    memcpy(split->held, op->packet, op->bytes);
+    split->held_bytes = op->bytes;
+    split->held_granule = granule;
+    split->have_held = TRUE;
+}
+
+static gboolean
+ogg_split_packet(struct OGGSplit *split, const ogg_packet *op, ogg_int64_t granule)
+{
+    if (split->finished) {
+        return TRUE;
+    }
+
+    if (split->have_held) {
+        if (!split->started) {
+            if (granule <= split->start) {
+                // Not yet at start, the held packet is only needed to prime the decoder
+                ogg_split_hold(split, op, granule);
+                return TRUE;
+            }
+
+            split->started = TRUE;
+
+            // No granule position: should the primer end a page on its own, the first page
+            // with a granule position must still be the one with the first samples
+            if (!ogg_split_emit(split, split->held, split->held_bytes, -1, FALSE)) {
+                return FALSE;
+            }
+        } else if (!ogg_split_emit(split, split->held, split->held_bytes, split->held_granule - split->start, FALSE)) {
+            return FALSE;
+        }
+
+        split->have_held = FALSE;
+    }
+
+    if (split->started && granule >= split->end) {
+        // A granule position before the end of the last packet makes the decoder drop the rest;
+        // if this is the first packet with samples (the track is shorter than one packet), the
+        // first audio page is also the last and the decoder cuts the end instead of the start
+        split->finished = TRUE;
+        return ogg_split_emit(split, op->packet, op->bytes, split->end - split->start, TRUE);
+    }
+
+    ogg_split_hold(split, op, granule);
+
+    return TRUE;
+}
+
+/* Flush the held packet as end of stream if the source ended before the end of the track */
+static gboolean
+ogg_split_finish(struct OGGSplit *split)
+{
+    if (split->finished) {
+        return TRUE;
+    }
+
+    if (!split->started) {
+        return FALSE;
+    }
+
+    split->finished = TRUE;
+
+    return ogg_split_emit(split, split->held, split->held_bytes, MIN(split->held_granule, split->end) - split->start, TRUE);
+}
+
+/* Create the output file and write the header pages */
+static gboolean
+ogg_split_open(struct OGGSplit *split, const OGGPageIndex *index, const char *filename, enum FormatWritePolicy write_policy, ogg_int64_t start, ogg_int64_t end)
+{
+    memset(split, 0, sizeof(*split));
+
+    // Repacking the pages changes the size, it is not known in advance
+    if ((split->output = format_output_open(filename, 0, write_policy)) == NULL) {
+        g_warning("Could not open '%s' for writing", filename);
+        return FALSE;
+    }
+
+    split->start = start;
+    split->end = end;
+
+    // Each track is a standalone stream with a serial number of its own
+    ogg_stream_init(&split->out, (int)g_random_int());
+
+    for (int i=0; i<OGG_VORBIS_HEADERS; ++i) {
+        if (!ogg_split_emit(split, index->headers[i].packet, index->headers[i].bytes, 0, FALSE)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* Returns 0 if ok is TRUE and the file could be closed, -1 otherwise */
+static int
+ogg_split_close(struct OGGSplit *split, const char *filename, gboolean ok)
+{
+    if (split->output == NULL) {
+        return -1;
+    }
+
+    ogg_stream_clear(&split->out);
+    g_free(g_steal_pointer(&split->held));
+
+    if (format_output_close(g_steal_pointer(&split->output)) != 0 || !ok) {
+        g_warning("Error writing to file %s", filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Demultiplex the packets of one page and compute the granule position of
+ * each from that of the page (the end of its last packet) and the block
+ * sizes. The packets are valid until the next page is passed in. Returns
+ * the number of packets.
+ **/
+static int
+ogg_demux_page(const OGGPageIndex *index, ogg_stream_state *os, ogg_page *og, ogg_packet packets[256], ogg_int64_t granules[256])
+{
+    int count = 0;
+
+    ogg_stream_pagein(os, og);
+
+    int ret;
+    ogg_packet op;
+    while (count < 256 && (ret = ogg_stream_packetout(os, &op)) != 0) {
+        // ret < 0: gap in the data (always the case for the first page read)
+        if (ret > 0) {
+            packets[count++] = op;
+        }
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    granules[count - 1] = ogg_page_granulepos(og);
+    if (granules[count - 1] == -1) {
+        g_warning("Ogg page with packets but without granule position");
+        return 0;
+    }
+
+    for (int i=count-1; i>0; --i) {
+        // Overlapping halves of this and the previous block
+        long blocksize = MAX(vorbis_packet_blocksize((vorbis_info *)&index->info, &packets[i]), 0);
+        long prev_blocksize = MAX(vorbis_packet_blocksize((vorbis_info *)&index->info, &packets[i - 1]), 0);
+
+        granules[i - 1] = granules[i] - (blocksize / 4 + prev_blocksize / 4);
+    }
+
+    return count;
+}
+
+static void
+ogg_get_sample_range(OpenedOGGVorbisFile *ogg, unsigned long start_pos, unsigned long end_pos, ogg_int64_t *start_samples, ogg_int64_t *end_samples)
+{
+    const SampleInfo *si = &ogg->hdr.sample_info;
+
+    *start_samples = (ogg_int64_t)(start_pos / si->blockSize) * si->samplesPerSec / CD_BLOCKS_PER_SEC;
+    *end_samples = (ogg_int64_t)(end_pos / si->blockSize) * si->samplesPerSec / CD_BLOCKS_PER_SEC;
+
+    if (*end_samples == 0) {
+        *end_samples = si->numBytes / si->blockAlign;
+    }
+}
+
 int
-ogg_vorbis_write_file(OpenedAudioFile *self, const char *output_filename, unsigned long start_pos, unsigned long end_pos, report_progress_func report_progress, void *report_progress_user_data)
+ogg_vorbis_write_file(OpenedAudioFile *self, const char *output_filename, unsigned long start_pos, unsigned long end_pos, enum FormatWritePolicy write_policy, report_progress_func report_progress, void *report_progress_user_data)
 {
     OpenedOGGVorbisFile *ogg = (OpenedOGGVorbisFile *)self;
 
-    g_warning("TODO: Write file '%s', start=%lu, end=%lu", output_filename, start_pos, end_pos);
+    ogg_int64_t start_samples;
+    ogg_int64_t end_samples;
+    ogg_get_sample_range(ogg, start_pos, end_pos, &start_samples, &end_samples);
+
+    const OGGPageIndex *index = ogg_get_page_index(ogg, TRUE);
+    if (!index->valid) {
+        g_warning("No Vorbis stream found in '%s'", ogg->hdr.filename);
+        return -1;
+    }
+
+    // The page before the last one ending at or before start_samples: the packet
+    // that primes the decoder ends on that last page and starts after the first
+    size_t first = ogg_page_index_count_until(index, start_samples);
+    uint64_t offset = (first >= 2) ? index->pages[first - 2].offset : index->audio_offset;
+
+    // Only used for progress reporting
+    size_t last = ogg_page_index_count_until(index, end_samples - 1) + 1;
+    uint64_t end_offset = (last < index->num_pages) ? index->pages[last].offset : ogg->hdr.file_size;
+
+    struct OGGSplit split;
+    gboolean ok = ogg_split_open(&split, index, output_filename, write_policy, start_samples, end_samples);
+
+    if (split.output == NULL) {
+        return -1;
+    }
 
     report_progress(0.0, report_progress_user_data);
 
-    uint32_t start_samples = start_pos / ogg->hdr.sample_info.blockSize * ogg->hdr.sample_info.samplesPerSec / CD_BLOCKS_PER_SEC;
-    uint32_t end_samples = end_pos / ogg->hdr.sample_info.blockSize * ogg->hdr.sample_info.samplesPerSec / CD_BLOCKS_PER_SEC;
+    ogg_sync_state oy;
+    ogg_stream_state os;
+    ogg_sync_init(&oy);
+    ogg_stream_init(&os, index->serial);
+
+    ogg_packet packets[256];
+    ogg_int64_t granules[256];
+
+    uint64_t read_offset = offset;
+
+    while (ok && !split.finished) {
+        ogg_page og;
+        int ret = ogg_sync_pageout(&oy, &og);
+
+        if (ret == 0) {
+            char *buf = ogg_sync_buffer(&oy, OGG_READ_SIZE);
+            long len = format_module_read_at(&ogg->hdr, buf, OGG_READ_SIZE, read_offset);
+            if (len <= 0) {
+                break;
+            }
+
+            ogg_sync_wrote(&oy, len);
+            read_offset += len;
+
+            double progress = (double)(read_offset - offset) / (double)MAX(end_offset - offset, 1);
+            if (!report_progress(MIN(progress, 1.0), report_progress_user_data)) {
+                ok = FALSE;
+            }
+            continue;
+        } else if (ret < 0 || ogg_page_serialno(&og) != index->serial) {
+            continue;
+        }
+
+        int count = ogg_demux_page(index, &os, &og, packets, granules);
+        for (int i=0; ok && i<count; ++i) {
+            ok = ogg_split_packet(&split, &packets[i], granules[i]);
+        }
+
+        if (ogg_page_eos(&og)) {
+            break;
+        }
+    }
+
+    if (ok && !ogg_split_finish(&split)) {
+        g_warning("Track starts after the end of '%s'", ogg->hdr.filename);
+        ok = FALSE;
+    }
+
+    ogg_stream_clear(&os);
+    ogg_sync_clear(&oy);
+
+    if (ogg_split_close(&split, output_filename, ok) != 0) {
+        return -1;
+    }
+
+    report_progress(1.0, report_progress_user_data);
+
+    return 0;
+}
+
+/**
+ * Demultiplex the stream once and pass each packet to the tracks that need
+ * it. A track is opened when the first packet after its start arrives,
+ * together with the previous packet (kept around) to prime the decoder.
+ **/
+static void
+ogg_vorbis_write_tracks(OpenedAudioFile *self, FormatTrack *tracks, size_t num_tracks)
+{
+    OpenedOGGVorbisFile *ogg = (OpenedOGGVorbisFile *)self;
+
+    const OGGPageIndex *index = ogg_get_page_index(ogg, FALSE);
+    if (!index->valid) {
+        g_warning("No Vorbis stream found in '%s'", ogg->hdr.filename);
+        for (size_t i=0; i<num_tracks; ++i) {
+            tracks[i].result = -1;
+        }
+        return;
+    }
+
+    struct OGGSplit *splits = g_new0(struct OGGSplit, num_tracks);
+    ogg_int64_t *starts = g_new(ogg_int64_t, num_tracks);
+    ogg_int64_t *ends = g_new(ogg_int64_t, num_tracks);
+
+    for (size_t i=0; i<num_tracks; ++i) {
+        ogg_get_sample_range(ogg, tracks[i].start_pos, tracks[i].end_pos, &starts[i], &ends[i]);
+        tracks[i].result = -1;
+    }
+
+    ogg_sync_state oy;
+    ogg_stream_state os;
+    ogg_sync_init(&oy);
+    ogg_stream_init(&os, index->serial);
+
+    ogg_packet packets[256];
+    ogg_int64_t granules[256];
+
+    struct OGGSplit prev;
+    memset(&prev, 0, sizeof(prev));
+
+    uint64_t read_offset = index->audio_offset;
+    size_t current = 0;
+    gboolean aborted = FALSE;
+
+    while (!aborted && current < num_tracks) {
+        ogg_page og;
+        int ret = ogg_sync_pageout(&oy, &og);
+
+        if (ret == 0) {
+            char *buf = ogg_sync_buffer(&oy, OGG_READ_SIZE);
+            long len = format_module_read_at(&ogg->hdr, buf, OGG_READ_SIZE, read_offset);
+            if (len <= 0) {
+                break;
+            }
+
+            ogg_sync_wrote(&oy, len);
+            read_offset += len;
+            continue;
+        } else if (ret < 0 || ogg_page_serialno(&og) != index->serial) {
+            continue;
+        }
+
+        int count = ogg_demux_page(index, &os, &og, packets, granules);
 
-    if (end_samples == 0) {
-        end_samples = ogg->hdr.sample_info.numBytes / ogg->hdr.sample_info.blockAlign;
+        for (int p=0; !aborted && p<count; ++p) {
+            for (size_t i=current; i<num_tracks && starts[i] < granules[p]; ++i) {
+                struct OGGSplit *split = &splits[i];
+
+                if (split->finished) {
+                    continue;
+                }
+
+                gboolean ok = TRUE;
+
+                if (split->output == NULL) {
+                    ok = ogg_split_open(split, index, tracks[i].filename, tracks[i].write_policy, starts[i], ends[i]);
+
+                    if (ok && prev.have_held) {
+                        ogg_packet primer = { .packet = prev.held, .bytes = prev.held_bytes };
+                        ok = ogg_split_packet(split, &primer, prev.held_granule);
+                    }
+
+                    if (ok && !tracks[i].report_progress(0.0, tracks[i].report_progress_user_data)) {
+                        aborted = TRUE;
+                    }
+                }
+
+                ok = ok && ogg_split_packet(split, &packets[p], granules[p]);
+
+                if (!ok || split->finished) {
+                    split->finished = TRUE;
+                    tracks[i].result = ogg_split_close(split, tracks[i].filename, ok);
+                    if (tracks[i].result == 0) {
+                        tracks[i].report_progress(1.0, tracks[i].report_progress_user_data);
+                    }
+                } else if (!tracks[i].report_progress((double)(granules[p] - starts[i]) / (double)MAX(ends[i] - starts[i], 1),
+                                                      tracks[i].report_progress_user_data)) {
+                    aborted = TRUE;
+                }
+            }
+
+            ogg_split_hold(&prev, &packets[p], granules[p]);
+
+            while (current < num_tracks && splits[current].finished) {
+                current++;
+            }
+        }
+
+        if (ogg_page_eos(&og)) {
+            break;
+        }
     }
 
-    // TODO: Copy Ogg Vorbis samples from source to output file
-    (void)start_samples;
-    (void)end_samples;
+    for (size_t i=current; i<num_tracks; ++i) {
+        struct OGGSplit *split = &splits[i];
 
-    return -1;
+        if (split->finished) {
+            continue;
+        }
+
+        if (aborted || split->output == NULL) {
+            if (!aborted) {
+                g_warning("Track starts after the end of '%s'", ogg->hdr.filename);
+            }
+            ogg_split_close(split, tracks[i].filename, FALSE);
+            continue;
+        }
+
+        // The source ended before the end of the track
+        tracks[i].result = ogg_split_close(split, tracks[i].filename, ogg_split_finish(split));
+        if (tracks[i].result == 0) {
+            tracks[i].report_progress(1.0, tracks[i].report_progress_user_data);
+        }
+    }
+
+    g_free(prev.held);
+    ogg_stream_clear(&os);
+    ogg_sync_clear(&oy);
+
+    g_free(ends);
+    g_free(starts);
+    g_free(splits);
 }
 
 static void
@@ -101,6 +780,10 @@ ogg_vorbis_close_file(const FormatModule *self, OpenedAudioFile *file)
 
     ov_clear(&ogg->ogg_vorbis_file);
 
+    if (ogg->page_index != NULL) {
+        ogg_page_index_unref(g_steal_pointer(&ogg->page_index));
+    }
+
     g_free(ogg);
 }
 
@@ -117,6 +800,7 @@ ogg_vorbis_open_file(const FormatModule *self, const char *filename, char **erro
     SampleInfo *si = &ogg->hdr.sample_info;
 
     ogg->ogg_vorbis_offset = 0;
+    ogg->page_index = ogg_page_index_new();
 
     g_debug("Trying as Ogg Vorbis...");
     int ogg_res = ov_fopen(ogg->hdr.filename, &ogg->ogg_vorbis_file);
@@ -164,6 +848,33 @@ error:
     return NULL;
 }
 
+static OpenedAudioFile *
+ogg_vorbis_reopen_file(OpenedAudioFile *self, char **error_message)
+{
+    OpenedOGGVorbisFile *orig = (OpenedOGGVorbisFile *)self;
+
+    OpenedOGGVorbisFile *ogg = g_new0(OpenedOGGVorbisFile, 1);
+
+    if (!format_module_open_file(self->mod, &ogg->hdr, self->filename, error_message)) {
+        g_free(ogg);
+        return NULL;
+    }
+
+    ogg->hdr.sample_info = self->sample_info;
+    ogg->hdr.details = g_strdup(self->details);
+    ogg->ogg_vorbis_offset = 0;
+    ogg->page_index = ogg_page_index_ref(orig->page_index);
+
+    int ogg_res = ov_fopen(ogg->hdr.filename, &ogg->ogg_vorbis_file);
+    if (ogg_res != 0) {
+        format_module_set_error_message(error_message, "ov_fopen() returned %d", ogg_res);
+        ogg_vorbis_close_file(self->mod, &ogg->hdr);
+        return NULL;
+    }
+
+    return &ogg->hdr;
+}
+
 static const FormatModule
 OGG_VORBIS_FORMAT_MODULE = {
     .name = "Ogg Vorbis",
@@ -172,9 +883,11 @@ OGG_VORBIS_FORMAT_MODULE = {
 
     .open_file = ogg_vorbis_open_file,
     .close_file = ogg_vorbis_close_file,
+    .reopen_file = ogg_vorbis_reopen_file,
 
     .read_samples = ogg_vorbis_read_samples,
     .write_file = ogg_vorbis_write_file,
+    .write_tracks = ogg_vorbis_write_tracks,
 };
 
 const FormatModule *
@@ -54,6 +54,9 @@ typedef struct {
 //	unsigned short  extraNonPcm;
 } FormatChunk;
 
+/* As written by wav_write_file_header() */
+#define WAV_FILE_HEADER_SIZE (sizeof(WaveHeader) + sizeof(ChunkHeader) + sizeof(FormatChunk) + sizeof(ChunkHeader))
+
 
 typedef struct OpenedWavFile_ OpenedWavFile;
 struct OpenedWavFile_ {
@@ -216,10 +219,6 @@ wav_read_samples(OpenedAudioFile *self, unsigned char *buf, size_t buf_size, uns
 {
     OpenedWavFile *wav = (OpenedWavFile *)self;
 
-    if (fseek(wav->hdr.fp, start_pos + wav->wavDataPtr, SEEK_SET)) {
-        return -1;
-    }
-
     if (start_pos > wav->wavDataSize) {
         return -1;
     }
@@ -228,75 +227,73 @@ wav_read_samples(OpenedAudioFile *self, unsigned char *buf, size_t buf_size, uns
         buf_size = wav->wavDataSize - start_pos;
     }
 
-    return fread(buf, 1, buf_size, wav->hdr.fp);
+    return format_module_read_at(&wav->hdr, buf, buf_size, (uint64_t)start_pos + wav->wavDataPtr);
 }
 
-int
-wav_write_file(OpenedAudioFile *self, const char *output_filename, unsigned long start_pos, unsigned long end_pos, report_progress_func report_progress, void *report_progress_user_data)
+static const unsigned char *
+wav_map_samples(OpenedAudioFile *self, unsigned long start_pos, size_t *len, enum FormatAccess access)
 {
     OpenedWavFile *wav = (OpenedWavFile *)self;
 
-    int buf_size = wav->hdr.sample_info.blockSize;
+    if (start_pos > wav->wavDataSize) {
+        return NULL;
+    }
+
+    *len = MIN(*len, wav->wavDataSize - start_pos);
+
+    return format_module_map_range(&wav->hdr, (uint64_t)start_pos + wav->wavDataPtr, *len, access);
+}
 
-    int ret;
-    FILE *new_fp = NULL;
-    unsigned long cur_pos, num_bytes;
-    unsigned char *buf = malloc(buf_size);
+int
+wav_write_file(OpenedAudioFile *self, const char *output_filename, unsigned long start_pos, unsigned long end_pos, enum FormatWritePolicy write_policy, report_progress_func report_progress, void *report_progress_user_data)
+{
+    OpenedWavFile *wav = (OpenedWavFile *)self;
+
+    FormatOutput *out = NULL;
+    unsigned long num_bytes;
 
     if (start_pos > wav->wavDataSize) {
         goto error;
     }
 
-    if ((new_fp = fopen(output_filename, "wb")) == NULL) {
-        g_warning("Error opening %s for writing", output_filename);
-        goto error;
+    if (end_pos == 0 || end_pos > wav->wavDataSize) {
+        end_pos = wav->wavDataSize;
     }
 
-    start_pos += wav->wavDataPtr;
-    if (end_pos != 0) {
-        end_pos += wav->wavDataPtr;
-        num_bytes = end_pos - start_pos;
-    } else {
-        num_bytes = wav->wavDataSize + wav->wavDataPtr - start_pos;
-    }
-    cur_pos = start_pos;
+    num_bytes = end_pos - start_pos;
 
-    if ((wav_write_file_header(new_fp, &wav->hdr.sample_info, num_bytes)) != 0) {
-        g_message("Could not write WAV header to %s", output_filename);
+    if ((out = format_output_open(output_filename, WAV_FILE_HEADER_SIZE + num_bytes, write_policy)) == NULL) {
+        g_warning("Error opening %s for writing", output_filename);
         goto error;
     }
 
-    if (fseek(wav->hdr.fp, cur_pos, SEEK_SET)) {
-        g_message("Could not seek to read position in %s", wav->hdr.filename);
+    if ((wav_write_file_header(out->fp, &wav->hdr.sample_info, num_bytes)) != 0) {
+        g_message("Could not write WAV header to %s", output_filename);
         goto error;
     }
 
     report_progress(0.0, report_progress_user_data);
 
-    while ((ret = fread(buf, 1, buf_size, wav->hdr.fp)) > 0 &&
-                (cur_pos < end_pos || end_pos == 0)) {
-        if ((fwrite(buf, 1, ret, new_fp)) < ret) {
-            g_message("Error writing to file %s", output_filename);
-            goto error;
-        }
-
-        cur_pos += ret;
-        report_progress((double)(cur_pos - start_pos) / num_bytes, report_progress_user_data);
+    if (!format_module_copy_to_file(&wav->hdr, (uint64_t)start_pos + wav->wavDataPtr, num_bytes, out,
+                                    report_progress, report_progress_user_data)) {
+        g_message("Error writing to file %s", output_filename);
+        goto error;
     }
 
-    free(buf);
-    fclose(new_fp);
+    if (format_output_close(g_steal_pointer(&out)) != 0) {
+        g_message("Error writing to file %s", output_filename);
+        goto error;
+    }
 
     report_progress(1.0, report_progress_user_data);
 
-    return ret;
+    return 0;
 
 error:
-    if (new_fp != NULL) {
-        fclose(new_fp);
+    if (out != NULL) {
+        format_output_close(out);
     }
 
-    free(buf);
     return -1;
 }
 
@@ -306,11 +303,13 @@ WAV_FORMAT_MODULE = {
     .name = "RIFF WAVE",
     .library_name = "built-in",
     .default_file_extension = ".wav",
+    .random_access = TRUE,
 
     .open_file = wav_open_file,
     .close_file = wav_close_file,
 
     .read_samples = wav_read_samples,
+    .map_samples = wav_map_samples,
     .write_file = wav_write_file,
 };
 
@@ -375,29 +374,21 @@ wav_write_file_header(FILE *fp,
     return 0;
 }
 
-int
-wav_merge_files(char *filename,
-                int num_files,
-                char *filenames[],
-                WriteInfo *write_info)
+static int
+wav_merge(char *filename,
+          int num_files,
+          char *filenames[],
+          ProgressChannel *progress)
 {
     int i;
     int ret = 0;
     SampleInfo sample_info[num_files];
     unsigned long data_ptr[num_files];
-    FILE *new_fp, *read_fp;
+    FormatOutput *out;
+    FILE *read_fp;
     unsigned long cur_pos, end_pos, num_bytes;
     unsigned char buf[DEFAULT_BUF_SIZE];
 
-    if( write_info != NULL) {
-        write_info->num_files = num_files;
-        write_info->cur_file = 0;
-        write_info->sync = 0;
-        write_info->sync_check_file_overwrite_to_write_progress = 0;
-        write_info->check_file_exists = 0;
-        write_info->skip_file = -1;
-    }
-
     const FormatModule *mod = format_module_wav();
 
     for (i = 0; i < num_files; i++) {
@@ -408,7 +399,7 @@ wav_merge_files(char *filename,
         if (oaf == NULL) {
             g_warning("Could not read WAV header of %s: %s", filenames[i], error_message);
             g_free(error_message);
-            return -1;
+            return WAV_MERGE_IO_ERROR;
         } else {
             sample_info[i] = oaf->sample_info;
             data_ptr[i] = wav->wavDataPtr;
@@ -420,48 +411,42 @@ wav_merge_files(char *filename,
 
     for (i = 1; i < num_files; i++) {
         if (sample_info[0].channels != sample_info[i].channels) {
-            return 1;
+            return WAV_MERGE_FORMAT_MISMATCH;
         } else if (sample_info[0].samplesPerSec != 
                             sample_info[i].samplesPerSec) {
-            return 1;
+            return WAV_MERGE_FORMAT_MISMATCH;
         } else if (sample_info[0].avgBytesPerSec != 
                             sample_info[i].avgBytesPerSec) {
-            return 1;
+            return WAV_MERGE_FORMAT_MISMATCH;
         } else if (sample_info[0].blockAlign != sample_info[i].blockAlign) {
-            return 1;
+            return WAV_MERGE_FORMAT_MISMATCH;
         } else if (sample_info[0].bitsPerSample != 
                             sample_info[i].bitsPerSample) {
-            return 1;
+            return WAV_MERGE_FORMAT_MISMATCH;
         }
 
         num_bytes += sample_info[i].numBytes;
     }
 
-    if ((new_fp = fopen(filename, "wb")) == NULL) {
+    if ((out = format_output_open(filename, WAV_FILE_HEADER_SIZE + num_bytes, FORMAT_WRITE_POLICY_CACHE_FRIENDLY)) == NULL) {
         printf("error opening %s for writing\n", filename);
-        return -1;
+        return WAV_MERGE_IO_ERROR;
     }
 
-    if ((wav_write_file_header(new_fp, &sample_info[0], num_bytes)) != 0) {
-        fclose(new_fp);
-        return -1;
+    if ((wav_write_file_header(out->fp, &sample_info[0], num_bytes)) != 0) {
+        format_output_close(out);
+        return WAV_MERGE_IO_ERROR;
     }
 
     for (i = 0; i < num_files; i++) {
-        if( write_info != NULL) {
-            write_info->pct_done = 0.0;
-            write_info->cur_file++;
-            if (write_info->cur_filename != NULL) {
-                free(write_info->cur_filename);
-            }
-            write_info->cur_filename = g_strdup(filenames[i]);
+        if (progress != NULL) {
+            progress_channel_post(progress, PROGRESS_EVENT_ITEM_STARTED, i + 1, i, num_files, filenames[i]);
         }
 
         if ((read_fp = fopen(filenames[i], "rb")) == NULL) {
             printf("error opening %s for reading\n", filenames[i]);
-            fclose(new_fp);
-            fclose(read_fp);
-            return -1;
+            format_output_close(out);
+            return WAV_MERGE_IO_ERROR;
         }
 
         cur_pos = data_ptr[i];
@@ -469,43 +454,65 @@ wav_merge_files(char *filename,
         end_pos = cur_pos + num_bytes;
 
         if (fseek(read_fp, cur_pos, SEEK_SET)) {
-            fclose(new_fp);
+            format_output_close(out);
             fclose(read_fp);
-            return -1;
+            return WAV_MERGE_IO_ERROR;
         }
 
-        while ((ret = fread(buf, 1, sizeof(buf), read_fp)) > 0 &&
-                           (cur_pos < end_pos)) {
+        // Only the sample data, not the chunks that may follow it
+        while (cur_pos < end_pos &&
+                (ret = fread(buf, 1, MIN(sizeof(buf), end_pos - cur_pos), read_fp)) > 0) {
 
-            if ((fwrite(buf, 1, ret, new_fp)) < ret) {
+            if ((fwrite(buf, 1, ret, out->fp)) < ret) {
                 printf("error writing to file %s\n", filename);
-                fclose(new_fp);
+                format_output_close(out);
                 fclose(read_fp);
-                return -1;
+                return WAV_MERGE_IO_ERROR;
             }
 
-            if( write_info != NULL) {
-                write_info->pct_done = (double) cur_pos / num_bytes;
+            format_output_written(out);
+
+            if (progress != NULL) {
+                double pct_done = (double)(cur_pos - data_ptr[i]) / MAX(num_bytes, 1);
+                progress_channel_set_fraction(progress, (i + pct_done) / num_files);
             }
 
             cur_pos += ret;
         }
 
         fclose(read_fp);
-    }
 
-    if( write_info != NULL) {
-        write_info->sync = 1;
-        if (write_info->cur_filename != NULL) {
-            g_free(write_info->cur_filename);
+        if (progress != NULL) {
+            progress_channel_post(progress, PROGRESS_EVENT_ITEM_FINISHED, i + 1, i + 1, num_files, filenames[i]);
         }
-        write_info->cur_filename = NULL;
     }
 
-    fclose(new_fp);
+    if (format_output_close(out) != 0) {
+        printf("error writing to file %s\n", filename);
+        return WAV_MERGE_IO_ERROR;
+    }
+
+    return WAV_MERGE_OK;
+}
+
+int
+wav_merge_files(char *filename,
+                int num_files,
+                char *filenames[],
+                ProgressChannel *progress)
+{
+    int ret = wav_merge(filename, num_files, filenames, progress);
+
+    if (progress != NULL) {
+        if (ret == WAV_MERGE_FORMAT_MISMATCH) {
+            progress_channel_post(progress, PROGRESS_EVENT_ERROR, 0, 0, num_files, _("The files are not of the same format."));
+        } else if (ret != WAV_MERGE_OK) {
+            progress_channel_post(progress, PROGRESS_EVENT_ERROR, 0, 0, num_files, _("Could not merge the files."));
+        } else {
+            progress_channel_set_fraction(progress, 1.0);
+        }
 
-    if( write_info != NULL) {
-        write_info->pct_done = 1.0;
+        progress_channel_post(progress, PROGRESS_EVENT_FINISHED, 0, (ret == WAV_MERGE_OK) ? num_files : 0, num_files, NULL);
     }
 
     return ret;
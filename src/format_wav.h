@@ -31,8 +31,19 @@ wav_write_file_header(FILE *fp,
                       SampleInfo *sample_info,
                       unsigned long num_bytes);
 
+enum WavMergeResult {
+    WAV_MERGE_OK = 0,
+    WAV_MERGE_IO_ERROR = -1,
+    WAV_MERGE_FORMAT_MISMATCH = -2, /* sample rate, channels, etc. differ */
+};
+
+/**
+ * Concatenate the sample data of WAV files of the same format, returns an
+ * enum WavMergeResult. progress (optional) receives one item per file, the
+ * error if any and a FINISHED event.
+ **/
 int
 wav_merge_files(char *filename,
                 int num_files,
                 char *filenames[],
-                WriteInfo *write_info);
+                ProgressChannel *progress);
@@ -50,7 +50,12 @@ static GtkListStore *store = NULL;
 static char folder[4096] = {0};
 
 static SampleInfo common_sample_info;
-static WriteInfo write_info;
+
+/* Progress of the running merge, NULL when there is none */
+static ProgressChannel *merge_progress;
+
+/* Don't redraw the progress bar more often than this */
+#define MERGE_PROGRESS_INTERVAL_MS 50
 
 gboolean file_merge_progress_idle_func(gpointer data);
 
@@ -77,7 +82,7 @@ struct MergeThreadData_ {
     char *merge_filename;
     int num_files;
     GList *filenames;
-    WriteInfo *write_info;
+    ProgressChannel *progress;
 };
 MergeThreadData mtd;
 
@@ -105,7 +110,7 @@ merge_thread(gpointer data)
     wav_merge_files(thread_data->merge_filename,
                         g_list_length(thread_data->filenames),
                         filenames,
-                        thread_data->write_info);
+                        thread_data->progress);
 
     head = thread_data->filenames;
     cur = head;
@@ -121,15 +126,27 @@ merge_thread(gpointer data)
     g_list_free(thread_data->filenames);
     g_free(thread_data->merge_filename);
 
+    progress_channel_unref(thread_data->progress);
+
     return NULL;
 }
 
+/* Runs on the merge thread, the UI is updated from the main loop */
+static void
+file_merge_progress_notify(ProgressChannel *progress, void *user_data)
+{
+    g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, file_merge_progress_idle_func,
+            progress_channel_ref(progress), (GDestroyNotify)progress_channel_unref);
+}
+
 static void
-do_merge_files(char *merge_filename, GList *filenames, WriteInfo *write_info)
+do_merge_files(char *merge_filename, GList *filenames)
 {
+    merge_progress = progress_channel_new(MERGE_PROGRESS_INTERVAL_MS, file_merge_progress_notify, NULL, NULL);
+
     mtd.merge_filename = g_strdup(merge_filename);
     mtd.filenames = filenames;
-    mtd.write_info = write_info;
+    mtd.progress = progress_channel_ref(merge_progress);
 
     g_thread_unref(g_thread_new("merge files", merge_thread, &mtd));
 }
@@ -187,10 +204,11 @@ static void ok_button_clicked(GtkWidget *widget, gpointer user_data)
 
     if( gtk_dialog_run( GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
         tmp = gtk_file_chooser_get_filename( GTK_FILE_CHOOSER(dialog));
-        write_info.pct_done = 0.0;
-        do_merge_files(tmp, filenames, &write_info);
+        do_merge_files(tmp, filenames);
         gtk_widget_destroy(GTK_WIDGET(user_data));
-        g_idle_add( file_merge_progress_idle_func, NULL);
+
+        // Show the progress window right away
+        file_merge_progress_notify(merge_progress, NULL);
     }
 
     gtk_widget_destroy( GTK_WIDGET(dialog));
@@ -418,8 +436,19 @@ gboolean file_merge_progress_idle_func(gpointer data) {
     static GtkWidget *vbox;
     static GtkWidget *label;
     static GtkWidget *status_label;
-    static int cur_file_displayed = 0;
-    static double fraction;
+    static guint files_done;
+    static guint num_files;
+    static GList *errors;
+
+    ProgressChannel *progress = data;
+
+    if (progress != merge_progress) {
+        // Woken up after that merge had already finished
+        return FALSE;
+    }
+
+    // Re-arm first, so that nothing published while we're draining is missed
+    progress_channel_poll(progress);
 
     if (window == NULL) {
         window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -462,44 +491,70 @@ gboolean file_merge_progress_idle_func(gpointer data) {
         gtk_box_pack_start(GTK_BOX(vbox), status_label, FALSE, TRUE, 5);
 
         gtk_widget_show_all(GTK_WIDGET(window));
-        cur_file_displayed = -1;
+        files_done = 0;
+        num_files = 0;
     }
 
-    if (write_info.sync) {
-        write_info.sync = 0;
-        gtk_widget_destroy(window);
-        window = NULL;
+    gboolean finished = FALSE;
+
+    ProgressEvent event;
+    while (progress_channel_pop(progress, &event)) {
+        switch (event.type) {
+            case PROGRESS_EVENT_ITEM_STARTED: {
+                gchar *bn = g_path_get_basename(event.text);
+                gchar *tmp = g_strdup_printf(_("Adding %s"), bn);
+                g_free(bn);
+                gchar *msg = g_markup_printf_escaped("<i>%s</i>", tmp);
+                g_free(tmp);
+                gtk_label_set_markup(GTK_LABEL(status_label), msg);
+                g_free(msg);
+                break;
+            }
+            case PROGRESS_EVENT_ERROR:
+                errors = g_list_append(errors, g_strdup(event.text));
+                break;
+            case PROGRESS_EVENT_FINISHED:
+                finished = TRUE;
+                break;
+            default:
+                break;
+        }
 
-        popupmessage_show(NULL, _("Operation successful"), _("The files have been merged."));
+        files_done = event.done;
+        num_files = event.total;
 
-        return FALSE;
+        progress_event_clear(&event);
     }
 
-    if (cur_file_displayed != write_info.cur_file) {
-        gchar *bn = g_path_get_basename(write_info.cur_filename);
-        gchar *tmp = g_strdup_printf(_("Adding %s"), bn);
-        g_free(bn);
-        gchar *msg = g_markup_printf_escaped("<i>%s</i>", tmp);
-        g_free(tmp);
-        gtk_label_set_markup(GTK_LABEL(status_label), msg);
-        g_free(msg);
+    if (finished) {
+        gtk_widget_destroy(window);
+        window = NULL;
+
+        progress_channel_unref(g_steal_pointer(&merge_progress));
 
-        cur_file_displayed = write_info.cur_file;
+        if (errors != NULL) {
+            popupmessage_show(NULL, _("Operation failed"), (const gchar *)errors->data);
+            g_list_free_full(g_steal_pointer(&errors), g_free);
+        } else {
+            popupmessage_show(NULL, _("Operation successful"), _("The files have been merged."));
+        }
+
+        return FALSE;
     }
 
-    fraction = 1.00*(write_info.cur_file-1+write_info.pct_done)/write_info.num_files;
-    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(pbar), fraction);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(pbar), progress_channel_get_fraction(progress));
 
     gchar *msg;
-    if (write_info.num_files > 1) {
+    if (num_files > 1) {
         // TODO: i18n plural forms
-        msg = g_strdup_printf(_("%d of %d files merged"), write_info.cur_file-1, write_info.num_files);
+        msg = g_strdup_printf(_("%d of %d files merged"), files_done, num_files);
     } else {
-        msg = g_strdup_printf(_("%d of 1 file merged"), write_info.cur_file-1);
+        msg = g_strdup_printf(_("%d of 1 file merged"), files_done);
     }
     gtk_progress_bar_set_text( GTK_PROGRESS_BAR(pbar), msg);
     g_free(msg);
 
-    return TRUE;
+    // Called again by file_merge_progress_notify() when there is news
+    return FALSE;
 }
 
@@ -0,0 +1,340 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "peakcache.h"
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PEAKCACHE_MAGIC "WBPEAKS"
+#define PEAKCACHE_BYTE_ORDER 0x01020304
+#define PEAKCACHE_EXTENSION ".peaks"
+
+/**
+ * On-disk layout: header, numSamples Points, then the absolute path of the
+ * audio file (path_length bytes, not NUL-terminated), all in native byte
+ * order. The header size is a multiple of 8, so the Points are aligned.
+ **/
+typedef struct PeakCacheHeader_ PeakCacheHeader;
+struct PeakCacheHeader_ {
+    char magic[8];
+    guint32 version;
+    guint32 byte_order;
+
+    // key
+    guint64 file_size;
+    gint64 mtime;
+    guint8 content_hash[32];
+    guint32 block_size;
+    guint32 bits_per_sample;
+
+    // GraphData
+    guint64 num_points;
+    guint64 max_sample_value;
+    guint64 max_sample_amp;
+    guint64 min_sample_amp;
+
+    guint64 path_length;
+};
+
+struct PeakCache_ {
+    GMappedFile *mapped;
+};
+
+gchar *
+peakcache_get_directory(void)
+{
+    return g_build_filename(g_get_user_cache_dir(), "wavbreaker", "peaks", NULL);
+}
+
+gchar *
+peakcache_get_filename(const char *audio_filename)
+{
+    gchar *path = g_canonicalize_filename(audio_filename, NULL);
+    gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, path, -1);
+    gchar *basename = g_strconcat(hash, PEAKCACHE_EXTENSION, NULL);
+
+    gchar *directory = peakcache_get_directory();
+    gchar *result = g_build_filename(directory, basename, NULL);
+
+    g_free(directory);
+    g_free(basename);
+    g_free(hash);
+    g_free(path);
+
+    return result;
+}
+
+static gboolean
+peakcache_compute_key(const char *audio_filename, PeakCacheHeader *key, char **error_message)
+{
+    GStatBuf st;
+    if (g_stat(audio_filename, &st) != 0) {
+        format_module_set_error_message(error_message, "Could not stat %s", audio_filename);
+        return FALSE;
+    }
+
+    key->file_size = st.st_size;
+    key->mtime = st.st_mtime;
+
+    FILE *fp = g_fopen(audio_filename, "rb");
+    if (fp == NULL) {
+        format_module_set_error_message(error_message, "Could not open %s", audio_filename);
+        return FALSE;
+    }
+
+    unsigned char *buf = g_malloc(PEAKCACHE_HASH_BYTES);
+    size_t len = fread(buf, 1, PEAKCACHE_HASH_BYTES, fp);
+    fclose(fp);
+
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(checksum, buf, len);
+
+    gsize digest_len = sizeof(key->content_hash);
+    g_checksum_get_digest(checksum, key->content_hash, &digest_len);
+
+    g_checksum_free(checksum);
+    g_free(buf);
+
+    return TRUE;
+}
+
+static const PeakCacheHeader *
+peakcache_check_mapping(GMappedFile *mapped, const PeakCacheHeader *key, char **error_message)
+{
+    gsize length = g_mapped_file_get_length(mapped);
+    const PeakCacheHeader *header = (const PeakCacheHeader *)g_mapped_file_get_contents(mapped);
+
+    if (length < sizeof(PeakCacheHeader) ||
+            memcmp(header->magic, PEAKCACHE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->byte_order != PEAKCACHE_BYTE_ORDER) {
+        format_module_set_error_message(error_message, "Not a peak cache file");
+        return NULL;
+    }
+
+    if (header->version != PEAKCACHE_VERSION) {
+        format_module_set_error_message(error_message, "Peak cache version %u not supported", header->version);
+        return NULL;
+    }
+
+    if (header->num_points > (length - sizeof(PeakCacheHeader)) / sizeof(Points) ||
+            sizeof(PeakCacheHeader) + header->num_points * sizeof(Points) + header->path_length != length) {
+        format_module_set_error_message(error_message, "Peak cache file is truncated");
+        return NULL;
+    }
+
+    if (key != NULL && (header->file_size != key->file_size ||
+                        header->mtime != key->mtime ||
+                        memcmp(header->content_hash, key->content_hash, sizeof(key->content_hash)) != 0 ||
+                        header->block_size != key->block_size ||
+                        header->bits_per_sample != key->bits_per_sample)) {
+        format_module_set_error_message(error_message, "Peak cache is out of date");
+        return NULL;
+    }
+
+    return header;
+}
+
+PeakCache *
+peakcache_open(OpenedAudioFile *file, GraphData *graph_data, char **error_message)
+{
+    PeakCacheHeader key;
+    memset(&key, 0, sizeof(key));
+
+    if (!peakcache_compute_key(file->filename, &key, error_message)) {
+        return NULL;
+    }
+
+    key.block_size = file->sample_info.blockSize;
+    key.bits_per_sample = file->sample_info.bitsPerSample;
+
+    gchar *filename = peakcache_get_filename(file->filename);
+    GMappedFile *mapped = g_mapped_file_new(filename, FALSE, NULL);
+    g_free(filename);
+
+    if (mapped == NULL) {
+        format_module_set_error_message(error_message, "No peak cache");
+        return NULL;
+    }
+
+    const PeakCacheHeader *header = peakcache_check_mapping(mapped, &key, error_message);
+    if (header == NULL) {
+        g_mapped_file_unref(mapped);
+        return NULL;
+    }
+
+    graph_data->numSamples = header->num_points;
+    graph_data->maxSampleValue = header->max_sample_value;
+    graph_data->maxSampleAmp = header->max_sample_amp;
+    graph_data->minSampleAmp = header->min_sample_amp;
+    g_atomic_int_set(&graph_data->validSamples, header->num_points);
+
+    // Read-only mapping, the analysis never touches cached data
+    graph_data->data = (Points *)(header + 1);
+
+    PeakCache *cache = g_new0(PeakCache, 1);
+    cache->mapped = mapped;
+
+    return cache;
+}
+
+void
+peakcache_close(PeakCache *cache)
+{
+    g_mapped_file_unref(cache->mapped);
+    g_free(cache);
+}
+
+gboolean
+peakcache_write(OpenedAudioFile *file, const GraphData *graph_data, char **error_message)
+{
+    PeakCacheHeader header;
+    memset(&header, 0, sizeof(header));
+
+    if (!peakcache_compute_key(file->filename, &header, error_message)) {
+        return FALSE;
+    }
+
+    gchar *path = g_canonicalize_filename(file->filename, NULL);
+
+    memcpy(header.magic, PEAKCACHE_MAGIC, sizeof(header.magic));
+    header.version = PEAKCACHE_VERSION;
+    header.byte_order = PEAKCACHE_BYTE_ORDER;
+    header.block_size = file->sample_info.blockSize;
+    header.bits_per_sample = file->sample_info.bitsPerSample;
+    header.num_points = graph_data->numSamples;
+    header.max_sample_value = graph_data->maxSampleValue;
+    header.max_sample_amp = graph_data->maxSampleAmp;
+    header.min_sample_amp = graph_data->minSampleAmp;
+    header.path_length = strlen(path);
+
+    gboolean result = FALSE;
+
+    gchar *directory = peakcache_get_directory();
+    gchar *filename = peakcache_get_filename(file->filename);
+
+    gsize points_size = graph_data->numSamples * sizeof(Points);
+    gsize length = sizeof(header) + points_size + header.path_length;
+    gchar *contents = g_malloc(length);
+
+    memcpy(contents, &header, sizeof(header));
+    memcpy(contents + sizeof(header), graph_data->data, points_size);
+    memcpy(contents + sizeof(header) + points_size, path, header.path_length);
+
+    GError *error = NULL;
+
+    if (g_mkdir_with_parents(directory, 0700) != 0) {
+        format_module_set_error_message(error_message, "Could not create %s", directory);
+    } else if (!g_file_set_contents(filename, contents, length, &error)) {
+        // Written to a temporary file and renamed, readers never see partial data
+        format_module_set_error_message(error_message, "Could not write %s: %s", filename, error->message);
+        g_error_free(error);
+    } else {
+        result = TRUE;
+    }
+
+    g_free(contents);
+    g_free(filename);
+    g_free(directory);
+    g_free(path);
+
+    return result;
+}
+
+gboolean
+peakcache_purge(const char *audio_filename)
+{
+    gchar *filename = peakcache_get_filename(audio_filename);
+    gboolean result = (g_unlink(filename) == 0);
+    g_free(filename);
+
+    return result;
+}
+
+static gboolean
+peakcache_is_stale(const char *filename)
+{
+    GMappedFile *mapped = g_mapped_file_new(filename, FALSE, NULL);
+    if (mapped == NULL) {
+        return TRUE;
+    }
+
+    gboolean result = TRUE;
+
+    const PeakCacheHeader *header = peakcache_check_mapping(mapped, NULL, NULL);
+    if (header != NULL) {
+        const char *path_data = (const char *)(header + 1) + header->num_points * sizeof(Points);
+        gchar *path = g_strndup(path_data, header->path_length);
+
+        PeakCacheHeader key;
+        memset(&key, 0, sizeof(key));
+
+        // block size and format are only known after opening the file, the rest of the key is enough here
+        if (peakcache_compute_key(path, &key, NULL)) {
+            result = (header->file_size != key.file_size ||
+                      header->mtime != key.mtime ||
+                      memcmp(header->content_hash, key.content_hash, sizeof(key.content_hash)) != 0);
+        }
+
+        g_free(path);
+    }
+
+    g_mapped_file_unref(mapped);
+
+    return result;
+}
+
+int
+peakcache_purge_directory(gboolean all)
+{
+    gchar *directory = peakcache_get_directory();
+
+    GDir *dir = g_dir_open(directory, 0, NULL);
+    if (dir == NULL) {
+        g_free(directory);
+        return 0;
+    }
+
+    int removed = 0;
+
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (!g_str_has_suffix(name, PEAKCACHE_EXTENSION) && strstr(name, PEAKCACHE_EXTENSION ".") == NULL) {
+            continue;
+        }
+
+        gchar *filename = g_build_filename(directory, name, NULL);
+
+        // Leftover temporary files (".peaks.XXXXXX") are always removed
+        gboolean remove = all || !g_str_has_suffix(name, PEAKCACHE_EXTENSION) || peakcache_is_stale(filename);
+
+        if (remove && g_unlink(filename) == 0) {
+            ++removed;
+        }
+
+        g_free(filename);
+    }
+
+    g_dir_close(dir);
+    g_free(directory);
+
+    return removed;
+}
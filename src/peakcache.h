@@ -0,0 +1,72 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "sample.h"
+#include "format.h"
+
+/**
+ * Persistent peak cache
+ *
+ * The analysis result (GraphData) of an audio file is stored in a binary
+ * file below $XDG_CACHE_HOME/wavbreaker/peaks/, named after a hash of the
+ * absolute path of the audio file. The cache is keyed by file size, mtime
+ * and a hash of the first PEAKCACHE_HASH_BYTES of the file (which covers
+ * the format header), and is mapped read-only when it is loaded.
+ **/
+
+#define PEAKCACHE_VERSION 1
+#define PEAKCACHE_HASH_BYTES (64 * 1024)
+
+typedef struct PeakCache_ PeakCache;
+
+/* Directory containing all cache files (newly-allocated) */
+gchar *
+peakcache_get_directory(void);
+
+/* Cache file for the given audio file (newly-allocated) */
+gchar *
+peakcache_get_filename(const char *audio_filename);
+
+/**
+ * Map the cache for file if it exists and matches the file on disk.
+ * On success, graph_data points into the mapping, which stays valid
+ * until peakcache_close() is called. Returns NULL and sets error_message
+ * if the cache is missing, stale or damaged.
+ **/
+PeakCache *
+peakcache_open(OpenedAudioFile *file, GraphData *graph_data, char **error_message);
+
+void
+peakcache_close(PeakCache *cache);
+
+/* Atomically (re-)write the cache for file, returns FALSE on error */
+gboolean
+peakcache_write(OpenedAudioFile *file, const GraphData *graph_data, char **error_message);
+
+/* Remove the cache of a single audio file, returns FALSE if there was none */
+gboolean
+peakcache_purge(const char *audio_filename);
+
+/**
+ * Remove cache files; if all is FALSE, only those whose audio file no
+ * longer exists or has changed. Returns the number of removed files.
+ **/
+int
+peakcache_purge_directory(gboolean all);
@@ -0,0 +1,412 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <config.h>
+
+#include "playback.h"
+#include "audio_sink.h"
+
+#include <string.h>
+
+/* Audio buffered ahead of the device (the ring is rounded up to a power of two) */
+#define PLAYBACK_RING_MS 500
+
+/* Most bytes read (or decoded) at once */
+#define PLAYBACK_READ_SIZE (64 * 1024)
+
+/* Most bytes handed to the device at once */
+#define PLAYBACK_WRITE_SIZE DEFAULT_BUF_SIZE
+
+/* Time a thread sleeps while waiting for the other one */
+#define PLAYBACK_WAIT_USEC 2000
+
+/* The same for a sink that is not realtime, which drains the ring at once */
+#define PLAYBACK_WAIT_FAST_USEC 100
+
+struct PlaybackEngine_ {
+    AudioSink *sink;
+    OpenedAudioFile *file;
+    GBytes *data;            /* instead of file: the PCM data from start_pos */
+    SampleInfo sample_info;
+    unsigned long start_pos;
+    unsigned long end_pos;   /* 0 = until the end of the file */
+    size_t frame_size;
+    gulong wait_usec;
+
+    // SPSC ring: head is only written by the reader, tail by the output thread
+    unsigned char *ring;
+    guint ring_size;
+    volatile gint head;
+    volatile gint tail;
+
+    volatile gint stop;    /* set by the control thread, or after the device failed */
+    volatile gint eof;     /* set by the reader after publishing the last byte */
+    volatile gint running; /* cleared by the output thread when it is done */
+    volatile gint failed;  /* set by the output thread if the sink could not be opened or written */
+    volatile gint underruns;
+
+    // Playhead clock, written by the output thread: the device plays at the
+    // sample rate from origin (monotonic time at which frame 0 was, or would
+    // have been, played) but never gets past the frames handed to it so far.
+    // The 64-bit origin is published in two halves under a sequence count.
+    volatile gint clock_seq;
+    volatile gint origin_hi;
+    volatile gint origin_lo;
+    volatile gint submitted_frames;
+
+    GThread *reader_thread;
+    GThread *output_thread;
+};
+
+/* Read len bytes at pos into buf, straight from the file mapping if possible */
+static long
+playback_read(OpenedAudioFile *file, unsigned char *buf, size_t len, unsigned long pos, enum FormatAccess access)
+{
+    size_t mapped_len = len;
+    const unsigned char *data = format_map_samples(file, pos, &mapped_len, access);
+
+    if (data != NULL) {
+        memcpy(buf, data, mapped_len);
+        return mapped_len;
+    }
+
+    return format_read_samples(file, buf, len, pos);
+}
+
+static gpointer
+playback_reader_thread(gpointer user_data)
+{
+    PlaybackEngine *engine = user_data;
+
+    unsigned long pos = engine->start_pos;
+
+    // Right after a jump the position is likely to change again (scrubbing)
+    enum FormatAccess access = FORMAT_ACCESS_RANDOM;
+
+    while (!g_atomic_int_get(&engine->stop)) {
+        guint head = g_atomic_int_get(&engine->head);
+        guint used = head - (guint)g_atomic_int_get(&engine->tail);
+        guint offset = head & (engine->ring_size - 1);
+
+        // Free space up to the end of the ring, the rest is filled next time
+        size_t len = MIN(MIN(engine->ring_size - used, engine->ring_size - offset), PLAYBACK_READ_SIZE);
+        if (len == 0) {
+            g_usleep(engine->wait_usec);
+            continue;
+        }
+
+        if (engine->end_pos != 0) {
+            len = MIN(len, engine->end_pos - MIN(pos, engine->end_pos));
+        }
+
+        long read = 0;
+        if (engine->data != NULL) {
+            gsize size = 0;
+            const unsigned char *data = g_bytes_get_data(engine->data, &size);
+
+            size_t done = MIN(pos - engine->start_pos, size);
+
+            read = MIN(len, size - done);
+            memcpy(engine->ring + offset, data + done, read);
+        } else if (len > 0) {
+            read = playback_read(engine->file, engine->ring + offset, len, pos, access);
+        }
+
+        if (read <= 0) {
+            break;
+        }
+
+        access = FORMAT_ACCESS_SEQUENTIAL;
+        pos += read;
+
+        // Publishes the data together with the new head
+        g_atomic_int_set(&engine->head, head + read);
+    }
+
+    g_atomic_int_set(&engine->eof, TRUE);
+
+    return NULL;
+}
+
+/* Copy len bytes from the ring at tail to buf, wrapping around */
+static void
+playback_ring_copy(PlaybackEngine *engine, guint tail, unsigned char *buf, size_t len)
+{
+    guint offset = tail & (engine->ring_size - 1);
+    size_t first = MIN(len, engine->ring_size - offset);
+
+    memcpy(buf, engine->ring + offset, first);
+    memcpy(buf + first, engine->ring, len - first);
+}
+
+static void
+playback_clock_set_origin(PlaybackEngine *engine, gint64 origin)
+{
+    guint seq = g_atomic_int_get(&engine->clock_seq);
+
+    // Odd while the halves are being replaced
+    g_atomic_int_set(&engine->clock_seq, seq + 1);
+    g_atomic_int_set(&engine->origin_hi, (gint)((guint64)origin >> 32));
+    g_atomic_int_set(&engine->origin_lo, (gint)((guint64)origin & 0xffffffff));
+    g_atomic_int_set(&engine->clock_seq, seq + 2);
+}
+
+static gint64
+playback_clock_get_origin(PlaybackEngine *engine)
+{
+    while (TRUE) {
+        guint seq = g_atomic_int_get(&engine->clock_seq);
+        guint hi = g_atomic_int_get(&engine->origin_hi);
+        guint lo = g_atomic_int_get(&engine->origin_lo);
+
+        if ((seq & 1) == 0 && (guint)g_atomic_int_get(&engine->clock_seq) == seq) {
+            return (gint64)(((guint64)hi << 32) | lo);
+        }
+    }
+}
+
+/* Frames the device has played at the monotonic time now */
+static guint
+playback_clock_get_frames(PlaybackEngine *engine, gint64 now)
+{
+    guint submitted = g_atomic_int_get(&engine->submitted_frames);
+
+    if (!audio_sink_is_realtime(engine->sink)) {
+        // Played as soon as it was written
+        return submitted;
+    }
+    gint64 origin = playback_clock_get_origin(engine);
+
+    if (origin == 0 || now <= origin) {
+        return 0;
+    }
+
+    guint64 frames = (guint64)(now - origin) * engine->sample_info.samplesPerSec / G_USEC_PER_SEC;
+
+    return MIN(frames, submitted);
+}
+
+static gpointer
+playback_output_thread(gpointer user_data)
+{
+    PlaybackEngine *engine = user_data;
+
+    // The reader fills the ring while the device is being opened
+    if (audio_sink_open(engine->sink, &engine->sample_info) != 0) {
+        audio_sink_close(engine->sink);
+        g_atomic_int_set(&engine->failed, TRUE);
+        g_atomic_int_set(&engine->stop, TRUE);
+        g_atomic_int_set(&engine->running, FALSE);
+        return NULL;
+    }
+
+    // Whole frames only, except for a truncated last one
+    size_t chunk_size = PLAYBACK_WRITE_SIZE - PLAYBACK_WRITE_SIZE % engine->frame_size;
+    unsigned char *buf = g_malloc(chunk_size);
+
+    gboolean realtime = audio_sink_is_realtime(engine->sink);
+
+    guint prefill = engine->ring_size / 4;
+    gboolean started = FALSE;
+    gboolean starved = FALSE;
+    gboolean finished = FALSE;
+    guint64 written = 0;
+    guint submitted = 0;
+
+    while (!g_atomic_int_get(&engine->stop)) {
+        // The head is final once eof is set, so read eof first
+        gboolean eof = g_atomic_int_get(&engine->eof);
+        guint tail = g_atomic_int_get(&engine->tail);
+        guint available = (guint)g_atomic_int_get(&engine->head) - tail;
+
+        if (!started && available < prefill && !eof) {
+            g_usleep(engine->wait_usec);
+            continue;
+        }
+
+        started = TRUE;
+
+        size_t len = MIN(available, chunk_size);
+        if (!eof) {
+            len -= len % engine->frame_size;
+        }
+
+        if (len == 0) {
+            if (eof) {
+                finished = TRUE;
+                break;
+            }
+
+            // Only audible if the device is waiting, too
+            if (!starved && realtime) {
+                starved = TRUE;
+                g_atomic_int_inc(&engine->underruns);
+                g_debug("Playback underrun at %lu", (unsigned long)(engine->start_pos + written));
+            }
+
+            g_usleep(engine->wait_usec);
+            continue;
+        }
+
+        starved = FALSE;
+
+        playback_ring_copy(engine, tail, buf, len);
+
+        // Hands the space back to the reader before blocking in the device
+        g_atomic_int_set(&engine->tail, tail + len);
+
+        // At the start and after an underrun the device has played everything
+        // it got, and starts on this chunk now -- or once it played out what
+        // an earlier, stopped play left in it; otherwise the clock runs on
+        gint64 now = g_get_monotonic_time();
+        if (playback_clock_get_frames(engine, now) >= submitted) {
+            gint64 start = MAX(now, audio_sink_get_drain_time(engine->sink));
+            playback_clock_set_origin(engine, start - (gint64)submitted * G_USEC_PER_SEC / engine->sample_info.samplesPerSec);
+        }
+
+        written += len;
+        submitted = written / engine->frame_size;
+        g_atomic_int_set(&engine->submitted_frames, submitted);
+
+        if (audio_sink_write(engine->sink, buf, len) != 0) {
+            g_atomic_int_set(&engine->failed, TRUE);
+            break;
+        }
+    }
+
+    // The device stays open and plays out what it has been given meanwhile
+    while (finished && !g_atomic_int_get(&engine->stop) &&
+            playback_clock_get_frames(engine, g_get_monotonic_time()) < submitted) {
+        g_usleep(PLAYBACK_WAIT_USEC);
+    }
+
+    audio_sink_close(engine->sink);
+    g_free(buf);
+
+    // The reader has no more reason to continue (device error, end of data)
+    g_atomic_int_set(&engine->stop, TRUE);
+    g_atomic_int_set(&engine->running, FALSE);
+
+    return NULL;
+}
+
+static PlaybackEngine *
+playback_engine_new(AudioSink *sink, const SampleInfo *sample_info, unsigned long start_pos, unsigned long end_pos)
+{
+    PlaybackEngine *engine = g_new0(PlaybackEngine, 1);
+
+    engine->sink = sink;
+    engine->wait_usec = audio_sink_is_realtime(sink) ? PLAYBACK_WAIT_USEC : PLAYBACK_WAIT_FAST_USEC;
+    engine->sample_info = *sample_info;
+    engine->start_pos = start_pos;
+    engine->end_pos = end_pos;
+    engine->frame_size = MAX(sample_info->blockAlign, 1);
+
+    uint64_t bytes_per_sec = (uint64_t)sample_info->samplesPerSec * engine->frame_size;
+    uint64_t wanted = bytes_per_sec * PLAYBACK_RING_MS / 1000;
+
+    engine->ring_size = PLAYBACK_READ_SIZE;
+    while (engine->ring_size < wanted) {
+        engine->ring_size <<= 1;
+    }
+
+    engine->ring = g_malloc(engine->ring_size);
+    engine->running = TRUE;
+
+    return engine;
+}
+
+static PlaybackEngine *
+playback_engine_run(PlaybackEngine *engine)
+{
+    engine->reader_thread = g_thread_new("play_reader", playback_reader_thread, engine);
+    engine->output_thread = g_thread_new("play_output", playback_output_thread, engine);
+
+    return engine;
+}
+
+PlaybackEngine *
+playback_engine_start(AudioSink *sink, OpenedAudioFile *file, unsigned long start_pos, unsigned long end_pos)
+{
+    PlaybackEngine *engine = playback_engine_new(sink, &file->sample_info, start_pos, end_pos);
+
+    engine->file = file;
+
+    return playback_engine_run(engine);
+}
+
+PlaybackEngine *
+playback_engine_start_data(AudioSink *sink, const SampleInfo *sample_info, GBytes *data, unsigned long start_pos)
+{
+    PlaybackEngine *engine = playback_engine_new(sink, sample_info, start_pos, 0);
+
+    engine->data = g_bytes_ref(data);
+
+    return playback_engine_run(engine);
+}
+
+gboolean
+playback_engine_is_running(PlaybackEngine *engine)
+{
+    return g_atomic_int_get(&engine->running);
+}
+
+gboolean
+playback_engine_has_failed(PlaybackEngine *engine)
+{
+    return g_atomic_int_get(&engine->failed);
+}
+
+unsigned long
+playback_engine_get_position(PlaybackEngine *engine)
+{
+    guint frames = playback_clock_get_frames(engine, g_get_monotonic_time());
+
+    return engine->start_pos + (unsigned long)frames * engine->frame_size;
+}
+
+guint
+playback_engine_get_latency(PlaybackEngine *engine)
+{
+    guint submitted = g_atomic_int_get(&engine->submitted_frames);
+    guint played = playback_clock_get_frames(engine, g_get_monotonic_time());
+
+    return (guint64)(submitted - played) * 1000 / MAX(engine->sample_info.samplesPerSec, 1);
+}
+
+guint
+playback_engine_get_underruns(PlaybackEngine *engine)
+{
+    return g_atomic_int_get(&engine->underruns);
+}
+
+void
+playback_engine_free(PlaybackEngine *engine)
+{
+    g_atomic_int_set(&engine->stop, TRUE);
+
+    g_thread_join(engine->output_thread);
+    g_thread_join(engine->reader_thread);
+
+    if (engine->data != NULL) {
+        g_bytes_unref(engine->data);
+    }
+
+    g_free(engine->ring);
+    g_free(engine);
+}
@@ -0,0 +1,83 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "format.h"
+#include "audio_sink.h"
+
+/**
+ * Playback engine
+ *
+ * A reader thread reads (or decodes) the file ahead into a ring buffer of
+ * about half a second, an output thread drains it to the audio device (an
+ * AudioSink, see audio_sink.h). The ring is single-producer/single-consumer
+ * and lock-free, so a slow read (a cold disk, a decoder seek, a busy export)
+ * is absorbed by the buffered audio instead of becoming a dropout, and a
+ * slow device never holds up the reader. Stop requests and the position are
+ * plain atomics.
+ *
+ * The position is what the device has played, not what was read or handed
+ * to it: the output thread anchors a clock at the sample rate whenever the
+ * device starts on new data (at the start, after an underrun), and readers
+ * interpolate it with the monotonic clock, capped at the frames submitted.
+ * It can be read lock-free as often as the display refreshes. Sinks that
+ * are not realtime (files, benchmarks) have played what they were given.
+ *
+ * All functions are called from one (control) thread.
+ **/
+
+typedef struct PlaybackEngine_ PlaybackEngine;
+
+/**
+ * Start playing file (used by the reader thread only until the engine is
+ * freed) from the PCM byte position start_pos to end_pos (0 = to its end)
+ * into sink, which is used by the output thread until then.
+ **/
+PlaybackEngine *
+playback_engine_start(AudioSink *sink, OpenedAudioFile *file, unsigned long start_pos, unsigned long end_pos);
+
+/* Start playing PCM data already in memory, which starts at start_pos */
+PlaybackEngine *
+playback_engine_start_data(AudioSink *sink, const SampleInfo *sample_info, GBytes *data, unsigned long start_pos);
+
+/* FALSE once everything was played, or the device failed */
+gboolean
+playback_engine_is_running(PlaybackEngine *engine);
+
+/* TRUE if playing ended because the device could not be opened or written to */
+gboolean
+playback_engine_has_failed(PlaybackEngine *engine);
+
+/* PCM byte position (on a frame boundary) of the audio being played now */
+unsigned long
+playback_engine_get_position(PlaybackEngine *engine);
+
+/* Audio handed to the device but not played yet, in milliseconds */
+guint
+playback_engine_get_latency(PlaybackEngine *engine);
+
+/* How often the device was waiting for the reader */
+guint
+playback_engine_get_underruns(PlaybackEngine *engine);
+
+/* Stop playing (if still running), join the threads and free the engine */
+void
+playback_engine_free(PlaybackEngine *engine);
@@ -0,0 +1,303 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "progress.h"
+
+/* Fixed-point scale of the fraction slot */
+#define PROGRESS_FRACTION_ONE (1 << 24)
+
+/* Events in flight, a power of two */
+#define PROGRESS_RING_SIZE 64
+
+/* Slots that item events leave free for errors and the final event */
+#define PROGRESS_RING_RESERVED 8
+
+struct ProgressChannel_ {
+    volatile gint ref_count;
+
+    progress_notify_func notify;
+    void *user_data;
+    GDestroyNotify destroy_user_data;
+
+    gint64 created;
+    gint min_interval_ms;
+    volatile gint last_notify_ms;
+
+    volatile gint fraction;
+    volatile gint pending; /* notified, the consumer has not polled yet */
+
+    // SPSC ring: head is only written by the producer, tail by the consumer
+    ProgressEvent ring[PROGRESS_RING_SIZE];
+    volatile gint head;
+    volatile gint tail;
+
+    // Errors and the final event that found the ring full: a stack pushed
+    // by the producer and taken as a whole by the consumer
+    volatile gpointer overflow;
+
+    // Consumer-side state
+    gint polled_fraction;
+    GList *overflow_pending; /* taken from overflow, oldest first */
+
+    // Only for progress_channel_wait(), never taken by the producer otherwise
+    GMutex wait_mutex;
+    GCond wait_cond;
+};
+
+ProgressChannel *
+progress_channel_new(guint min_interval_ms, progress_notify_func notify, void *user_data, GDestroyNotify destroy_user_data)
+{
+    ProgressChannel *channel = g_new0(ProgressChannel, 1);
+
+    channel->ref_count = 1;
+    channel->notify = notify;
+    channel->user_data = user_data;
+    channel->destroy_user_data = destroy_user_data;
+
+    channel->created = g_get_monotonic_time();
+    channel->min_interval_ms = min_interval_ms;
+    channel->last_notify_ms = -(gint)min_interval_ms;
+
+    g_mutex_init(&channel->wait_mutex);
+    g_cond_init(&channel->wait_cond);
+
+    return channel;
+}
+
+ProgressChannel *
+progress_channel_ref(ProgressChannel *channel)
+{
+    g_atomic_int_inc(&channel->ref_count);
+
+    return channel;
+}
+
+void
+progress_channel_unref(ProgressChannel *channel)
+{
+    if (!g_atomic_int_dec_and_test(&channel->ref_count)) {
+        return;
+    }
+
+    ProgressEvent event;
+    while (progress_channel_pop(channel, &event)) {
+        progress_event_clear(&event);
+    }
+
+    if (channel->destroy_user_data != NULL) {
+        channel->destroy_user_data(channel->user_data);
+    }
+
+    g_cond_clear(&channel->wait_cond);
+    g_mutex_clear(&channel->wait_mutex);
+
+    g_free(channel);
+}
+
+void *
+progress_channel_get_user_data(ProgressChannel *channel)
+{
+    return channel->user_data;
+}
+
+static void
+progress_channel_notify(ProgressChannel *channel, gboolean rate_limited)
+{
+    // Already notified, the consumer reads the latest state anyway
+    if (g_atomic_int_get(&channel->pending)) {
+        return;
+    }
+
+    gint now_ms = (g_get_monotonic_time() - channel->created) / 1000;
+    if (rate_limited && now_ms - g_atomic_int_get(&channel->last_notify_ms) < channel->min_interval_ms) {
+        return;
+    }
+
+    if (!g_atomic_int_compare_and_exchange(&channel->pending, FALSE, TRUE)) {
+        return;
+    }
+
+    g_atomic_int_set(&channel->last_notify_ms, now_ms);
+
+    if (channel->notify != NULL) {
+        channel->notify(channel, channel->user_data);
+    } else {
+        g_mutex_lock(&channel->wait_mutex);
+        g_cond_broadcast(&channel->wait_cond);
+        g_mutex_unlock(&channel->wait_mutex);
+    }
+}
+
+void
+progress_channel_set_fraction(ProgressChannel *channel, double fraction)
+{
+    gint value = CLAMP(fraction, 0.0, 1.0) * PROGRESS_FRACTION_ONE;
+
+    // Workers racing each other must not move the fraction backwards
+    gint old;
+    do {
+        old = g_atomic_int_get(&channel->fraction);
+        if (value <= old) {
+            return;
+        }
+    } while (!g_atomic_int_compare_and_exchange(&channel->fraction, old, value));
+
+    // The final value is never held back by the rate limit
+    progress_channel_notify(channel, value < PROGRESS_FRACTION_ONE);
+}
+
+static void
+progress_channel_push_overflow(ProgressChannel *channel, const ProgressEvent *event)
+{
+    ProgressEvent *queued = g_new(ProgressEvent, 1);
+    *queued = *event;
+
+    GList *node = g_list_prepend(NULL, queued);
+
+    do {
+        node->next = g_atomic_pointer_get(&channel->overflow);
+    } while (!g_atomic_pointer_compare_and_exchange(&channel->overflow, node->next, node));
+}
+
+void
+progress_channel_post(ProgressChannel *channel, enum ProgressEventType type, guint position, guint done, guint total, const char *text)
+{
+    gboolean important = (type == PROGRESS_EVENT_ERROR || type == PROGRESS_EVENT_FINISHED);
+
+    guint head = g_atomic_int_get(&channel->head);
+    guint used = head - (guint)g_atomic_int_get(&channel->tail);
+
+    // Once something overflowed, later events must not overtake it in the ring
+    gboolean overflowing = (g_atomic_pointer_get(&channel->overflow) != NULL);
+
+    if (!important && (overflowing || used >= PROGRESS_RING_SIZE - PROGRESS_RING_RESERVED)) {
+        // The consumer is behind: drop the item event, the next one carries
+        // the current counts anyway
+        progress_channel_notify(channel, FALSE);
+        return;
+    }
+
+    ProgressEvent event = {
+        .type = type,
+        .position = position,
+        .done = done,
+        .total = total,
+        .text = g_strdup(text),
+    };
+
+    if (overflowing || used >= PROGRESS_RING_SIZE) {
+        progress_channel_push_overflow(channel, &event);
+    } else {
+        channel->ring[head % PROGRESS_RING_SIZE] = event;
+
+        // Publishes the slot contents together with the new head
+        g_atomic_int_set(&channel->head, head + 1);
+    }
+
+    progress_channel_notify(channel, FALSE);
+}
+
+gboolean
+progress_channel_poll(ProgressChannel *channel)
+{
+    gboolean changed = g_atomic_int_compare_and_exchange(&channel->pending, TRUE, FALSE);
+
+    // Rate-limited updates don't notify, but are visible here
+    gint fraction = g_atomic_int_get(&channel->fraction);
+    if (fraction != channel->polled_fraction) {
+        channel->polled_fraction = fraction;
+        changed = TRUE;
+    }
+
+    return changed;
+}
+
+void
+progress_channel_wait(ProgressChannel *channel)
+{
+    g_mutex_lock(&channel->wait_mutex);
+    while (!g_atomic_int_get(&channel->pending)) {
+        g_cond_wait(&channel->wait_cond, &channel->wait_mutex);
+    }
+    g_mutex_unlock(&channel->wait_mutex);
+
+    progress_channel_poll(channel);
+}
+
+double
+progress_channel_get_fraction(ProgressChannel *channel)
+{
+    return (double)g_atomic_int_get(&channel->fraction) / PROGRESS_FRACTION_ONE;
+}
+
+static gboolean
+progress_channel_pop_overflow(ProgressChannel *channel, ProgressEvent *event)
+{
+    if (channel->overflow_pending == NULL) {
+        GList *taken;
+        do {
+            taken = g_atomic_pointer_get(&channel->overflow);
+        } while (!g_atomic_pointer_compare_and_exchange(&channel->overflow, taken, NULL));
+
+        // Only the next links of the stack are valid, rebuild it oldest first
+        for (GList *l = taken; l != NULL; l = l->next) {
+            channel->overflow_pending = g_list_prepend(channel->overflow_pending, l->data);
+        }
+        g_list_free(taken);
+    }
+
+    if (channel->overflow_pending == NULL) {
+        return FALSE;
+    }
+
+    ProgressEvent *queued = channel->overflow_pending->data;
+    channel->overflow_pending = g_list_delete_link(channel->overflow_pending, channel->overflow_pending);
+
+    *event = *queued;
+    g_free(queued);
+
+    return TRUE;
+}
+
+gboolean
+progress_channel_pop(ProgressChannel *channel, ProgressEvent *event)
+{
+    // Anything taken from the overflow is older than what the ring holds now
+    if (channel->overflow_pending != NULL) {
+        return progress_channel_pop_overflow(channel, event);
+    }
+
+    guint tail = g_atomic_int_get(&channel->tail);
+
+    if (tail == (guint)g_atomic_int_get(&channel->head)) {
+        return progress_channel_pop_overflow(channel, event);
+    }
+
+    *event = channel->ring[tail % PROGRESS_RING_SIZE];
+
+    // Hands the slot back to the producer
+    g_atomic_int_set(&channel->tail, tail + 1);
+
+    return TRUE;
+}
+
+void
+progress_event_clear(ProgressEvent *event)
+{
+    g_free(g_steal_pointer(&event->text));
+}
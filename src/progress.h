@@ -0,0 +1,114 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/**
+ * Progress reporting from worker threads
+ *
+ * A channel carries the overall progress of a long-running operation
+ * (split, merge, analysis) from its worker threads to one consumer, usually
+ * the UI. The fraction lives in an atomic slot: updating it is a single
+ * compare-and-swap, it never moves backwards, and the consumer is notified
+ * at most once per min_interval_ms (but always for the final value).
+ * Discrete events (a track was started, an error) go through a fixed-size
+ * single-producer/single-consumer ring; they always notify the consumer.
+ * Producers never wait: when the consumer falls behind, item events are
+ * dropped, errors and the final event are kept on an overflow list. No
+ * lock is shared between producer and consumer.
+ *
+ * The consumer is notified once, then not again until it has called
+ * progress_channel_poll() -- which it does before reading, so no update is
+ * ever missed. The notify function runs on the producer thread and must
+ * only schedule the actual work (e.g. with g_idle_add()). Without one,
+ * the consumer blocks in progress_channel_wait() instead.
+ **/
+
+typedef struct ProgressChannel_ ProgressChannel;
+
+enum ProgressEventType {
+    PROGRESS_EVENT_ITEM_STARTED,  /* position, total, text = item name */
+    PROGRESS_EVENT_ITEM_FINISHED, /* position, total, text = item name */
+    PROGRESS_EVENT_ERROR,         /* text = message */
+    PROGRESS_EVENT_FINISHED,      /* the last event posted to a channel */
+};
+
+typedef struct ProgressEvent_ ProgressEvent;
+struct ProgressEvent_ {
+    enum ProgressEventType type;
+    guint position; /* item number, starting at 1 */
+    guint done;     /* items finished (or skipped) so far */
+    guint total;    /* number of items */
+    gchar *text;    /* owned by the event, see progress_event_clear() */
+};
+
+typedef void (*progress_notify_func)(ProgressChannel *channel, void *user_data);
+
+/**
+ * Create a channel (with a reference held by the caller). notify may be
+ * NULL, destroy_user_data is called on user_data when the last reference
+ * is dropped.
+ **/
+ProgressChannel *
+progress_channel_new(guint min_interval_ms, progress_notify_func notify, void *user_data, GDestroyNotify destroy_user_data);
+
+ProgressChannel *
+progress_channel_ref(ProgressChannel *channel);
+
+void
+progress_channel_unref(ProgressChannel *channel);
+
+void *
+progress_channel_get_user_data(ProgressChannel *channel);
+
+/* Producer: publish the overall progress (0..1), lower values are ignored */
+void
+progress_channel_set_fraction(ProgressChannel *channel, double fraction);
+
+/**
+ * Producer: queue an event (text is copied), never blocks. The ring is
+ * single-producer, several producer threads must serialize their calls.
+ * ITEM_STARTED and ITEM_FINISHED are dropped if the consumer is behind,
+ * ERROR and FINISHED are always delivered.
+ **/
+void
+progress_channel_post(ProgressChannel *channel, enum ProgressEventType type, guint position, guint done, guint total, const char *text);
+
+/**
+ * Consumer: re-arm the notification; returns TRUE if anything was published
+ * since the previous call.
+ **/
+gboolean
+progress_channel_poll(ProgressChannel *channel);
+
+/* Consumer: block until something was published, then re-arm (no notify function only) */
+void
+progress_channel_wait(ProgressChannel *channel);
+
+/* Consumer (or anyone): the latest fraction */
+double
+progress_channel_get_fraction(ProgressChannel *channel);
+
+/* Consumer: take the oldest queued event, FALSE if there is none */
+gboolean
+progress_channel_pop(ProgressChannel *channel, ProgressEvent *event);
+
+void
+progress_event_clear(ProgressEvent *event);
@@ -28,12 +28,20 @@
 #include <limits.h>
 #include <stdint.h>
 
-#include "aoaudio.h"
+#include <glib/gstdio.h>
 
 #include "sample_info.h"
 #include "track_break.h"
 
 #include "format.h"
+#include "analysis.h"
+#include "analysis_kernels.h"
+#include "peakcache.h"
+#include "export_plan.h"
+#include "playback.h"
+#include "audio_sink.h"
+#include "audition.h"
+#include "aoaudio.h"
 #include "gettext.h"
 
 typedef struct WriteThreadData_ WriteThreadData;
@@ -43,6 +51,7 @@ struct WriteThreadData_ {
     TrackBreakList *list;
     WriteStatusCallbacks *callbacks;
     const char *outputdir;
+    WriteOptions options;
 };
 
 struct Sample_ {
@@ -53,19 +62,30 @@ struct Sample_ {
     gchar *basename_without_extension;
 
     GMutex load_mutex;
-    gboolean loaded;
+    volatile gint loaded;
+    ProgressChannel *load_progress;
     GraphData graph_data;
-    double load_percentage;
+    AnalysisStats analysis_stats;
+    AnalysisControl analysis_control;
+    PeakCache *peak_cache;
+    GThread *open_thread;
+
+    OpenedAudioFile *play_file;
+    PlaybackEngine *play_engine;
+    gulong play_marker; /* where the last playback stopped */
+    guint play_underruns; /* of the last playback */
+    gboolean play_failed; /* the last playback ended because the device failed */
 
-    GThread *play_thread;
-    GMutex play_mutex;
-    gboolean playing;
-    gboolean kill_play_thread;
-    gulong play_position;
-    unsigned long play_start_position;
+    AudioSink *audio_sink; /* set by the caller, or NULL */
+    AudioSink *default_audio_sink; /* created on first play if there is none */
+
+    OpenedAudioFile *audition_file;
+    Audition *audition;
 
     GMutex write_mutex;
     gboolean writing;
+    volatile gint write_cancelled;
+    GThread *write_thread;
 
     WriteThreadData write_thread_data;
 };
@@ -74,119 +94,103 @@ struct Sample_ {
 static void
 sample_max_min(Sample *sample);
 
-static long
-read_sample(OpenedAudioFile *oaf, unsigned char *buf, int buf_size, unsigned long start_pos)
+static void
+sample_set_loaded(Sample *sample)
 {
-    if (oaf != NULL) {
-        return format_read_samples(oaf, buf, buf_size, start_pos);
+    progress_channel_set_fraction(sample->load_progress, 1.0);
+    g_atomic_int_set(&sample->loaded, TRUE);
+    progress_channel_post(sample->load_progress, PROGRESS_EVENT_FINISHED, 0, 0, 0, NULL);
+}
+
+/**
+ * Handle for a thread reading concurrently with the analysis. Reads from
+ * random access formats are positional and can share the opened file,
+ * compressed formats get a decoder of their own.
+ **/
+static OpenedAudioFile *
+sample_open_reader(Sample *sample, char **error_message)
+{
+    if (sample->opened_audio_file->mod->random_access) {
+        return sample->opened_audio_file;
     }
 
-    return -1;
+    return format_reopen_file(sample->opened_audio_file, error_message);
+}
+
+static void
+sample_close_reader(Sample *sample, OpenedAudioFile *reader)
+{
+    if (reader != NULL && reader != sample->opened_audio_file) {
+        format_close_file(reader);
+    }
 }
 
 void sample_init()
 {
     format_init();
+    analysis_kernels_init();
 }
 
-static gpointer
-play_thread(gpointer thread_data)
+void sample_shutdown()
 {
-    Sample *sample = thread_data;
-
-    int read_ret = 0;
-    int i;
+    ao_audio_shutdown();
+}
 
-    unsigned char *devbuf;
+gboolean
+sample_is_playing(Sample *sample)
+{
+    return sample->play_engine != NULL && playback_engine_is_running(sample->play_engine);
+}
 
-    /*
-    printf("play_thread: calling open_audio_device\n");
-    */
-    if (ao_audio_open_device(&sample->opened_audio_file->sample_info) != 0) {
-        g_mutex_lock(&sample->play_mutex);
-        sample->playing = FALSE;
-        ao_audio_close_device();
-        g_mutex_unlock(&sample->play_mutex);
-        //printf("play_thread: return from open_audio_device != 0\n");
-        return NULL;
+gboolean
+sample_play_has_failed(Sample *sample)
+{
+    if (sample->play_engine == NULL) {
+        return sample->play_failed;
     }
-    //printf("play_thread: return from open_audio_device\n");
 
-    i = 0;
+    return playback_engine_has_failed(sample->play_engine);
+}
 
-    devbuf = malloc(DEFAULT_BUF_SIZE);
-    if (devbuf == NULL) {
-        g_mutex_lock(&sample->play_mutex);
-        sample->playing = FALSE;
-        ao_audio_close_device();
-        g_mutex_unlock(&sample->play_mutex);
-        printf("play_thread: out of memory\n");
-        return NULL;
+gulong
+sample_get_play_marker(Sample *sample)
+{
+    if (sample->play_engine == NULL) {
+        return sample->play_marker;
     }
 
-    read_ret = read_sample(sample->opened_audio_file, devbuf, DEFAULT_BUF_SIZE, sample->play_start_position + (DEFAULT_BUF_SIZE * i++));
-
-    while (read_ret > 0 && read_ret <= DEFAULT_BUF_SIZE) {
-        /*
-        if (read_ret < 0) {
-            printf("read_ret: %d\n", read_ret);
-        }
-        */
-
-        ao_audio_write(devbuf, read_ret);
-
-        if (g_mutex_trylock(&sample->play_mutex)) {
-            if (sample->kill_play_thread) {
-                ao_audio_close_device();
-                sample->playing = FALSE;
-                sample->kill_play_thread = FALSE;
-                g_mutex_unlock(&sample->play_mutex);
-                return NULL;
-            }
-            g_mutex_unlock(&sample->play_mutex);
-        }
-
-        read_ret = read_sample(sample->opened_audio_file, devbuf, DEFAULT_BUF_SIZE, sample->play_start_position + (DEFAULT_BUF_SIZE * i++));
-
-        g_mutex_lock(&sample->play_mutex);
-
-        sample->play_position = ((DEFAULT_BUF_SIZE * i) + sample->play_start_position) / sample->opened_audio_file->sample_info.blockSize;
+    return playback_engine_get_position(sample->play_engine) / sample->opened_audio_file->sample_info.blockSize;
+}
 
-        g_mutex_unlock(&sample->play_mutex);
+guint
+sample_get_play_underruns(Sample *sample)
+{
+    if (sample->play_engine == NULL) {
+        return sample->play_underruns;
     }
 
-    g_mutex_lock(&sample->play_mutex);
-
-    ao_audio_close_device();
-    sample->playing = FALSE;
-
-    g_mutex_unlock(&sample->play_mutex);
-
-    return NULL;
+    return playback_engine_get_underruns(sample->play_engine);
 }
 
-gboolean
-sample_is_playing(Sample *sample)
+void
+sample_set_audio_sink(Sample *sample, AudioSink *sink)
 {
-    gboolean result;
-
-    g_mutex_lock(&sample->play_mutex);
-    result = sample->playing;
-    g_mutex_unlock(&sample->play_mutex);
-
-    return result;
+    sample_stop(sample);
+    sample->audio_sink = sink;
 }
 
-gulong
-sample_get_play_marker(Sample *sample)
+static AudioSink *
+sample_get_audio_sink(Sample *sample)
 {
-    gulong result;
+    if (sample->audio_sink != NULL) {
+        return sample->audio_sink;
+    }
 
-    g_mutex_lock(&sample->play_mutex);
-    result = sample->play_position;
-    g_mutex_unlock(&sample->play_mutex);
+    if (sample->default_audio_sink == NULL) {
+        sample->default_audio_sink = audio_sink_new("ao", NULL);
+    }
 
-    return result;
+    return sample->default_audio_sink;
 }
 
 gboolean
@@ -204,45 +208,136 @@ sample_is_writing(Sample *sample)
 int
 sample_play(Sample *sample, gulong startpos)
 {
-    g_mutex_lock(&sample->play_mutex);
-    if (sample->playing) {
-        g_mutex_unlock(&sample->play_mutex);
+    if (sample_is_playing(sample)) {
         return 2;
     }
 
     if (sample->opened_audio_file == NULL) {
-        g_mutex_unlock(&sample->play_mutex);
         return 3;
     }
 
-    sample->playing = TRUE;
-    sample->play_start_position = startpos * sample->opened_audio_file->sample_info.blockSize;
-
-    /* setup thread */
+    if (sample->play_engine != NULL) {
+        // Reap the previous playback, which has already finished
+        playback_engine_free(g_steal_pointer(&sample->play_engine));
+    }
 
-    sample->play_position = startpos;
+    if (sample->play_file == NULL) {
+        char *error_message = NULL;
+        sample->play_file = sample_open_reader(sample, &error_message);
+        if (sample->play_file == NULL) {
+            g_warning("Could not open file for playback: %s", error_message);
+            g_free(error_message);
+            return 3;
+        }
+    }
 
-    sample->play_thread = g_thread_new("play_sample", play_thread, sample);
+    sample->play_engine = playback_engine_start(sample_get_audio_sink(sample), sample->play_file, startpos * sample->opened_audio_file->sample_info.blockSize, 0);
 
-    g_mutex_unlock(&sample->play_mutex);
     return 0;
 }
 
 void
 sample_stop(Sample *sample)
 {
-    g_mutex_lock(&sample->play_mutex);
+    if (sample->play_engine != NULL) {
+        sample->play_marker = sample_get_play_marker(sample);
+        sample->play_underruns = playback_engine_get_underruns(sample->play_engine);
+        sample->play_failed = playback_engine_has_failed(sample->play_engine);
+        playback_engine_free(g_steal_pointer(&sample->play_engine));
+    }
+}
 
-    if (!sample->playing) {
-        g_mutex_unlock(&sample->play_mutex);
-        return;
+/* Bytes played before and after a break when auditioning */
+static unsigned long
+sample_audition_context(Sample *sample, guint context_blocks)
+{
+    return (unsigned long)context_blocks * sample->opened_audio_file->sample_info.blockSize;
+}
+
+void
+sample_audition_prefetch(Sample *sample, const gulong *offsets, guint n, guint context_blocks)
+{
+    unsigned long context = sample_audition_context(sample, context_blocks);
+
+    if (sample->audition != NULL && audition_get_context(sample->audition) != context) {
+        audition_free(g_steal_pointer(&sample->audition));
     }
 
-    sample->kill_play_thread = TRUE;
-    g_mutex_unlock(&sample->play_mutex);
+    if (sample->audition == NULL) {
+        if (sample->audition_file == NULL) {
+            char *error_message = NULL;
+            sample->audition_file = sample_open_reader(sample, &error_message);
+            if (sample->audition_file == NULL) {
+                // Transitions are played from the file instead
+                g_warning("Could not open file for prefetching: %s", error_message);
+                g_free(error_message);
+                return;
+            }
+        }
+
+        sample->audition = audition_new(sample->audition_file, context);
+    }
 
-    // Wait for play thread to actually quit
-    g_thread_join(g_steal_pointer(&sample->play_thread));
+    unsigned long positions[AUDITION_MAX_REGIONS];
+    n = MIN(n, AUDITION_MAX_REGIONS);
+    for (guint i = 0; i < n; i++) {
+        positions[i] = offsets[i] * sample->opened_audio_file->sample_info.blockSize;
+    }
+
+    audition_set_queue(sample->audition, positions, n);
+}
+
+int
+sample_play_transition(Sample *sample, gulong offset, guint context_blocks)
+{
+    if (sample->opened_audio_file == NULL) {
+        return 3;
+    }
+
+    if (sample->play_engine != NULL) {
+        sample_stop(sample);
+    }
+
+    const SampleInfo *sample_info = &sample->opened_audio_file->sample_info;
+    unsigned long context = sample_audition_context(sample, context_blocks);
+    unsigned long position = offset * sample_info->blockSize;
+
+    if (sample->audition != NULL && audition_get_context(sample->audition) == context) {
+        unsigned long start_pos = 0;
+        GBytes *data = audition_get_region(sample->audition, position, &start_pos);
+
+        if (data != NULL) {
+            sample->play_engine = playback_engine_start_data(sample_get_audio_sink(sample), sample_info, data, start_pos);
+            g_bytes_unref(data);
+            return 0;
+        }
+    }
+
+    // Not prefetched (yet), read it from the file
+    if (sample->play_file == NULL) {
+        char *error_message = NULL;
+        sample->play_file = sample_open_reader(sample, &error_message);
+        if (sample->play_file == NULL) {
+            g_warning("Could not open file for playback: %s", error_message);
+            g_free(error_message);
+            return 3;
+        }
+    }
+
+    unsigned long end_pos = MIN(position + context, sample_info->numBytes);
+    sample->play_engine = playback_engine_start(sample_get_audio_sink(sample), sample->play_file, position - MIN(position, context), end_pos);
+
+    return 0;
+}
+
+void
+sample_audition_end(Sample *sample)
+{
+    if (sample->audition != NULL) {
+        audition_free(g_steal_pointer(&sample->audition));
+    }
+
+    sample_close_reader(sample, g_steal_pointer(&sample->audition_file));
 }
 
 static gpointer
@@ -256,11 +351,11 @@ open_thread(gpointer data)
 }
 
 Sample *
-sample_open(const char *filename, char **error_message)
+sample_open(const char *filename, ProgressChannel *load_progress, char **error_message)
 {
     Sample *sample = g_new0(Sample, 1);
 
-    sample->opened_audio_file = format_open_file(filename, error_message);
+    sample->opened_audio_file = format_open_file(filename, FORMAT_OPEN_DEFAULT, error_message);
     if (sample->opened_audio_file == NULL) {
         g_free(sample);
         g_message("Could not open %s with format_open_file(): %s", filename, *error_message);
@@ -282,11 +377,31 @@ sample_open(const char *filename, char **error_message)
     sample->basename_without_extension = tmp;
 
     g_mutex_init(&sample->load_mutex);
-    g_mutex_init(&sample->play_mutex);
     g_mutex_init(&sample->write_mutex);
+    analysis_control_init(&sample->analysis_control);
+
+    // Without a consumer, the channel only backs sample_get_load_percentage()
+    sample->load_progress = (load_progress != NULL) ? progress_channel_ref(load_progress) : progress_channel_new(0, NULL, NULL, NULL);
 
-    // TODO: Capture thread and properly tear it down - if needed - in sample_close()
-    g_thread_unref(g_thread_new("open file", open_thread, sample));
+    char *cache_error_message = NULL;
+    sample->peak_cache = peakcache_open(sample->opened_audio_file, &sample->graph_data, &cache_error_message);
+    if (sample->peak_cache != NULL) {
+        analysis_build_pyramid(&sample->graph_data);
+
+        sample->analysis_stats.from_cache = TRUE;
+        sample_set_loaded(sample);
+    } else {
+        g_debug("Analyzing %s: %s", filename, cache_error_message);
+        g_free(cache_error_message);
+
+        if (!analysis_prepare(sample->opened_audio_file, &sample->graph_data)) {
+            format_module_set_error_message(error_message, "Could not allocate waveform data");
+            sample_close(sample);
+            return NULL;
+        }
+
+        sample->open_thread = g_thread_new("open file", open_thread, sample);
+    }
 
     return sample;
 }
@@ -300,15 +415,8 @@ sample_print_file_info(Sample *sample)
 GraphData *
 sample_get_graph_data(Sample *sample)
 {
-    GraphData *result = NULL;
-
-    g_mutex_lock(&sample->load_mutex);
-    if (sample->loaded) {
-        result = &sample->graph_data;
-    }
-    g_mutex_unlock(&sample->load_mutex);
-
-    return result;
+    // Readers must only look at the first analysis_get_valid_blocks() entries
+    return &sample->graph_data;
 }
 
 unsigned long
@@ -320,10 +428,43 @@ sample_get_num_sample_blocks(Sample *sample)
 void
 sample_close(Sample *sample)
 {
+    // Stop all threads still using the sample before tearing it down
+    sample_stop(sample);
+    sample_audition_end(sample);
+
+    analysis_control_cancel(&sample->analysis_control);
+    if (sample->open_thread != NULL) {
+        g_thread_join(g_steal_pointer(&sample->open_thread));
+    }
+
+    g_atomic_int_set(&sample->write_cancelled, TRUE);
+    if (sample->write_thread != NULL) {
+        g_thread_join(g_steal_pointer(&sample->write_thread));
+    }
+
     g_free(sample->basename_without_extension);
     g_free(sample->filename_basename);
     g_free(sample->filename_dirname);
 
+    if (sample->peak_cache != NULL) {
+        // data belongs to the mapping
+        sample->graph_data.data = NULL;
+    }
+
+    analysis_free(&sample->graph_data);
+    analysis_control_clear(&sample->analysis_control);
+    progress_channel_unref(g_steal_pointer(&sample->load_progress));
+
+    if (sample->peak_cache != NULL) {
+        peakcache_close(g_steal_pointer(&sample->peak_cache));
+    }
+
+    sample_close_reader(sample, g_steal_pointer(&sample->play_file));
+
+    if (sample->default_audio_sink != NULL) {
+        audio_sink_free(g_steal_pointer(&sample->default_audio_sink));
+    }
+
     if (sample->opened_audio_file != NULL) {
         format_close_file(g_steal_pointer(&sample->opened_audio_file));
     }
@@ -334,25 +475,27 @@ sample_close(Sample *sample)
 gboolean
 sample_is_loaded(Sample *sample)
 {
-    gboolean result;
-
-    g_mutex_lock(&sample->load_mutex);
-    result = sample->loaded;
-    g_mutex_unlock(&sample->load_mutex);
-
-    return result;
+    return g_atomic_int_get(&sample->loaded);
 }
 
 double
 sample_get_load_percentage(Sample *sample)
 {
-    double result;
+    return progress_channel_get_fraction(sample->load_progress);
+}
 
+void
+sample_set_analysis_focus(Sample *sample, unsigned long first, unsigned long count)
+{
+    analysis_control_set_focus(&sample->analysis_control, first, count);
+}
+
+void
+sample_get_analysis_stats(Sample *sample, AnalysisStats *stats)
+{
     g_mutex_lock(&sample->load_mutex);
-    result = sample->load_percentage;
+    *stats = sample->analysis_stats;
     g_mutex_unlock(&sample->load_mutex);
-
-    return result;
 }
 
 uint64_t
@@ -385,240 +528,613 @@ sample_get_basename_without_extension(Sample *sample)
     return sample->basename_without_extension;
 }
 
+static void
+sample_max_min_progress(unsigned long blocks_done, unsigned long blocks_total, void *user_data)
+{
+    Sample *sample = user_data;
+
+    // Called by all analysis workers, for every chunk
+    progress_channel_set_fraction(sample->load_progress, (double)blocks_done / blocks_total);
+}
+
 static void
 sample_max_min(Sample *sample)
 {
-    GraphData *graphData = &sample->graph_data;
-
-    SampleInfo *sample_info = &sample->opened_audio_file->sample_info;
-    int tmp = 0;
-    long int ret = 0;
-    int min, max, xtmp;
-    int min_sample, max_sample;
-    long int i, k;
-    long int numSampleBlocks;
-    long int tmp_sample_calc;
-    unsigned char devbuf[sample->opened_audio_file->sample_info.blockSize];
-    Points *graph_data;
-
-    tmp_sample_calc = sample_info->numBytes;
-    tmp_sample_calc = tmp_sample_calc / sample_info->blockSize;
-    numSampleBlocks = (tmp_sample_calc + 1);
-
-    /* DEBUG CODE START */
-    /*
-    printf("\nsample_info->numBytes: %lu\n", sample_info->numBytes);
-    printf("sample_info->bitsPerSample: %d\n", sample_info->bitsPerSample);
-    printf("sample_info->blockSize: %d\n", sample_info->blockSize);
-    printf("sample_info->channels: %d\n", sample_info->channels);
-    printf("numSampleBlocks: %d\n\n", numSampleBlocks);
-    */
-    /* DEBUG CODE END */
-
-    graph_data = (Points *)malloc(numSampleBlocks * sizeof(Points));
-
-    if (graph_data == NULL) {
-        printf("NULL returned from malloc of graph_data\n");
+    AnalysisStats stats;
+
+    if (!analysis_run(sample->opened_audio_file, &sample->graph_data, &sample->analysis_control, sample_max_min_progress, sample, &stats)) {
+        // Cancelled by sample_close(), the partial result must not be cached
         return;
     }
 
-    i = 0;
-
-    ret = read_sample(sample->opened_audio_file, devbuf, sample_info->blockSize, sample_info->blockSize * i);
-
-    min_sample = SHRT_MAX; /* highest value for 16-bit samples */
-    max_sample = 0;
-
-    while (ret == sample_info->blockSize && i < numSampleBlocks) {
-        min = max = 0;
-        for (k = 0; k < ret; k++) {
-            if (sample_info->bitsPerSample == 8) {
-                tmp = devbuf[k];
-                tmp -= 128;
-            } else if (sample_info->bitsPerSample == 16) {
-                tmp = (char)devbuf[k+1] << 8 | (char)devbuf[k];
-                k++;
-	    } else if (sample_info->bitsPerSample == 24) {
-		tmp   = ((char)devbuf[k]) | ((char)devbuf[k+1] << 8);
-		tmp  &= 0x0000ffff;
-		xtmp  =  (char)devbuf[k+2] << 16;
-		tmp  |= xtmp;
-		k += 2;
-            }
+    g_mutex_lock(&sample->load_mutex);
+    sample->analysis_stats = stats;
+    g_mutex_unlock(&sample->load_mutex);
 
-            if (tmp > max) {
-                max = tmp;
-            } else if (tmp < min) {
-                min = tmp;
-            }
+    sample_set_loaded(sample);
+
+    char *error_message = NULL;
+    if (!peakcache_write(sample->opened_audio_file, &sample->graph_data, &error_message)) {
+        g_warning("Could not write peak cache: %s", error_message);
+        g_free(error_message);
+    }
+}
+
+static gboolean
+write_is_cancelled(Sample *sample)
+{
+    WriteStatusCallbacks *callbacks = sample->write_thread_data.callbacks;
+
+    return g_atomic_int_get(&sample->write_cancelled) || callbacks->is_cancelled(callbacks->user_data);
+}
+
+typedef struct WriteJob_ WriteJob;
+
+typedef struct WriteTask_ WriteTask;
+struct WriteTask_ {
+    WriteJob *job;
+    ExportPlanEntry *entry;
+
+    guint position;
+    gchar *filename;
+    unsigned long start_pos;
+    unsigned long end_pos;
+
+    gint progress; /* WRITE_PROGRESS_ONE units, only touched by the writing thread */
+    gboolean started;
+    gboolean finished;
+};
+
+/**
+ * Tracks are written by a pool of workers, each with its own read handle.
+ * Progress updates are lock-free; the mutex only serializes claiming tasks
+ * and posting events (the progress ring has a single producer).
+ **/
+struct WriteJob_ {
+    Sample *sample;
+    WriteStatusCallbacks *callbacks;
+    ProgressChannel *progress;
+
+    GMutex mutex;
+    WriteTask *tasks;
+    guint num_tasks;
+    guint next_task;
+
+    enum OutputCodec codec;
+    enum FormatWritePolicy write_policy;
+    gboolean rewrite_all;
+
+    guint total;              /* enabled tracks, including skipped ones */
+    volatile gint finished;   /* written, failed or skipped tracks */
+    volatile gint done;       /* finished * WRITE_PROGRESS_ONE + progress of running tasks */
+};
+
+/* Fixed-point scale of the per-track progress */
+#define WRITE_PROGRESS_ONE 10000
+
+/**
+ * Add delta to the overall progress and publish it, called by the workers
+ * without any lock. Both parts of the progress live in one counter, so a
+ * track moving from running to finished is never counted twice or not at
+ * all.
+ **/
+static void
+write_job_report(WriteJob *job, gint delta)
+{
+    gint done = g_atomic_int_add(&job->done, delta) + delta;
+
+    progress_channel_set_fraction(job->progress, (double)done / ((gint64)MAX(job->total, 1) * WRITE_PROGRESS_ONE));
+}
+
+/* Called with job->mutex held */
+static void
+write_job_post(WriteJob *job, WriteTask *task, enum ProgressEventType type)
+{
+    progress_channel_post(job->progress, type, task->position, g_atomic_int_get(&job->finished), job->total, task->filename);
+}
+
+static void
+write_task_set_percentage(WriteTask *task, double percentage, gboolean finished)
+{
+    WriteJob *job = task->job;
+
+    gint progress = percentage * WRITE_PROGRESS_ONE;
+
+    if (finished) {
+        g_atomic_int_add(&job->finished, 1);
+        write_job_report(job, WRITE_PROGRESS_ONE - task->progress);
+        task->progress = 0;
+        task->finished = TRUE;
+
+        g_mutex_lock(&job->mutex);
+        write_job_post(job, task, PROGRESS_EVENT_ITEM_FINISHED);
+        g_mutex_unlock(&job->mutex);
+    } else if (progress != task->progress) {
+        write_job_report(job, progress - task->progress);
+        task->progress = progress;
+    }
+}
+
+static gboolean
+trampoline_file_progress_changed(double progress, void *user_data)
+{
+    WriteTask *task = user_data;
+
+    write_task_set_percentage(task, progress, FALSE);
+
+    return !write_is_cancelled(task->job->sample);
+}
+
+/* Called with job->mutex held */
+static void
+write_job_start_task(WriteJob *job, WriteTask *task)
+{
+    task->started = TRUE;
+    write_job_post(job, task, PROGRESS_EVENT_ITEM_STARTED);
+}
 
-            // skip over any extra channels
-            k += (sample_info->channels - 1) * (sample_info->bitsPerSample / 8);
+static WriteTask *
+write_job_claim_task(WriteJob *job)
+{
+    WriteTask *task = NULL;
+
+    if (write_is_cancelled(job->sample)) {
+        return NULL;
+    }
+
+    g_mutex_lock(&job->mutex);
+
+    if (job->next_task < job->num_tasks) {
+        task = &job->tasks[job->next_task++];
+        write_job_start_task(job, task);
+    }
+
+    g_mutex_unlock(&job->mutex);
+
+    return task;
+}
+
+static void
+write_task_finish(WriteTask *task, int res)
+{
+    WriteJob *job = task->job;
+
+    task->entry->written = (res == 0);
+
+    if (res == -1 && write_is_cancelled(job->sample)) {
+        // Don't leave a truncated track behind
+        g_unlink(task->filename);
+    } else if (res == -1) {
+        g_warning("Could not write file %s", task->filename);
+
+        g_mutex_lock(&job->mutex);
+        write_job_post(job, task, PROGRESS_EVENT_ERROR);
+        g_mutex_unlock(&job->mutex);
+    }
+
+    if (!task->finished) {
+        write_task_set_percentage(task, 1.0, TRUE);
+    }
+}
+
+/**
+ * Decode the range of task with reader and queue it to a new encoder, which
+ * runs on a thread of its own. Returns the encoder (to be finished by the
+ * caller once it has no more use for the overlap), NULL on error or abort.
+ **/
+static Encoder *
+write_task_encode(WriteTask *task, OpenedAudioFile *reader, report_progress_func report_progress)
+{
+    const SampleInfo *si = &reader->sample_info;
+
+    unsigned long end_pos = (task->end_pos != 0) ? MIN(task->end_pos, si->numBytes) : si->numBytes;
+    unsigned long pos = MIN(task->start_pos, end_pos);
+
+    char *error_message = NULL;
+    Encoder *encoder = encoder_start(task->job->codec, task->filename, si, end_pos - pos, &error_message);
+    if (encoder == NULL) {
+        g_warning("Could not encode %s: %s", task->filename, error_message);
+        g_free(error_message);
+        return NULL;
+    }
+
+    gboolean ok = TRUE;
+
+    while (ok && pos < end_pos) {
+        if (!report_progress((double)(pos - task->start_pos) / (double)(end_pos - task->start_pos), task)) {
+            ok = FALSE;
+            break;
         }
 
-        graph_data[i].min = min;
-        graph_data[i].max = max;
+        // Blocks while the encoder is behind, which bounds the memory used
+        EncoderBuffer *buffer = encoder_get_buffer(encoder);
 
-        if( min_sample > (max-min)) {
-            min_sample = (max-min);
+        long len = format_read_samples(reader, buffer->data, MIN(buffer->size, end_pos - pos), pos);
+        if (len < 0) {
+            ok = FALSE;
+        } else if (len == 0) {
+            // The decoder produced fewer samples than announced
+            end_pos = pos;
         }
-        if( max_sample < (max-min)) {
-            max_sample = (max-min);
+
+        buffer->len = MAX(len, 0);
+        pos += buffer->len;
+
+        if (!encoder_push_buffer(encoder, buffer)) {
+            ok = FALSE;
         }
+    }
+
+    if (!ok) {
+        encoder_finish(encoder, TRUE);
+        return NULL;
+    }
+
+    return encoder;
+}
+
+static gpointer
+write_worker_thread(gpointer data)
+{
+    WriteJob *job = data;
+    Sample *sample = job->sample;
 
-        ret = read_sample(sample->opened_audio_file, devbuf, sample_info->blockSize, sample_info->blockSize * i);
+    char *error_message = NULL;
+    OpenedAudioFile *reader = sample_open_reader(sample, &error_message);
+    if (reader == NULL) {
+        // Other workers (if any) pick up the remaining tracks
+        g_warning("Could not open file for writing: %s", error_message);
 
-        g_mutex_lock(&sample->load_mutex);
-        sample->load_percentage = (double) i / numSampleBlocks;
-        g_mutex_unlock(&sample->load_mutex);
-        i++;
+        g_mutex_lock(&job->mutex);
+        progress_channel_post(job->progress, PROGRESS_EVENT_ERROR, 0, g_atomic_int_get(&job->finished), job->total, error_message);
+        g_mutex_unlock(&job->mutex);
+
+        g_free(error_message);
+        return NULL;
     }
 
-    graphData->numSamples = numSampleBlocks;
+    WriteTask *task;
+    while ((task = write_job_claim_task(job)) != NULL) {
+        int res;
 
-    if (graphData->data != NULL) {
-        free(graphData->data);
+        if (job->codec != OUTPUT_CODEC_SOURCE) {
+            Encoder *encoder = write_task_encode(task, reader, trampoline_file_progress_changed);
+            res = (encoder != NULL) ? encoder_finish(encoder, FALSE) : -1;
+        } else {
+            res = format_write_file(reader, task->filename, task->start_pos, task->end_pos, job->write_policy, trampoline_file_progress_changed, task);
+        }
+
+        write_task_finish(task, res);
     }
-    graphData->data = graph_data;
 
-    graphData->minSampleAmp = min_sample;
-    graphData->maxSampleAmp = max_sample;
+    sample_close_reader(sample, reader);
 
-    if (sample_info->bitsPerSample == 8) {
-        graphData->maxSampleValue = UCHAR_MAX;
-    } else if (sample_info->bitsPerSample == 16) {
-        graphData->maxSampleValue = SHRT_MAX;
-    } else if (sample_info->bitsPerSample == 24) {
-	graphData->maxSampleValue = 0x7fffff;
+    return NULL;
+}
+
+static gboolean
+trampoline_track_progress_changed(double progress, void *user_data)
+{
+    WriteTask *task = user_data;
+    WriteJob *job = task->job;
+
+    if (!task->started) {
+        g_mutex_lock(&job->mutex);
+        write_job_start_task(job, task);
+        g_mutex_unlock(&job->mutex);
     }
 
-    g_mutex_lock(&sample->load_mutex);
-    sample->load_percentage = 1.0;
-    sample->loaded = TRUE;
-    g_mutex_unlock(&sample->load_mutex);
+    if (!task->finished) {
+        write_task_set_percentage(task, MIN(progress, 1.0), progress >= 1.0);
+    }
+
+    return !write_is_cancelled(job->sample);
 }
 
+/* Called with job->mutex not held */
 static void
-trampoline_file_progress_changed(double progress, void *user_data)
+write_task_start_late(WriteTask *task)
 {
-    WriteStatusCallbacks *callbacks = user_data;
-    callbacks->on_file_progress_changed(progress, callbacks->user_data);
+    WriteJob *job = task->job;
+
+    // Tracks that failed before any progress was reported
+    if (!task->started) {
+        g_mutex_lock(&job->mutex);
+        write_job_start_task(job, task);
+        g_mutex_unlock(&job->mutex);
+    }
 }
 
-static gpointer
-write_thread(gpointer data)
+/**
+ * Single-pass mode with an output codec: the tracks are decoded in order,
+ * the encoder of each one finishes while the next one is being decoded.
+ **/
+static void
+write_single_pass_encode(WriteJob *job, OpenedAudioFile *reader)
 {
-    WriteThreadData *thread_data = data;
+    WriteTask *pending = NULL;
+    Encoder *pending_encoder = NULL;
 
-    TrackBreakList *list = thread_data->list;
+    for (guint t = 0; t < job->num_tasks; t++) {
+        WriteTask *task = &job->tasks[t];
+        Encoder *encoder = NULL;
 
-    GList *tbl_head = list->breaks;
-    GList *tbl_cur, *tbl_next;
-    const char *outputdir = thread_data->outputdir;
-    TrackBreak *tb_cur, *tb_next;
+        if (!write_is_cancelled(job->sample)) {
+            encoder = write_task_encode(task, reader, trampoline_track_progress_changed);
+        }
 
-    WriteStatusCallbacks *callbacks = thread_data->callbacks;
+        if (pending != NULL) {
+            write_task_finish(pending, (pending_encoder != NULL) ? encoder_finish(pending_encoder, FALSE) : -1);
+        }
 
-    Sample *sample = thread_data->sample;
+        write_task_start_late(task);
 
-    unsigned long start_pos, end_pos;
-    char filename[1024];
+        pending = task;
+        pending_encoder = encoder;
+    }
+
+    if (pending != NULL) {
+        write_task_finish(pending, (pending_encoder != NULL) ? encoder_finish(pending_encoder, FALSE) : -1);
+    }
+}
+
+/**
+ * Single-pass mode: one reader streams the source front to back and the
+ * tracks are written in order as it passes them (see format_write_tracks()).
+ **/
+static void
+write_single_pass(WriteJob *job)
+{
+    Sample *sample = job->sample;
+
+    char *error_message = NULL;
+    OpenedAudioFile *reader = sample_open_reader(sample, &error_message);
+    if (reader == NULL) {
+        g_warning("Could not open file for writing: %s", error_message);
+
+        g_mutex_lock(&job->mutex);
+        progress_channel_post(job->progress, PROGRESS_EVENT_ERROR, 0, g_atomic_int_get(&job->finished), job->total, error_message);
+        g_mutex_unlock(&job->mutex);
+
+        g_free(error_message);
+        return;
+    }
 
-    gulong num_files = 0;
-    enum OverwriteDecision overwrite_decision = OVERWRITE_DECISION_ASK;
+    if (job->codec != OUTPUT_CODEC_SOURCE) {
+        write_single_pass_encode(job, reader);
+        sample_close_reader(sample, reader);
+        return;
+    }
 
-    tbl_cur = tbl_head;
-    while (tbl_cur != NULL) {
-        tb_cur = tbl_cur->data;
+    FormatTrack *tracks = g_new0(FormatTrack, job->num_tasks);
+
+    for (guint t = 0; t < job->num_tasks; t++) {
+        tracks[t] = (FormatTrack) {
+            .filename = job->tasks[t].filename,
+            .start_pos = job->tasks[t].start_pos,
+            .end_pos = job->tasks[t].end_pos,
+            .write_policy = job->write_policy,
+            .report_progress = trampoline_track_progress_changed,
+            .report_progress_user_data = &job->tasks[t],
+        };
+    }
 
-        if (tb_cur->write == TRUE) {
-            ++num_files;
+    if (!write_is_cancelled(sample)) {
+        format_write_tracks(reader, tracks, job->num_tasks);
+    } else {
+        for (guint t = 0; t < job->num_tasks; t++) {
+            tracks[t].result = -1;
         }
+    }
 
-        tbl_cur = g_list_next(tbl_cur);
+    for (guint t = 0; t < job->num_tasks; t++) {
+        write_task_start_late(&job->tasks[t]);
+        write_task_finish(&job->tasks[t], tracks[t].result);
     }
 
-    int i = 1;
-    tbl_cur = tbl_head;
-    tbl_next = g_list_next(tbl_cur);
+    g_free(tracks);
 
-    while (tbl_cur != NULL && !callbacks->is_cancelled(callbacks->user_data)) {
-        tb_cur = tbl_cur->data;
+    sample_close_reader(sample, reader);
+}
 
-        if (tb_cur->write) {
-            start_pos = tb_cur->offset * sample->opened_audio_file->sample_info.blockSize;
+/* File extension of the split tracks, including the dot */
+static const char *
+write_get_extension(Sample *sample, enum OutputCodec codec)
+{
+    // TODO: CDDA needs .cdda.raw file extension, not .raw
+    const char *extension = encoder_codec_get_file_extension(codec);
+    if (extension == NULL && sample->opened_audio_file->filename != NULL) {
+        extension = strrchr(sample->opened_audio_file->filename, '.');
+    }
+    if (extension == NULL) {
+        /* Fallback extensions if not in source filename */
+        extension = sample->opened_audio_file->mod->default_file_extension;
+    }
 
-            if (tbl_next == NULL) {
-                end_pos = 0;
-                tb_next = NULL;
-            } else {
-                tb_next = tbl_next->data;
-                end_pos = tb_next->offset * sample->opened_audio_file->sample_info.blockSize;
-            }
+    return extension;
+}
 
-            /* add output directory to filename */
-            strcpy(filename, outputdir);
-            strcat(filename, "/");
-
-            gchar *tmp = track_break_get_filename(tb_cur, list);
-            strcat(filename, tmp);
-            g_free(tmp);
-
-            // TODO: CDDA needs .cdda.raw file extension, not .raw
-            const char *source_file_extension = sample->opened_audio_file->filename ? strrchr(sample->opened_audio_file->filename, '.') : NULL;
-            if (source_file_extension == NULL) {
-                /* Fallback extensions if not in source filename */
-                if (sample->opened_audio_file != NULL) {
-                    source_file_extension = sample->opened_audio_file->mod->default_file_extension;
-                }
-            }
+/**
+ * Resolve all output files, reuse unchanged ones from the previous export,
+ * settle the overwrite questions and check for collisions and free space
+ * before anything is written. Returns NULL if the export can't go ahead
+ * (an error has been posted).
+ **/
+static ExportPlan *
+write_plan(WriteJob *job, TrackBreakList *list, const char *outputdir)
+{
+    Sample *sample = job->sample;
+    OpenedAudioFile *oaf = sample->opened_audio_file;
 
-            /* add file extension to filename */
-            if (source_file_extension != NULL && strstr(filename, source_file_extension) == NULL) {
-                strcat(filename, source_file_extension);
-            }
+    ExportPlan *plan = export_plan_new(list, outputdir, write_get_extension(sample, job->codec),
+            &oaf->sample_info, oaf->file_size, job->codec);
 
-            callbacks->on_file_changed(i, num_files, filename, callbacks->user_data);
-            callbacks->on_file_progress_changed(0.0, callbacks->user_data);
+    if (!job->rewrite_all) {
+        ExportManifest *previous = export_manifest_new(outputdir, oaf->filename, encoder_codec_get_name(job->codec));
 
-            gboolean file_exists = g_file_test(filename, G_FILE_TEST_EXISTS);
+        if (previous != NULL && export_manifest_load(previous)) {
+            export_plan_match_manifest(plan, previous);
+        }
 
-            if (file_exists && overwrite_decision == OVERWRITE_DECISION_ASK) {
-                overwrite_decision = callbacks->ask_overwrite(filename, callbacks->user_data);
-            }
+        if (previous != NULL) {
+            export_manifest_free(previous);
+        }
+    }
 
-            if (!file_exists || overwrite_decision == OVERWRITE_DECISION_OVERWRITE || overwrite_decision == OVERWRITE_DECISION_OVERWRITE_ALL) {
-                if (format_write_file(sample->opened_audio_file, filename, start_pos, end_pos, trampoline_file_progress_changed, callbacks) == -1) {
-                    g_warning("Could not write file %s", filename);
-                    callbacks->on_error(filename, callbacks->user_data);
-                }
-            }
+    export_plan_resolve_overwrites(plan, job->callbacks);
+
+    char *error_message = NULL;
+    if (!write_is_cancelled(sample) && !export_plan_check(plan, &error_message)) {
+        progress_channel_post(job->progress, PROGRESS_EVENT_ERROR, 0, 0, plan->num_entries, error_message);
+        g_free(error_message);
+
+        export_plan_free(plan);
+        return NULL;
+    }
+
+    if (!write_is_cancelled(sample) && !export_plan_move_reused(plan, &error_message)) {
+        progress_channel_post(job->progress, PROGRESS_EVENT_ERROR, 0, 0, plan->num_entries, error_message);
+        g_free(error_message);
+
+        export_plan_free(plan);
+        return NULL;
+    }
+
+    return plan;
+}
+
+/* Record the outputs of this export, for the next one */
+static void
+write_save_manifest(WriteJob *job, ExportPlan *plan)
+{
+    OpenedAudioFile *oaf = job->sample->opened_audio_file;
+
+    ExportManifest *manifest = export_manifest_new(plan->output_dir, oaf->filename, encoder_codec_get_name(job->codec));
+    if (manifest == NULL) {
+        return;
+    }
+
+    export_plan_update_manifest(plan, manifest);
+
+    char *error_message = NULL;
+    if (!export_manifest_save(manifest, &error_message)) {
+        g_warning("%s", error_message);
+        g_free(error_message);
+    }
+
+    export_manifest_free(manifest);
+}
+
+static gpointer
+write_thread(gpointer data)
+{
+    WriteThreadData *thread_data = data;
+
+    TrackBreakList *list = thread_data->list;
+    const char *outputdir = thread_data->outputdir;
+    WriteStatusCallbacks *callbacks = thread_data->callbacks;
+    Sample *sample = thread_data->sample;
+
+    WriteJob job;
+    memset(&job, 0, sizeof(job));
+
+    job.sample = sample;
+    job.callbacks = callbacks;
+    job.progress = callbacks->progress;
+    job.codec = thread_data->options.codec;
+    job.write_policy = thread_data->options.write_policy;
+    job.rewrite_all = thread_data->options.rewrite_all;
+    g_mutex_init(&job.mutex);
+
+    ExportPlan *plan = write_plan(&job, list, outputdir);
 
-            callbacks->on_file_progress_changed(1.0, callbacks->user_data);
+    if (plan != NULL) {
+        job.total = plan->num_entries;
+        job.tasks = g_new0(WriteTask, job.total);
 
-            if (overwrite_decision != OVERWRITE_DECISION_SKIP_ALL && overwrite_decision != OVERWRITE_DECISION_OVERWRITE_ALL) {
-                overwrite_decision = OVERWRITE_DECISION_ASK;
+        // Tracks that are not overwritten or reused count as done
+        for (guint i = 0; i < plan->num_entries && !write_is_cancelled(sample); i++) {
+            ExportPlanEntry *entry = &plan->entries[i];
+
+            if (entry->skip || entry->reused_from != NULL) {
+                ++job.finished;
+                job.done += WRITE_PROGRESS_ONE;
+                continue;
             }
 
-            i++;
+            job.tasks[job.num_tasks++] = (WriteTask) {
+                .job = &job,
+                .entry = entry,
+                .position = entry->position,
+                .filename = g_strdup(entry->filename),
+                .start_pos = entry->start_pos,
+                .end_pos = entry->end_pos,
+            };
+        }
+    }
+
+    if (job.num_tasks == 0) {
+        // Nothing to write (or the plan failed)
+        write_job_report(&job, 0);
+    } else if (thread_data->options.single_pass) {
+        write_single_pass(&job);
+    } else {
+        guint num_workers = thread_data->options.jobs;
+        if (num_workers == 0) {
+            num_workers = g_get_num_processors();
+        }
+        num_workers = CLAMP(num_workers, 1, MAX(job.num_tasks, 1));
+
+        GThread **workers = g_new0(GThread *, num_workers);
+
+        // The first worker runs on this thread
+        for (guint w = 1; w < num_workers; w++) {
+            workers[w] = g_thread_new("write worker", write_worker_thread, &job);
+        }
+
+        write_worker_thread(&job);
+
+        for (guint w = 1; w < num_workers; w++) {
+            g_thread_join(workers[w]);
         }
 
-        tbl_cur = g_list_next(tbl_cur);
-        tbl_next = g_list_next(tbl_next);
+        g_free(workers);
     }
 
+    if (plan != NULL) {
+        write_save_manifest(&job, plan);
+        export_plan_free(plan);
+    }
+
+    for (guint t = 0; t < job.num_tasks; t++) {
+        g_free(job.tasks[t].filename);
+    }
+
+    g_free(job.tasks);
+    g_mutex_clear(&job.mutex);
+
     g_mutex_lock(&sample->write_mutex);
     sample->writing = FALSE;
     g_mutex_unlock(&sample->write_mutex);
 
-    callbacks->on_finished(callbacks->user_data);
+    // Last use of the channel, the consumer may free callbacks after this
+    progress_channel_post(job.progress, PROGRESS_EVENT_FINISHED, 0, g_atomic_int_get(&job.finished), job.total, NULL);
+    progress_channel_unref(job.progress);
 
     return NULL;
 }
 
 void
-sample_write_files(Sample *sample, TrackBreakList *list, WriteStatusCallbacks *callbacks, const char *output_dir)
+sample_write_files(Sample *sample, TrackBreakList *list, WriteStatusCallbacks *callbacks, const char *output_dir, const WriteOptions *options)
 {
+    // Reap the thread of a previous (finished) write
+    if (sample->write_thread != NULL) {
+        g_thread_join(g_steal_pointer(&sample->write_thread));
+    }
+
+    // Dropped by the write thread after its FINISHED event
+    progress_channel_ref(callbacks->progress);
+
     sample->write_thread_data = (WriteThreadData) {
         .sample = sample,
         .list = list,
@@ -626,10 +1142,14 @@ sample_write_files(Sample *sample, TrackBreakList *list, WriteStatusCallbacks *c
         .outputdir = output_dir,
     };
 
+    if (options != NULL) {
+        sample->write_thread_data.options = *options;
+    }
+
     g_mutex_lock(&sample->write_mutex);
     sample->writing = TRUE;
     g_mutex_unlock(&sample->write_mutex);
 
-    // TODO: Capture thread and properly tear it down - if needed - in sample_close()
-    g_thread_unref(g_thread_new("write data", write_thread, &sample->write_thread_data));
+    g_atomic_int_set(&sample->write_cancelled, FALSE);
+    sample->write_thread = g_thread_new("write data", write_thread, &sample->write_thread_data);
 }
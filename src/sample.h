@@ -21,6 +21,10 @@
 
 #include "sample_info.h"
 #include "track_break.h"
+#include "encoder.h"
+#include "format.h"
+#include "progress.h"
+#include "audio_sink.h"
 
 #include <glib.h>
 #include <stdio.h>
@@ -31,6 +35,8 @@ struct Points_ {
         int min, max;
 };
 
+#define GRAPH_DATA_MAX_LEVELS 32
+
 typedef struct GraphData_ GraphData;
 struct GraphData_{
 	unsigned long numSamples;
@@ -38,6 +44,35 @@ struct GraphData_{
         unsigned long maxSampleAmp;
         unsigned long minSampleAmp;
 	Points *data;
+
+        /* data[0..validSamples) is final, see analysis_get_valid_blocks() */
+        volatile gint validSamples;
+
+        /* The analysis fills chunks of chunkBlocks blocks in any order
+         * (visible range first); chunkValid[n] is set once chunk n is
+         * final, analyzedSamples counts all final blocks */
+        unsigned long chunkBlocks;
+        unsigned long numChunks;
+        volatile gint *chunkValid;
+        volatile gint analyzedSamples;
+
+        /* Peak pyramid: each entry of levels[n] is the min/max of two
+         * entries of the level below (levels[0] reduces data), so any
+         * range of blocks can be summarized from O(log n) entries */
+        unsigned int numLevels;
+        unsigned long levelSamples[GRAPH_DATA_MAX_LEVELS];
+        Points *levels[GRAPH_DATA_MAX_LEVELS];
+        Points *pyramid;
+};
+
+typedef struct AnalysisStats_ AnalysisStats;
+struct AnalysisStats_ {
+    uint64_t bytes;
+    unsigned long blocks;
+    gint64 duration; /* microseconds */
+    guint workers;
+    gboolean from_cache; /* loaded from the peak cache, nothing analyzed */
+    gboolean mapped; /* analyzed straight from the file mapping */
 };
 
 enum OverwriteDecision {
@@ -51,13 +86,13 @@ enum OverwriteDecision {
 
 typedef struct WriteStatusCallbacks_ WriteStatusCallbacks;
 struct WriteStatusCallbacks_ {
-    // Write thread reporting to the UI
-    void (*on_file_changed)(guint position, guint total, const char *filename, void *user_data);
-    void (*on_file_progress_changed)(double percentage, void *user_data);
-    void (*on_error)(const char *message, void *user_data);
-    void (*on_finished)(void *user_data);
+    // Write thread reporting to the UI: the overall fraction, one
+    // ITEM_STARTED and ITEM_FINISHED event per track (several may be
+    // running at once), ERROR events and a final FINISHED event
+    ProgressChannel *progress;
 
-    // Write thread querying the UI
+    // Write thread querying the UI; is_cancelled is called for every
+    // progress update, so it must not block
     gboolean (*is_cancelled)(void *user_data);
     enum OverwriteDecision (*ask_overwrite)(const char *filename, void *user_data);
 
@@ -65,33 +100,30 @@ struct WriteStatusCallbacks_ {
     void *user_data;
 };
 
-typedef struct WriteInfo_ WriteInfo;
-struct WriteInfo_ {
-	guint num_files;
-	guint cur_file;
-	char *cur_filename;
-	double pct_done;
-	guint sync;
-	gint check_file_exists;
-	gint skip_file; /* -1 = waiting for check
-			 * 0 = don't overwrite file
-			 * 1 = file is ok to overwrite
-			 * 2 = overwrite all files
-			 */
-	gint sync_check_file_overwrite_to_write_progress;
-	GList *errors;
+typedef struct WriteOptions_ WriteOptions;
+struct WriteOptions_ {
+    guint jobs; /* tracks written in parallel, 0 = one per CPU */
+    gboolean single_pass; /* read the source once, front to back (jobs is ignored) */
+    enum OutputCodec codec; /* encode tracks instead of copying the source format */
+    enum FormatWritePolicy write_policy; /* page cache handling of the output files */
+    gboolean rewrite_all; /* write every track, even if unchanged since the last export */
 };
 
 void sample_init();
 
+/* Release the audio device kept open between plays */
+void sample_shutdown();
+
 typedef struct Sample_ Sample;
 
+/* load_progress (optional) receives the analysis progress and a FINISHED event */
 Sample *
-sample_open(const char *filename, char **error_message);
+sample_open(const char *filename, ProgressChannel *load_progress, char **error_message);
 
 void
 sample_print_file_info(Sample *sample);
 
+/* Stops playback, cancels and joins the analysis and write threads, then frees sample */
 void
 sample_close(Sample *sample);
 
@@ -101,6 +133,13 @@ sample_is_loaded(Sample *sample);
 double
 sample_get_load_percentage(Sample *sample);
 
+void
+sample_get_analysis_stats(Sample *sample, AnalysisStats *stats);
+
+/* Analyze the given block range first (e.g. the visible part of the waveform) */
+void
+sample_set_analysis_focus(Sample *sample, unsigned long first, unsigned long count);
+
 uint64_t
 sample_get_file_size(Sample *sample);
 
@@ -125,8 +164,39 @@ sample_get_play_marker(Sample *sample);
 void
 sample_stop(Sample *sample);
 
+/* How often the current (or last) playback was waiting for the file */
+guint
+sample_get_play_underruns(Sample *sample);
+
+/* TRUE if the current (or last) playback ended because the device failed, not played to the end */
+gboolean
+sample_play_has_failed(Sample *sample);
+
+/**
+ * Play into sink (which must outlive the sample) from the next play on;
+ * NULL selects the default, the libao device.
+ **/
+void
+sample_set_audio_sink(Sample *sample, AudioSink *sink);
+
+/**
+ * Break audition: read the regions around the breaks at offsets (the ones
+ * played next, in order) into memory in the background. context_blocks are
+ * played before and after each break.
+ **/
+void
+sample_audition_prefetch(Sample *sample, const gulong *offsets, guint n, guint context_blocks);
+
+/* Stop playback and play the region around the break at offset */
+int
+sample_play_transition(Sample *sample, gulong offset, guint context_blocks);
+
+/* Free the prefetched regions */
+void
+sample_audition_end(Sample *sample);
+
 void
-sample_write_files(Sample *sample, TrackBreakList *list, WriteStatusCallbacks *callbacks, const char *output_dir);
+sample_write_files(Sample *sample, TrackBreakList *list, WriteStatusCallbacks *callbacks, const char *output_dir, const WriteOptions *options);
 
 GraphData *
 sample_get_graph_data(Sample *sample);
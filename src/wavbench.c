@@ -0,0 +1,193 @@
+/* wavbreaker - A tool to split a wave file up into multiple waves.
+ * Copyright (C) 2026 wavbreaker contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "analysis.h"
+#include "analysis_kernels.h"
+#include "format.h"
+
+#define BENCH_DEFAULT_MIB 64
+#define BENCH_ROUNDS 5
+
+static double
+bench_kernel(const AnalysisKernel *kernel, const SampleInfo *sample_info,
+             const unsigned char *buf, size_t num_bytes, Points *out, unsigned long num_blocks)
+{
+    analysis_kernel_func reduce = kernel->reduce[sample_info->blockAlign / sample_info->channels - 1];
+    gint64 best = G_MAXINT64;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        gint64 started = g_get_monotonic_time();
+
+        for (unsigned long i = 0; i < num_blocks; i++) {
+            size_t offset = i * sample_info->blockSize;
+            reduce(buf + offset, MIN(num_bytes - offset, sample_info->blockSize),
+                   sample_info->channels, &out[i]);
+        }
+
+        best = MIN(best, g_get_monotonic_time() - started);
+    }
+
+    return (double)num_bytes / (1024.0 * 1024.0) / ((double)MAX(best, 1) / G_USEC_PER_SEC);
+}
+
+/* One analysis pass over filename, returns MiB/s or -1 on error */
+static double
+bench_analysis_pass(const char *filename, int open_flags, gboolean *mapped)
+{
+    char *error_message = NULL;
+    OpenedAudioFile *oaf = format_open_file(filename, open_flags, &error_message);
+
+    if (oaf == NULL) {
+        printf("Could not open %s: %s\n", filename, error_message);
+        g_free(error_message);
+        return -1.0;
+    }
+
+    double result = -1.0;
+
+    GraphData graph_data = { 0 };
+    AnalysisStats stats;
+
+    if (analysis_prepare(oaf, &graph_data) && analysis_run(oaf, &graph_data, NULL, NULL, NULL, &stats)) {
+        result = (double)stats.bytes / (1024.0 * 1024.0) * G_USEC_PER_SEC / MAX(stats.duration, 1);
+        *mapped = stats.mapped;
+    }
+
+    analysis_free(&graph_data);
+    format_close_file(oaf);
+
+    return result;
+}
+
+/* Analyze filename through the mapping and with pread(), after warming up the page cache */
+static int
+bench_file(const char *filename)
+{
+    format_init();
+    analysis_kernels_init();
+
+    gboolean mapped = FALSE, read_mapped = FALSE;
+
+    if (bench_analysis_pass(filename, FORMAT_OPEN_DEFAULT, &mapped) < 0.0) {
+        return 1;
+    }
+
+    double mmap_speed = bench_analysis_pass(filename, FORMAT_OPEN_DEFAULT, &mapped);
+    double read_speed = bench_analysis_pass(filename, FORMAT_OPEN_NO_MMAP, &read_mapped);
+
+    if (mmap_speed < 0.0 || read_speed < 0.0) {
+        return 1;
+    }
+
+    if (!mapped) {
+        printf("Analysis with warm page cache: %.1f MiB/s (file is not memory-mapped)\n", read_speed);
+        return 0;
+    }
+
+    printf("Analysis with warm page cache: mmap %.1f MiB/s, read %.1f MiB/s (%.2fx)\n",
+            mmap_speed, read_speed, mmap_speed / read_speed);
+
+    return 0;
+}
+
+int cmd_wavbench(int argc, char *argv[])
+{
+    if (argc == 3 && strcmp(argv[1], "--file") == 0) {
+        return bench_file(argv[2]);
+    }
+
+    if (argc > 2 || (argc == 2 && atoi(argv[1]) <= 0)) {
+        printf("Usage: %s [size-in-MiB]\n", argv[0]);
+        printf("       %s --file F\n", argv[0]);
+        printf("  size-in-MiB      Benchmark the analysis kernels on random data (default %d)\n", BENCH_DEFAULT_MIB);
+        printf("  --file F         Compare analyzing F through its memory mapping and with read()\n");
+        return 1;
+    }
+
+    size_t num_bytes = (size_t)(argc == 2 ? atoi(argv[1]) : BENCH_DEFAULT_MIB) * 1024 * 1024;
+
+    unsigned char *buf = malloc(num_bytes);
+    if (buf == NULL) {
+        printf("Could not allocate %zu bytes\n", num_bytes);
+        return 1;
+    }
+
+    GRand *rand = g_rand_new_with_seed(0x5eed);
+    for (size_t i = 0; i < num_bytes; i += 4) {
+        guint32 r = g_rand_int(rand);
+        memcpy(buf + i, &r, MIN(4, num_bytes - i));
+    }
+    g_rand_free(rand);
+
+    analysis_kernels_init();
+
+    const AnalysisKernel * const *kernels = analysis_kernels_list();
+    int result = 0;
+
+    printf("Benchmarking analysis kernels on %zu MiB of stereo data (default: %s)\n\n",
+           num_bytes / (1024 * 1024), analysis_kernels_get()->name);
+
+    for (int bits = 8; bits <= 32; bits += 8) {
+        SampleInfo sample_info;
+        memset(&sample_info, 0, sizeof(sample_info));
+
+        sample_info.channels = 2;
+        sample_info.samplesPerSec = 44100;
+        sample_info.bitsPerSample = bits;
+        sample_info.blockAlign = sample_info.channels * (bits / 8);
+        sample_info.avgBytesPerSec = sample_info.samplesPerSec * sample_info.blockAlign;
+        sample_info.blockSize = sample_info.avgBytesPerSec / CD_BLOCKS_PER_SEC;
+
+        size_t usable = num_bytes - num_bytes % sample_info.blockAlign;
+        unsigned long num_blocks = (usable + sample_info.blockSize - 1) / sample_info.blockSize;
+
+        Points *reference = g_new0(Points, num_blocks);
+        Points *points = g_new0(Points, num_blocks);
+
+        double scalar_speed = 0.0;
+
+        for (int k = 0; kernels[k] != NULL; k++) {
+            double speed = bench_kernel(kernels[k], &sample_info, buf, usable,
+                                        (k == 0) ? reference : points, num_blocks);
+
+            const char *status = "";
+            if (k == 0) {
+                scalar_speed = speed;
+            } else if (memcmp(reference, points, num_blocks * sizeof(Points)) != 0) {
+                status = "  MISMATCH";
+                result = 1;
+            }
+
+            printf("%2d-bit  %-8s %9.1f MiB/s  %5.2fx%s\n", bits, kernels[k]->name,
+                   speed, speed / scalar_speed, status);
+        }
+
+        g_free(points);
+        g_free(reference);
+    }
+
+    free(buf);
+
+    return result;
+}
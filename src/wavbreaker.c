@@ -111,9 +111,26 @@ static int pixmap_offset;
 static guint open_file_source_id;
 static guint redraw_source_id;
 
-// timeout-based (periodic) progress UI update event sources
-static guint file_open_progress_source_id;
-static guint play_progress_source_id;
+// frame clock callback following the play marker
+static guint play_progress_tick_id;
+
+// analysis progress of g_sample, NULL once it is loaded
+static ProgressChannel *file_open_progress;
+
+// break audition: the breaks still to be played, the first one is playing
+static struct {
+    gboolean active;
+    GList *queue; /* TrackBreak * of track_breaks */
+    guint accepted;
+    guint skipped;
+    guint total;
+} audition;
+
+/* Breaks whose surroundings are read into memory ahead of time */
+#define AUDITION_PREFETCH_BREAKS 4
+
+/* Don't redraw the waveform more often than this while analyzing */
+#define FILE_OPEN_PROGRESS_INTERVAL_MS 100
 
 static struct FileWriteProgressUI *
 current_file_write_progress_ui = NULL;
@@ -235,6 +252,30 @@ menu_play(GtkWidget *widget, gpointer user_data);
 static void
 menu_stop(GtkWidget *widget, gpointer user_data);
 
+static void
+menu_audition(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void
+menu_audition_accept(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void
+menu_audition_skip(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void
+menu_audition_nudge(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void
+menu_audition_stop(GSimpleAction *action, GVariant *parameter, gpointer user_data);
+
+static void
+audition_next();
+
+static void
+audition_stop();
+
+static gboolean
+audition_key_press(GtkWidget *widget, GdkEventKey *event, gpointer user_data);
+
 static void
 menu_next_silence( GtkWidget* widget, gpointer user_data);
 
@@ -436,6 +477,8 @@ track_break_create_list_gui()
     gtk_widget_add_events(draw_summary, GDK_BUTTON_PRESS_MASK);
     g_signal_connect(G_OBJECT(treeview), "button_press_event",
                      G_CALLBACK(track_break_button_press), NULL);
+    g_signal_connect(G_OBJECT(treeview), "key-press-event",
+                     G_CALLBACK(audition_key_press), NULL);
 
     gtk_widget_show(treeview);
 
@@ -528,6 +571,10 @@ track_break_button_press(GtkWidget *widget, GdkEventButton *event, gpointer user
     g_menu_append(break_model, _("Jump to track break"), "win.jump_break");
     g_menu_append_section(menu_model, NULL, G_MENU_MODEL(break_model));
 
+    GMenu *audition_model = g_menu_new();
+    g_menu_append(audition_model, _("Audition track breaks"), "win.audition");
+    g_menu_append_section(menu_model, NULL, G_MENU_MODEL(audition_model));
+
     GtkMenu *menu = GTK_MENU(gtk_menu_new_from_model(G_MENU_MODEL(menu_model)));
     gtk_menu_attach_to_widget(menu, main_window, NULL);
     gtk_menu_popup_at_pointer(GTK_MENU(menu), NULL);
@@ -749,89 +796,55 @@ void track_break_filename_edited(GtkCellRendererText *cell,
  */
 
 struct FileWriteProgressUI {
-    GMutex mutex;
+    // Reference held until the FINISHED event, the UI is freed with the channel
+    ProgressChannel *progress;
 
-    guint position;
+    guint done;
     guint total;
-    gchar *filename;
-    double percentage;
     GList *errors;
-    gboolean cancelled;
+    volatile gint cancelled;
     gboolean finished;
 
     struct {
         GtkWidget *window;
         GtkWidget *status_label;
         GtkWidget *pbar;
-
-        guint cur_file_displayed;
     } gtk;
 
     struct {
+        GMutex mutex;
         GCond cond;
         gchar *filename;
         enum OverwriteDecision result;
     } overwrite_decision;
 
-    guint source_id;
     WriteStatusCallbacks callbacks;
 };
 
-static void
-file_write_progress_ui_on_file_changed(guint position, guint total, const char *filename, void *user_data)
-{
-    struct FileWriteProgressUI *ui = user_data;
-
-    g_mutex_lock(&ui->mutex);
-
-    if (ui->filename != NULL) {
-        g_free(g_steal_pointer(&ui->filename));
-    }
-
-    ui->position = position;
-    ui->total = total;
-    ui->filename = g_strdup(filename);
-    ui->percentage = 0.0;
-
-    g_mutex_unlock(&ui->mutex);
-}
+/* Don't redraw the progress bar more often than this */
+#define WRITE_PROGRESS_INTERVAL_MS 50
 
 static void
-file_write_progress_ui_on_file_progress_changed(double percentage, void *user_data)
+file_write_progress_ui_free(gpointer data)
 {
-    struct FileWriteProgressUI *ui = user_data;
-
-    g_mutex_lock(&ui->mutex);
+    struct FileWriteProgressUI *ui = data;
 
-    ui->percentage = percentage;
+    g_list_free_full(ui->errors, g_free);
+    g_cond_clear(&ui->overwrite_decision.cond);
+    g_mutex_clear(&ui->overwrite_decision.mutex);
 
-    g_mutex_unlock(&ui->mutex);
+    g_free(ui);
 }
 
-static void
-file_write_progress_ui_on_error(const char *message, void *user_data)
-{
-    struct FileWriteProgressUI *ui = user_data;
-
-    g_warning("Error writing file: %s", message);
-
-    g_mutex_lock(&ui->mutex);
-
-    ui->errors = g_list_append(ui->errors, g_strdup(message));
-
-    g_mutex_unlock(&ui->mutex);
-}
+gboolean
+file_write_progress_idle_func(gpointer data);
 
+/* Runs on the write threads, the UI is updated from the main loop */
 static void
-file_write_progress_ui_on_finished(void *user_data)
+file_write_progress_notify(ProgressChannel *progress, void *user_data)
 {
-    struct FileWriteProgressUI *ui = user_data;
-
-    g_mutex_lock(&ui->mutex);
-
-    ui->finished = TRUE;
-
-    g_mutex_unlock(&ui->mutex);
+    g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, file_write_progress_idle_func,
+            progress_channel_ref(progress), (GDestroyNotify)progress_channel_unref);
 }
 
 static gboolean
@@ -839,15 +852,7 @@ file_write_progress_ui_is_cancelled(void *user_data)
 {
     struct FileWriteProgressUI *ui = user_data;
 
-    gboolean cancelled;
-
-    g_mutex_lock(&ui->mutex);
-
-    cancelled = ui->cancelled;
-
-    g_mutex_unlock(&ui->mutex);
-
-    return cancelled;
+    return g_atomic_int_get(&ui->cancelled);
 }
 
 static enum OverwriteDecision
@@ -855,20 +860,23 @@ file_write_progress_ui_ask_overwrite(const char *filename, void *user_data)
 {
     struct FileWriteProgressUI *ui = user_data;
 
-    g_mutex_lock(&ui->mutex);
+    g_mutex_lock(&ui->overwrite_decision.mutex);
 
     ui->overwrite_decision.result = OVERWRITE_DECISION_ASK;
     ui->overwrite_decision.filename = g_strdup(filename);
 
+    // Nothing else may be published while we wait, so wake up the UI here
+    file_write_progress_notify(ui->callbacks.progress, ui);
+
     while (ui->overwrite_decision.result == OVERWRITE_DECISION_ASK) {
-        g_cond_wait(&ui->overwrite_decision.cond, &ui->mutex);
+        g_cond_wait(&ui->overwrite_decision.cond, &ui->overwrite_decision.mutex);
     }
 
     g_free(g_steal_pointer(&ui->overwrite_decision.filename));
 
     enum OverwriteDecision decision = ui->overwrite_decision.result;
 
-    g_mutex_unlock(&ui->mutex);
+    g_mutex_unlock(&ui->overwrite_decision.mutex);
 
     return decision;
 }
@@ -878,20 +886,25 @@ on_write_dialog_cancel_button_clicked(GtkWidget *button, void *user_data)
 {
     struct FileWriteProgressUI *ui = user_data;
 
-    g_mutex_lock(&ui->mutex);
-
     gtk_widget_set_sensitive(button, FALSE);
-    ui->cancelled = TRUE;
-
-    g_mutex_unlock(&ui->mutex);
+    g_atomic_int_set(&ui->cancelled, TRUE);
 }
 
 gboolean
 file_write_progress_idle_func(gpointer data)
 {
-    struct FileWriteProgressUI *ui = data;
+    ProgressChannel *progress = data;
+    struct FileWriteProgressUI *ui = progress_channel_get_user_data(progress);
+
+    if (ui->finished) {
+        // Woken up after the FINISHED event was handled
+        return FALSE;
+    }
 
-    g_mutex_lock(&ui->mutex);
+    // Re-arm first, so that nothing published while we're draining is missed
+    progress_channel_poll(progress);
+
+    g_mutex_lock(&ui->overwrite_decision.mutex);
 
     if (ui->overwrite_decision.result == OVERWRITE_DECISION_ASK) {
         if (ui->gtk.window != NULL) {
@@ -904,6 +917,8 @@ file_write_progress_idle_func(gpointer data)
         g_cond_signal(&ui->overwrite_decision.cond);
     }
 
+    g_mutex_unlock(&ui->overwrite_decision.mutex);
+
     if (ui->gtk.window == NULL) {
         ui->gtk.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
         gtk_widget_realize(ui->gtk.window);
@@ -956,26 +971,38 @@ file_write_progress_idle_func(gpointer data)
         gtk_box_pack_start(GTK_BOX(vbox), hbbox, FALSE, TRUE, 5);
 
         gtk_widget_show_all(GTK_WIDGET(ui->gtk.window));
-        ui->gtk.cur_file_displayed = 0;
     }
 
-    if (ui->gtk.cur_file_displayed != ui->position && ui->filename != NULL) {
-        gchar *file_basename = g_path_get_basename(ui->filename);
+    ProgressEvent event;
+    while (progress_channel_pop(progress, &event)) {
+        switch (event.type) {
+            case PROGRESS_EVENT_ITEM_STARTED: {
+                gchar *file_basename = g_path_get_basename(event.text);
 
-        gchar *tmp = g_strdup_printf(_("Writing %s"), file_basename);
-        gchar *msg = g_markup_printf_escaped("<i>%s</i>", tmp);
-        gtk_label_set_markup(GTK_LABEL(ui->gtk.status_label), msg);
-        g_free(msg);
-        g_free(tmp);
+                gchar *tmp = g_strdup_printf(_("Writing %s"), file_basename);
+                gchar *msg = g_markup_printf_escaped("<i>%s</i>", tmp);
+                gtk_label_set_markup(GTK_LABEL(ui->gtk.status_label), msg);
+                g_free(msg);
+                g_free(tmp);
 
-        g_free(file_basename);
+                g_free(file_basename);
+                break;
+            }
+            case PROGRESS_EVENT_ERROR:
+                g_warning("Error writing file: %s", event.text);
+                ui->errors = g_list_append(ui->errors, g_strdup(event.text));
+                break;
+            case PROGRESS_EVENT_FINISHED:
+                ui->finished = TRUE;
+                break;
+            default:
+                break;
+        }
 
-        // FIXME: i18n plural forms
-        gchar *tmp_str = g_strdup_printf(_("%d of %d parts written"), ui->position-1, ui->total);
-        gtk_progress_bar_set_text(GTK_PROGRESS_BAR(ui->gtk.pbar), tmp_str);
-        g_free(tmp_str);
+        ui->done = event.done;
+        ui->total = event.total;
 
-        ui->gtk.cur_file_displayed = ui->position;
+        progress_event_clear(&event);
     }
 
     if (ui->finished) {
@@ -998,7 +1025,7 @@ file_write_progress_idle_func(gpointer data)
 
             popupmessage_show(NULL, _("Operation failed"), tmp_str);
             g_free(tmp_str);
-        } else if (ui->cancelled) {
+        } else if (g_atomic_int_get(&ui->cancelled)) {
             popupmessage_show(NULL, _("Operation cancelled"), _("The split operation was cancelled."));
         } else {
             // TODO: gettext plurals
@@ -1009,33 +1036,26 @@ file_write_progress_idle_func(gpointer data)
 
         current_file_write_progress_ui = NULL;
 
-        ui->source_id = 0;
-
-        if (ui->filename) {
-            g_free(ui->filename);
-        }
-
-        g_cond_clear(&ui->overwrite_decision.cond);
-
-        g_mutex_unlock(&ui->mutex);
-
-        g_mutex_clear(&ui->mutex);
-
-        g_free(ui);
+        // ui is freed with the channel, once the pending wakeups are gone
+        progress_channel_unref(g_steal_pointer(&ui->progress));
 
         return FALSE;
     }
 
-    double fraction = 1.0 * (ui->position-1+ui->percentage) / ui->total;
-    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ui->gtk.pbar), fraction);
+    // FIXME: i18n plural forms
+    gchar *tmp_str = g_strdup_printf(_("%d of %d parts written"), ui->done, ui->total);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(ui->gtk.pbar), tmp_str);
+    g_free(tmp_str);
 
-    g_mutex_unlock(&ui->mutex);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ui->gtk.pbar), progress_channel_get_fraction(progress));
 
-    return TRUE;
+    // Called again by file_write_progress_notify() when there is news
+    return FALSE;
 }
 
-gboolean
-file_play_progress_idle_func(gpointer data) {
+/* Follows the play marker, called by the frame clock once per displayed frame */
+static gboolean
+file_play_progress_tick_func(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data) {
     GtkAllocation allocation;
     gtk_widget_get_allocation(draw, &allocation);
     gint half_width = allocation.width / 2;
@@ -1063,7 +1083,18 @@ file_play_progress_idle_func(gpointer data) {
         return TRUE;
     } else {
         set_play_icon();
-        play_progress_source_id = 0;
+        play_progress_tick_id = 0;
+
+        if (audition.active && sample_play_has_failed(g_sample)) {
+            // Don't run through the remaining breaks without hearing them
+            audition_stop();
+            update_status(FALSE);
+            popupmessage_show(main_window, _("Audition stopped"), _("The audio device could not be opened or failed while playing."));
+        } else if (audition.active) {
+            // Played to the end without objection, on to the next break
+            audition_next();
+        }
+
         return FALSE;
     }
 }
@@ -1074,132 +1105,99 @@ file_play_progress_idle_func(gpointer data) {
  *-------------------------------------------------------------------------
  */
 
-gboolean
-file_open_progress_idle_func(gpointer data)
+static void
+file_open_reset_view(Sample *sample)
 {
-    Sample *sample = data;
-
-    static GtkWidget *window;
-    static GtkWidget *pbar;
-    static GtkWidget *vbox;
-    static GtkWidget *label;
-    static char tmp_str[6144];
-    static char tmp_str2[6144];
-    static int current, size;
-
-    if (window == NULL) {
-        window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-        gtk_widget_realize(window);
-        gtk_window_set_resizable(GTK_WINDOW(window), FALSE);
-        gtk_window_set_modal(GTK_WINDOW(window), TRUE);
-        gtk_window_set_transient_for(GTK_WINDOW(window),
-                GTK_WINDOW(main_window));
-        gtk_window_set_type_hint(GTK_WINDOW(window),
-                GDK_WINDOW_TYPE_HINT_DIALOG);
-        gtk_window_set_position(GTK_WINDOW(window),
-                GTK_WIN_POS_CENTER_ON_PARENT);
-        gdk_window_set_functions(GDK_WINDOW(gtk_widget_get_window(window)), GDK_FUNC_MOVE);
-
-        vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-        gtk_container_add(GTK_CONTAINER(window), vbox);
-        gtk_container_set_border_width(GTK_CONTAINER(vbox), 10);
+    /* --------------------------------------------------- */
+    /* Reset things because we have a new file             */
+    /* --------------------------------------------------- */
 
-        gtk_window_set_title( GTK_WINDOW(window), _("Analyzing waveform"));
+    gtk_adjustment_set_value(GTK_ADJUSTMENT(adj), 0);
+    gtk_adjustment_set_value(GTK_ADJUSTMENT(cursor_marker_spinner_adj), 0);
+    gtk_adjustment_set_value(GTK_ADJUSTMENT(cursor_marker_min_spinner_adj), 0);
+    gtk_adjustment_set_value(GTK_ADJUSTMENT(cursor_marker_sec_spinner_adj), 0);
+    gtk_adjustment_set_value(GTK_ADJUSTMENT(cursor_marker_subsec_spinner_adj), 0);
 
-        tmp_str[0] = '\0';
-        strcat( tmp_str, "<span size=\"larger\" weight=\"bold\">");
-        strcat( tmp_str, gtk_window_get_title( GTK_WINDOW( window)));
-        strcat( tmp_str, "</span>");
-
-        label = gtk_label_new( NULL);
-        gtk_label_set_markup( GTK_LABEL(label), tmp_str);
-        g_object_set(G_OBJECT(label), "xalign", 0.0f, "yalign", 0.5f, NULL);
-        gtk_box_pack_start(GTK_BOX(vbox), label, FALSE, TRUE, 5);
-
-        label = gtk_label_new( _("The waveform data of the selected file is being analyzed and processed. This can take some time."));
-        gtk_label_set_line_wrap( GTK_LABEL(label), TRUE);
-        g_object_set(G_OBJECT(label), "xalign", 0.0f, "yalign", 0.5f, NULL);
-        gtk_box_pack_start(GTK_BOX(vbox), label, FALSE, TRUE, 5);
-
-        pbar = gtk_progress_bar_new();
-        gtk_box_pack_start(GTK_BOX(vbox), pbar, FALSE, TRUE, 5);
-
-        sprintf( tmp_str, _("Analyzing %s"), sample_get_basename(sample));
-        gchar *str = g_markup_escape_text(tmp_str, -1);
-        sprintf( tmp_str2, "<i>%s</i>", str);
-        g_free(str);
+    gtk_widget_queue_draw(scrollbar);
 
-        label = gtk_label_new( NULL);
-        gtk_label_set_markup( GTK_LABEL(label), tmp_str2);
-        g_object_set(G_OBJECT(label), "xalign", 0.0f, "yalign", 0.5f, NULL);
-        gtk_label_set_ellipsize( GTK_LABEL(label), PANGO_ELLIPSIZE_END);
-        gtk_box_pack_start(GTK_BOX(vbox), label, FALSE, TRUE, 5);
+    /* TODO: Remove FIX !!!!!!!!!!! */
+    configure_event(draw, NULL, NULL);
 
-        gtk_widget_show_all(GTK_WIDGET(window));
+#if defined(WANT_MOODBAR)
+    if (moodbarData) {
+        moodbar_free(moodbarData);
     }
+    moodbarData = moodbar_open(sample_get_filename(sample));
+    set_action_enabled("display_moodbar", moodbarData != NULL);
+    set_action_enabled("generate_moodbar", moodbarData == NULL);
+#endif
 
-    if (sample_is_loaded(sample)) {
-        gtk_widget_destroy(window);
-        window = NULL;
-
-        /* --------------------------------------------------- */
-        /* Reset things because we have a new file             */
-        /* --------------------------------------------------- */
+    if (!track_breaks) {
+        track_breaks = track_break_list_new(sample_get_basename_without_extension(sample));
+    }
 
-        gtk_adjustment_set_value(GTK_ADJUSTMENT(adj), 0);
-        gtk_adjustment_set_value(GTK_ADJUSTMENT(cursor_marker_spinner_adj), 0);
-        gtk_adjustment_set_value(GTK_ADJUSTMENT(cursor_marker_min_spinner_adj), 0);
-        gtk_adjustment_set_value(GTK_ADJUSTMENT(cursor_marker_sec_spinner_adj), 0);
-        gtk_adjustment_set_value(GTK_ADJUSTMENT(cursor_marker_subsec_spinner_adj), 0);
+    // The number of blocks is known before the analysis has finished
+    track_break_list_set_total_duration(track_breaks, sample_get_num_sample_blocks(sample));
 
-        gtk_widget_queue_draw(scrollbar);
+    track_break_update_gui_model();
+    redraw();
+}
 
-        /* TODO: Remove FIX !!!!!!!!!!! */
-        configure_event(draw, NULL, NULL);
+gboolean
+file_open_progress_idle_func(gpointer data)
+{
+    ProgressChannel *progress = data;
 
-#if defined(WANT_MOODBAR)
-        if (moodbarData) {
-            moodbar_free(moodbarData);
-        }
-        moodbarData = moodbar_open(sample_get_filename(sample));
-        set_action_enabled("display_moodbar", moodbarData != NULL);
-        set_action_enabled("generate_moodbar", moodbarData == NULL);
-#endif
+    if (progress != file_open_progress) {
+        // The sample has been closed (or is loaded) in the meantime
+        return FALSE;
+    }
 
-        if (!track_breaks) {
-            track_breaks = track_break_list_new(sample_get_basename_without_extension(sample));
-        }
-        track_break_list_set_total_duration(track_breaks, sample_get_num_sample_blocks(sample));
+    progress_channel_poll(progress);
 
-        // Now that the file is fully loaded, update the duration
-        track_break_update_gui_model();
-        redraw();
+    gboolean loaded = FALSE;
 
-        /* --------------------------------------------------- */
+    ProgressEvent event;
+    while (progress_channel_pop(progress, &event)) {
+        loaded = loaded || (event.type == PROGRESS_EVENT_FINISHED);
+        progress_event_clear(&event);
+    }
 
-        file_open_progress_source_id = 0;
-        return FALSE;
+    /* the waveform surfaces pick up newly analyzed blocks on redraw */
+    redraw();
+    update_status(FALSE);
 
-    } else {
-        double load_percentage = sample_get_load_percentage(sample);
+    if (loaded) {
+        progress_channel_unref(g_steal_pointer(&file_open_progress));
+    }
 
-        size = sample_get_file_size(sample) / (1024*1024);
-        current = size*load_percentage;
-        sprintf( tmp_str, _("%d of %d MB analyzed"), current, size);
-        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(pbar), load_percentage);
-        gtk_progress_bar_set_text( GTK_PROGRESS_BAR(pbar), tmp_str);
+    // Called again by file_open_progress_notify() when there is news
+    return FALSE;
+}
 
-        return TRUE;
-    }
+/* Runs on the analysis workers, the UI is updated from the main loop */
+static void
+file_open_progress_notify(ProgressChannel *progress, void *user_data)
+{
+    g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, file_open_progress_idle_func,
+            progress_channel_ref(progress), (GDestroyNotify)progress_channel_unref);
 }
 
 static void open_file(const char *filename) {
+    audition_stop();
+
     if (g_sample != NULL) {
         sample_close(g_steal_pointer(&g_sample));
     }
 
+    if (file_open_progress != NULL) {
+        progress_channel_unref(g_steal_pointer(&file_open_progress));
+    }
+    file_open_progress = progress_channel_new(FILE_OPEN_PROGRESS_INTERVAL_MS, file_open_progress_notify, NULL, NULL);
+
     char *error_message = NULL;
-    if ((g_sample = sample_open(filename, &error_message)) == NULL) {
+    if ((g_sample = sample_open(filename, file_open_progress, &error_message)) == NULL) {
+        progress_channel_unref(g_steal_pointer(&file_open_progress));
         popupmessage_show(main_window, _("Error opening file"), error_message);
         g_free(error_message);
         return;
@@ -1215,6 +1213,7 @@ static void open_file(const char *filename) {
     set_action_enabled("auto_rename", TRUE);
     set_action_enabled("remove_break", TRUE);
     set_action_enabled("jump_break", TRUE);
+    set_action_enabled("audition", TRUE);
 
     set_action_enabled("export", TRUE);
     set_action_enabled("import", TRUE);
@@ -1249,10 +1248,8 @@ static void open_file(const char *filename) {
     track_breaks = track_break_list_new(sample_get_basename_without_extension(g_sample));
     track_break_add_entry();
 
-    if (file_open_progress_source_id) {
-        g_source_remove(file_open_progress_source_id);
-    }
-    file_open_progress_source_id = g_timeout_add(100, file_open_progress_idle_func, g_sample);
+    file_open_reset_view(g_sample);
+
     set_title(sample_get_basename(g_sample));
 }
 
@@ -1384,6 +1381,9 @@ static gboolean redraw_later( gpointer data)
 
     int *redraw_done = (int*)data;
 
+    /* analyze the visible part first if the analysis is still running */
+    sample_set_analysis_focus(g_sample, pixmap_offset, gtk_widget_get_allocated_width(draw));
+
     struct WaveformSurfaceDrawContext ctx = {
         .widget = draw,
         .pixmap_offset = pixmap_offset,
@@ -1994,6 +1994,23 @@ static void update_status(gboolean update_time_offset) {
         strcat(str, strbuf);
     }
 
+    if (audition.active) {
+        strcat( str, "\t");
+        guint done = audition.accepted + audition.skipped;
+        if (audition.skipped > 0) {
+            sprintf( strbuf, _("Audition: break %u of %u, %u skipped"), MIN(done + 1, audition.total), audition.total, audition.skipped);
+        } else {
+            sprintf( strbuf, _("Audition: break %u of %u"), MIN(done + 1, audition.total), audition.total);
+        }
+        strcat(str, strbuf);
+    }
+
+    if (!sample_is_loaded(g_sample)) {
+        strcat( str, "\t");
+        sprintf( strbuf, _("Analyzing: %d%%"), (int)(100 * sample_get_load_percentage(g_sample)));
+        strcat(str, strbuf);
+    }
+
     gtk_header_bar_set_subtitle(GTK_HEADER_BAR(header_bar), str);
 }
 
@@ -2008,10 +2025,10 @@ static void menu_play(GtkWidget *widget, gpointer user_data)
 
     switch (sample_play(g_sample, cursor_marker)) {
         case 0:
-            if (play_progress_source_id) {
-                g_source_remove(play_progress_source_id);
+            if (play_progress_tick_id) {
+                gtk_widget_remove_tick_callback(draw, play_progress_tick_id);
             }
-            play_progress_source_id = g_timeout_add(10, file_play_progress_idle_func, NULL);
+            play_progress_tick_id = gtk_widget_add_tick_callback(draw, file_play_progress_tick_func, NULL, NULL);
             set_stop_icon();
             break;
         case 1:
@@ -2037,8 +2054,233 @@ static void set_play_icon() {
 
 static void menu_stop(GtkWidget *widget, gpointer user_data)
 {
+    audition_stop();
+
+    if (g_sample != NULL) {
+        sample_stop(g_sample);
+    }
+}
+
+static guint
+audition_context_blocks()
+{
+    return appconfig_get_audition_seconds() * CD_BLOCKS_PER_SEC;
+}
+
+static void
+audition_set_actions_enabled(gboolean enabled)
+{
+    set_action_enabled("audition_accept", enabled);
+    set_action_enabled("audition_skip", enabled);
+    set_action_enabled("audition_nudge", enabled);
+    set_action_enabled("audition_stop", enabled);
+}
+
+/* Play the region around the first break in the queue */
+static void
+audition_play_current()
+{
+    // Breaks may have been removed from the list in the meantime
+    GList *cur = audition.queue;
+    while (cur != NULL) {
+        GList *next = cur->next;
+        if (g_list_find(track_breaks->breaks, cur->data) == NULL) {
+            audition.queue = g_list_delete_link(audition.queue, cur);
+            --audition.total;
+        }
+        cur = next;
+    }
+
+    if (audition.queue == NULL) {
+        audition_stop();
+        set_play_icon();
+        update_status(FALSE);
+        return;
+    }
+
+    TrackBreak *track_break = audition.queue->data;
+
+    gulong offsets[AUDITION_PREFETCH_BREAKS];
+    guint n = 0;
+    for (cur = audition.queue; cur != NULL && n < AUDITION_PREFETCH_BREAKS; cur = cur->next) {
+        offsets[n++] = ((TrackBreak *)cur->data)->offset;
+    }
+    sample_audition_prefetch(g_sample, offsets, n, audition_context_blocks());
+
+    cursor_marker = track_break->offset;
+    select_and_show_track_break(g_list_index(track_breaks->breaks, track_break));
+    reset_sample_display(cursor_marker);
+
+    if (sample_play_transition(g_sample, track_break->offset, audition_context_blocks()) != 0) {
+        audition_stop();
+        set_play_icon();
+        update_status(FALSE);
+        return;
+    }
+
+    if (play_progress_tick_id) {
+        gtk_widget_remove_tick_callback(draw, play_progress_tick_id);
+    }
+    play_progress_tick_id = gtk_widget_add_tick_callback(draw, file_play_progress_tick_func, NULL, NULL);
+    set_stop_icon();
+
+    update_status(FALSE);
+    redraw();
+}
+
+/* The first break in the queue is accepted */
+static void
+audition_next()
+{
+    audition.queue = g_list_delete_link(audition.queue, audition.queue);
+    ++audition.accepted;
+
+    audition_play_current();
+}
+
+static void
+audition_stop()
+{
+    if (!audition.active) {
+        return;
+    }
+
+    audition.active = FALSE;
+    g_list_free(g_steal_pointer(&audition.queue));
+    audition_set_actions_enabled(FALSE);
+
     if (g_sample != NULL) {
         sample_stop(g_sample);
+        sample_audition_end(g_sample);
+    }
+}
+
+static void
+menu_audition(GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+    if (g_sample == NULL) {
+        return;
+    }
+
+    menu_stop(NULL, NULL);
+
+    // The first break starts the file, there is no transition to hear
+    for (GList *cur = track_breaks->breaks; cur != NULL; cur = cur->next) {
+        TrackBreak *track_break = cur->data;
+
+        if (track_break->write && track_break->offset > 0) {
+            audition.queue = g_list_append(audition.queue, track_break);
+        }
+    }
+
+    if (audition.queue == NULL) {
+        popupmessage_show(main_window, _("Nothing to audition"), _("There are no enabled track breaks after the start of the file."));
+        return;
+    }
+
+    audition.active = TRUE;
+    audition.accepted = 0;
+    audition.skipped = 0;
+    audition.total = g_list_length(audition.queue);
+    audition_set_actions_enabled(TRUE);
+
+    // The audition keys go to the waveform (or the track list)
+    gtk_widget_grab_focus(draw);
+
+    audition_play_current();
+}
+
+static void
+menu_audition_accept(GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+    if (audition.active) {
+        audition_next();
+    }
+}
+
+static void
+menu_audition_skip(GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+    if (!audition.active || audition.queue == NULL) {
+        return;
+    }
+
+    // Left as it is, without counting it as accepted
+    audition.queue = g_list_delete_link(audition.queue, audition.queue);
+    ++audition.skipped;
+
+    audition_play_current();
+}
+
+static void
+menu_audition_nudge(GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+    if (!audition.active || audition.queue == NULL) {
+        return;
+    }
+
+    TrackBreak *track_break = audition.queue->data;
+    GList *link = g_list_find(track_breaks->breaks, track_break);
+    if (link == NULL) {
+        audition_play_current();
+        return;
+    }
+
+    // Stay between the neighbouring breaks, so that the list stays sorted
+    glong min_offset = (link->prev != NULL) ? ((TrackBreak *)link->prev->data)->offset + 1 : 0;
+    glong max_offset = (link->next != NULL) ? ((TrackBreak *)link->next->data)->offset - 1 : (glong)sample_get_num_sample_blocks(g_sample) - 1;
+
+    glong offset = (glong)track_break->offset + g_variant_get_int32(parameter);
+    track_break->offset = CLAMP(offset, min_offset, MAX(min_offset, max_offset));
+
+    track_break_update_gui_model();
+
+    // Listen to the transition again at the new position
+    audition_play_current();
+}
+
+static void
+menu_audition_stop(GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+    menu_stop(NULL, NULL);
+    set_play_icon();
+    update_status(FALSE);
+}
+
+/**
+ * Audition keys of the waveform and the track list. Only handled while they
+ * have the focus, so that the keys still work as usual in a track name being
+ * edited (or anywhere else).
+ **/
+static gboolean
+audition_key_press(GtkWidget *widget, GdkEventKey *event, gpointer user_data)
+{
+    if (!audition.active || !gtk_widget_is_focus(widget)) {
+        return FALSE;
+    }
+
+    gint step = (event->state & GDK_SHIFT_MASK) ? 15 : 1;
+    GActionGroup *actions = G_ACTION_GROUP(main_window);
+
+    switch (event->keyval) {
+        case GDK_KEY_Return:
+        case GDK_KEY_KP_Enter:
+            g_action_group_activate_action(actions, "audition_accept", NULL);
+            return TRUE;
+        case GDK_KEY_space:
+            g_action_group_activate_action(actions, "audition_skip", NULL);
+            return TRUE;
+        case GDK_KEY_Left:
+            g_action_group_activate_action(actions, "audition_nudge", g_variant_new_int32(-step));
+            return TRUE;
+        case GDK_KEY_Right:
+            g_action_group_activate_action(actions, "audition_nudge", g_variant_new_int32(step));
+            return TRUE;
+        case GDK_KEY_Escape:
+            g_action_group_activate_action(actions, "audition_stop", NULL);
+            return TRUE;
+        default:
+            return FALSE;
     }
 }
 
@@ -2050,7 +2292,8 @@ menu_jump_to(GtkWidget *widget, gpointer user_data)
 
 static void menu_next_silence( GtkWidget* widget, gpointer user_data)
 {
-    if (g_sample == NULL) {
+    /* silence detection needs the amplitude range of the whole file */
+    if (g_sample == NULL || !sample_is_loaded(g_sample)) {
         return;
     }
 
@@ -2077,7 +2320,8 @@ static void menu_next_silence( GtkWidget* widget, gpointer user_data)
 
 static void menu_prev_silence( GtkWidget* widget, gpointer user_data)
 {
-    if (g_sample == NULL) {
+    /* silence detection needs the amplitude range of the whole file */
+    if (g_sample == NULL || !sample_is_loaded(g_sample)) {
         return;
     }
 
@@ -2128,14 +2372,13 @@ void wavbreaker_write_files(char *dirname) {
     if (!sample_is_writing(g_sample)) {
         struct FileWriteProgressUI *ui = g_new0(struct FileWriteProgressUI, 1);
 
-        g_mutex_init(&ui->mutex);
+        g_mutex_init(&ui->overwrite_decision.mutex);
         g_cond_init(&ui->overwrite_decision.cond);
 
+        ui->progress = progress_channel_new(WRITE_PROGRESS_INTERVAL_MS, file_write_progress_notify, ui, file_write_progress_ui_free);
+
         ui->callbacks = (WriteStatusCallbacks) {
-            .on_file_changed = file_write_progress_ui_on_file_changed,
-            .on_file_progress_changed = file_write_progress_ui_on_file_progress_changed,
-            .on_error = file_write_progress_ui_on_error,
-            .on_finished = file_write_progress_ui_on_finished,
+            .progress = ui->progress,
 
             .is_cancelled = file_write_progress_ui_is_cancelled,
             .ask_overwrite = file_write_progress_ui_ask_overwrite,
@@ -2143,9 +2386,17 @@ void wavbreaker_write_files(char *dirname) {
             .user_data = ui,
         };
 
-        sample_write_files(g_sample, track_breaks, &ui->callbacks, dirname);
+        WriteOptions options = {
+            .jobs = appconfig_get_split_jobs(),
+            .single_pass = appconfig_get_split_single_pass(),
+            .codec = appconfig_get_split_codec(),
+            .write_policy = appconfig_get_split_write_policy(),
+        };
+
+        sample_write_files(g_sample, track_breaks, &ui->callbacks, dirname, &options);
 
-        ui->source_id = g_timeout_add(50, file_write_progress_idle_func, ui);
+        // Show the progress window right away
+        file_write_progress_notify(ui->progress, ui);
 
         current_file_write_progress_ui = ui;
     }
@@ -2391,8 +2642,24 @@ static void save_window_sizes()
 }
 
 void wavbreaker_quit() {
+    audition_stop();
+
+    if (current_file_write_progress_ui != NULL) {
+        struct FileWriteProgressUI *ui = current_file_write_progress_ui;
+
+        // TODO: Would need to properly tear down the progress UI
+        g_atomic_int_set(&ui->cancelled, TRUE);
+
+        // Unblock a write thread waiting for an overwrite decision, sample_close() joins it
+        g_mutex_lock(&ui->overwrite_decision.mutex);
+        if (ui->overwrite_decision.result == OVERWRITE_DECISION_ASK) {
+            ui->overwrite_decision.result = OVERWRITE_DECISION_SKIP_ALL;
+            g_cond_signal(&ui->overwrite_decision.cond);
+        }
+        g_mutex_unlock(&ui->overwrite_decision.mutex);
+    }
+
     if (g_sample != NULL) {
-        sample_stop(g_sample);
         sample_close(g_steal_pointer(&g_sample));
     }
 
@@ -2400,20 +2667,13 @@ void wavbreaker_quit() {
         track_break_list_free(g_steal_pointer(&track_breaks));
     }
 
-    if (current_file_write_progress_ui != NULL) {
-        // TODO: Would need to properly tear down the progress UI
-        g_source_remove(current_file_write_progress_ui->source_id);
-        current_file_write_progress_ui->source_id = 0;
-    }
-
     if (open_file_source_id) {
         g_source_remove(open_file_source_id);
         open_file_source_id = 0;
     }
 
-    if (file_open_progress_source_id) {
-        g_source_remove(file_open_progress_source_id);
-        file_open_progress_source_id = 0;
+    if (file_open_progress != NULL) {
+        progress_channel_unref(g_steal_pointer(&file_open_progress));
     }
 
     if (redraw_source_id) {
@@ -2421,9 +2681,9 @@ void wavbreaker_quit() {
         redraw_source_id = 0;
     }
 
-    if (play_progress_source_id) {
-        g_source_remove(play_progress_source_id);
-        play_progress_source_id = 0;
+    if (play_progress_tick_id) {
+        gtk_widget_remove_tick_callback(draw, play_progress_tick_id);
+        play_progress_tick_id = 0;
     }
 
     save_window_sizes();
@@ -2570,6 +2830,12 @@ do_activate(GApplication *app, gpointer user_data)
         { "auto_rename", menu_rename, NULL, NULL, NULL, },
         { "remove_break", menu_delete_track_break, NULL, NULL, NULL, },
         { "jump_break", jump_to_track_break, NULL, NULL, NULL, },
+
+        { "audition", menu_audition, NULL, NULL, NULL, },
+        { "audition_accept", menu_audition_accept, NULL, NULL, NULL, },
+        { "audition_skip", menu_audition_skip, NULL, NULL, NULL, },
+        { "audition_nudge", menu_audition_nudge, "i", NULL, NULL, },
+        { "audition_stop", menu_audition_stop, NULL, NULL, NULL, },
     };
 
     g_action_map_add_action_entries(G_ACTION_MAP(main_window),
@@ -2586,6 +2852,8 @@ do_activate(GApplication *app, gpointer user_data)
     set_action_enabled("auto_rename", FALSE);
     set_action_enabled("remove_break", FALSE);
     set_action_enabled("jump_break", FALSE);
+    set_action_enabled("audition", FALSE);
+    audition_set_actions_enabled(FALSE);
 
     set_action_enabled("export", FALSE);
     set_action_enabled("import", FALSE);
@@ -2709,10 +2977,14 @@ do_activate(GApplication *app, gpointer user_data)
              G_CALLBACK(button_release), NULL);
     g_signal_connect(G_OBJECT(draw), "scroll-event",
              G_CALLBACK(scroll_event), NULL);
+    g_signal_connect(G_OBJECT(draw), "key-press-event",
+             G_CALLBACK(audition_key_press), NULL);
 
     gtk_widget_add_events(draw, GDK_BUTTON_RELEASE_MASK);
     gtk_widget_add_events(draw, GDK_BUTTON_PRESS_MASK);
     gtk_widget_add_events(draw, GDK_BUTTON_MOTION_MASK);
+    gtk_widget_add_events(draw, GDK_KEY_PRESS_MASK);
+    gtk_widget_set_can_focus(draw, TRUE);
 
     frame = gtk_frame_new(NULL);
     gtk_frame_set_shadow_type(GTK_FRAME(frame), GTK_SHADOW_IN);
@@ -2872,6 +3144,8 @@ do_shutdown(GApplication *application, gpointer user_data)
     waveform_surface_free(sample_surface);
     waveform_surface_free(summary_surface);
 
+    sample_shutdown();
+
     appconfig_write_file();
 }
 
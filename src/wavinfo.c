@@ -32,7 +32,7 @@ int cmd_wavinfo(int argc, char *argv[])
 
     for (int i = 1; i < argc; i++) {
         char *error_message = NULL;
-        OpenedAudioFile *oaf = format_open_file(argv[i], &error_message);
+        OpenedAudioFile *oaf = format_open_file(argv[i], FORMAT_OPEN_DEFAULT, &error_message);
 
         if (oaf == NULL) {
             printf("Error opening %s: %s\n", argv[i], error_message);
@@ -65,7 +65,10 @@ cmd_wavmerge(int argc, char *argv[])
 
     ret = wav_merge_files(merge_filename, num_files, filenames, NULL);
 
-    if (ret != 0) {
+    if (ret == WAV_MERGE_IO_ERROR) {
+        fprintf(stderr, "ERROR: Could not merge the files into %s.\n", merge_filename);
+        return 1;
+    } else if (ret != WAV_MERGE_OK) {
         fprintf(stderr,
 "ERROR: The files are not of the same format.\n\n"
 "This means that the sample rate, bits per sample, etc. are different.\n"